@@ -0,0 +1,456 @@
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <iostream>
+#include "./Renderer.h"
+#include "./PixelOrder.h"
+#include "./accel/BVH.h"
+#include "./attributes/Textures.h"
+#include "./math/FastMath.h"
+#include "./math/CPUDispatch.h"
+#include "./primitives/Ray.h"
+#include "./primitives/Camera.h"
+#include "./primitives/Object.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#ifndef Benchmark_h
+#define Benchmark_h
+
+using namespace std;
+
+/**
+ * @brief Function that compares the node layouts of the BVH on a set of rays
+ *
+ * Every layout is built with the same builder and traces all the rays for
+ * their closest hit. The memory of the nodes and the traversal throughput are
+ * reported, relative to the full precision nodes of the same width and to the
+ * binary BVH respectively.
+ *
+ * @param camera The camera whose primary rays are traced
+ * @param objects The objects of the scene
+ * @param builder The algorithm used to build the hierarchies
+ */
+inline void benchmarkTraversal(const Camera &camera, const vector<Object *> &objects, BVHBuilder builder) {
+	vector<Ray> rays;
+
+	for (int i = 0; i < camera.width; i++) {
+		for (int j = 0; j < camera.height; j++) rays.push_back(camera.generateRay(i, j));
+	}
+
+	const int layouts[][2] = {{2, 32}, {4, 32}, {4, 16}, {4, 8}, {8, 32}, {8, 16}, {8, 8}};
+	double reference = 0.0;
+
+	cout << "Traversal benchmark over " << rays.size() << " rays:" << endl;
+
+	for (const int *layout : layouts) {
+		BVH accelerator;
+		accelerator.build(objects, builder, layout[0], layout[1]);
+
+		auto start = chrono::steady_clock::now();
+		int hits = 0;
+
+		for (const Ray &ray : rays) {
+			if (accelerator.intersect(ray, objects).hit) hits++;
+		}
+
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		double throughput = seconds > 0 ? rays.size() / seconds / 1e6 : 0.0;
+		if (reference == 0.0) reference = throughput;
+
+		BVHBuildStats stats = accelerator.stats;
+		cout << "  BVH" << stats.width << " " << stats.precision << " bit: " << stats.nodes << " nodes, " << stats.bytes << " bytes";
+		cout << " (" << 100.0 * (1.0 - (double)stats.bytes / stats.full_bytes) << "% saved";
+		if (stats.precision < 32 && stats.bytes >= stats.full_bytes) cout << ", the padding of the nodes cancels the compression";
+		cout << "), ";
+		cout << throughput << " Mrays/s (" << 100.0 * throughput / reference << "% of BVH2), " << hits << " hits" << endl;
+	}
+}
+
+/**
+ * @brief Function that compares a libm function with its approximation
+ *
+ * @param name The name of the function
+ * @param count The number of samples
+ * @param argument Called as argument(k) to get the arguments of sample k
+ * @param precise The libm function
+ * @param fast The approximation
+ * @param fast4 The SSE2 version of the approximation, called on 4 samples at a time
+ * @param relative Whether to report the relative rather than the absolute error, over the results in the normal range
+ */
+template <typename Argument, typename Precise, typename Fast, typename Fast4>
+void benchmarkFunction(const char * name, int count, Argument argument, Precise precise, Fast fast, Fast4 fast4, bool relative) {
+	vector<glm::vec2> arguments(count);
+	for (int k = 0; k < count; k++) arguments[k] = argument(k);
+
+	double seconds[2];
+	float sum[2] = {0.0, 0.0};
+	double error = 0.0;
+
+	for (int mode = 0; mode < 2; mode++) {
+		auto start = chrono::steady_clock::now();
+
+		for (const glm::vec2 &x : arguments) sum[mode] += mode == 0 ? precise(x.x, x.y) : fast(x.x, x.y);
+
+		seconds[mode] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+
+#if defined(__SSE2__)
+	// The SSE2 version computes the same operations as the scalar one, so it is checked for the same results
+	vector<float> results(count);
+	auto start = chrono::steady_clock::now();
+
+	for (int k = 0; k + 4 <= count; k += 4) {
+		const glm::vec2 * x = &arguments[k];
+		__m128 first = _mm_setr_ps(x[0].x, x[1].x, x[2].x, x[3].x);
+		__m128 second = _mm_setr_ps(x[0].y, x[1].y, x[2].y, x[3].y);
+		_mm_storeu_ps(&results[k], fast4(first, second));
+	}
+
+	double vector_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	int mismatches = 0;
+
+	for (int k = 0; k < count / 4 * 4; k++) {
+		float scalar = fast(arguments[k].x, arguments[k].y);
+		mismatches += memcmp(&scalar, &results[k], sizeof(float)) != 0;
+	}
+#else
+	(void)fast4;
+#endif
+
+	for (const glm::vec2 &x : arguments) {
+		double reference = precise(x.x, x.y);
+		double difference = fabs(fast(x.x, x.y) - reference);
+		error = max(error, relative ? (fabs(reference) >= FLT_MIN ? difference / fabs(reference) : 0.0) : difference);
+	}
+
+	cout << "  " << name << ": max " << (relative ? "relative" : "absolute") << " error " << error;
+	cout << ", " << seconds[0] / max(seconds[1], 1e-9) << "x faster";
+#if defined(__SSE2__)
+	cout << ", SSE2 " << seconds[0] / max(vector_seconds, 1e-9) << "x faster with " << mismatches << " results differing from the scalar ones";
+#endif
+	cout << " (checksums " << sum[0] << ", " << sum[1] << ")" << endl;
+}
+
+/**
+ * @brief Function that reports the error and speed of the fast math approximations
+ */
+inline void benchmarkMath() {
+#if defined(__SSE2__)
+	#define FAST4(call) [](__m128 first, __m128 second) { (void)second; return call; }
+#else
+	#define FAST4(call) 0
+#endif
+
+	const int count = 1 << 20;
+
+	cout << "Fast math benchmark over " << count << " samples:" << endl;
+
+	benchmarkFunction("sqrt", count, [](int k) { return glm::vec2((k + 1) * 1e-4f, 0.0f); },
+		[](float x, float) { return sqrtf(x); }, [](float x, float) { return fastSqrt(x); }, FAST4(fastSqrt4(first)), true);
+	benchmarkFunction("asin", count, [&](int k) { return glm::vec2(2.0f * k / (count - 1) - 1.0f, 0.0f); },
+		[](float x, float) { return asinf(x); }, [](float x, float) { return fastAsin(x); }, FAST4(fastAsin4(first)), false);
+	benchmarkFunction("atan2", count, [&](int k) { return glm::vec2(sin(2 * M_PI * k / count), cos(2 * M_PI * k / count)); },
+		[](float y, float x) { return atan2f(y, x); }, [](float y, float x) { return fastAtan2(y, x); }, FAST4(fastAtan24(first, second)), false);
+	benchmarkFunction("pow", count, [&](int k) { return glm::vec2((k % 8192 + 1) / 8192.0f, (float)(k / 8192)); },
+		[](float x, float y) { return powf(x, y); }, [](float x, float y) { return fastPow(x, y); }, FAST4(fastPow4(first, second)), true);
+}
+
+#undef FAST4
+
+/**
+ * @brief Function that times a dispatched kernel at every instruction set level supported by the CPU
+ *
+ * The results of every level are checked bit for bit against those of the
+ * baseline level. The selected level is restored afterwards.
+ *
+ * @param name The name of the kernel
+ * @param tests The number of calls of the kernel made by run
+ * @param run Called as run(results) at every level, runs the kernel selected for the level and appends its results
+ */
+template <typename Run>
+void benchmarkLevels(const char * name, long long tests, Run run) {
+	ISALevel selected = active_isa;
+	ISALevel supported = detectISA();
+	vector<float> reference;
+
+	cout << "  " << name << ":";
+
+	for (ISALevel level : {ISA_BASELINE, ISA_SSE42, ISA_AVX2, ISA_AVX512}) {
+		if (level > supported) break;
+		setISA(level);
+
+		vector<float> results;
+		auto start = chrono::steady_clock::now();
+		run(results);
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		if (reference.empty()) reference = results;
+		bool same = results.size() == reference.size() && memcmp(results.data(), reference.data(), results.size() * sizeof(float)) == 0;
+
+		cout << " " << isaName(level) << " " << (seconds > 0 ? tests / seconds / 1e6 : 0.0) << (same ? "" : " (DIFFERENT results)");
+	}
+
+	cout << " Mcalls/s" << endl;
+	setISA(selected);
+}
+
+/**
+ * @brief Function that compares the instruction set levels of the dispatched kernels
+ *
+ * The box test of the 8-ary BVH is run on random nodes and rays, and the
+ * procedural textures on random lookups.
+ */
+inline void benchmarkKernels() {
+	const int count = 1 << 12, repeats = 256;
+	vector<WideBVHNode<8>> nodes(count);
+	vector<WideRay> rays;
+
+	srand(1);
+	auto random = []() { return (float)rand() / RAND_MAX; };
+
+	for (WideBVHNode<8> &node : nodes) {
+		for (int i = 0; i < 8; i++) {
+			glm::vec3 low(random(), random(), random());
+			node.setChild(i, AABB(4.0f * low - 2.0f, 4.0f * low - 2.0f + glm::vec3(random(), random(), random())), i, 0);
+		}
+	}
+
+	for (int k = 0; k < count; k++) {
+		glm::vec3 direction = glm::normalize(glm::vec3(random(), random(), random()) - 0.5f);
+		rays.push_back(WideRay(Ray(-4.0f * direction, direction)));
+	}
+
+	cout << "Kernel benchmark over " << (long long)count * repeats << " calls, CPU supports " << isaName(detectISA()) << ":" << endl;
+
+	// The run keeps the masks and the entry distances of its first repeat
+	benchmarkLevels("box tests of 8 children", (long long)count * repeats, [&](vector<float> &results) {
+		ChildrenKernel<8> kernel = childrenKernel<8>();
+
+		for (int r = 0; r < repeats; r++) {
+			for (int k = 0; k < count; k++) {
+				float t_near[8];
+				int mask = kernel(nodes[k], rays[(k + r) % count], INFINITY, t_near);
+				if (r == 0) {
+					results.push_back(mask);
+					results.insert(results.end(), t_near, t_near + 8);
+				}
+			}
+		}
+	});
+
+	// Lookups over a few squares and stripes, a quarter of them point sampled
+	vector<float> u(count), v(count), width_u(count), width_v(count), colors[3];
+	for (int c = 0; c < 3; c++) colors[c].resize(count);
+
+	for (int k = 0; k < count; k++) {
+		u[k] = 0.4f * random() - 0.2f;
+		v[k] = 0.4f * random() - 0.2f;
+		width_u[k] = k % 4 == 0 ? 0.0f : 0.01f * random();
+		width_v[k] = k % 4 == 0 ? 0.0f : 0.01f * random();
+	}
+
+	TextureBatch batch;
+	batch.count = count;
+	batch.u = u.data();
+	batch.v = v.data();
+	batch.width_u = width_u.data();
+	batch.width_v = width_v.data();
+	batch.r = colors[0].data();
+	batch.g = colors[1].data();
+	batch.b = colors[2].data();
+
+	const char * names[2] = {"checkerboard lookups", "rainbow lookups"};
+	glm::vec3 (* textures[2])(glm::vec2, glm::vec2) = {&checkerboardTexture, &rainbowTexture};
+
+	for (int t = 0; t < 2; t++) {
+		benchmarkLevels(names[t], (long long)count * repeats, [&](vector<float> &results) {
+			for (int r = 0; r < repeats; r++) evaluateTextures(textures[t], batch);
+			for (int c = 0; c < 3; c++) results.insert(results.end(), colors[c].begin(), colors[c].end());
+		});
+	}
+}
+
+/**
+ * @brief CacheCounters structure
+ *
+ * This structure counts the cache references and misses of the process and
+ * of the threads it starts, with the hardware counters of Linux. The
+ * counters are unavailable on other systems and in most virtual machines.
+ */
+struct CacheCounters {
+	int references = -1; ///< Counter of the cache references, -1 if unavailable
+	int misses = -1; ///< Counter of the cache misses, -1 if unavailable
+
+	/**
+	 * @brief Open and start the counters
+	 */
+	CacheCounters() {
+#if defined(__linux__)
+		references = open(PERF_COUNT_HW_CACHE_REFERENCES);
+		misses = open(PERF_COUNT_HW_CACHE_MISSES);
+#endif
+	}
+
+	CacheCounters(const CacheCounters &) = delete;
+	CacheCounters & operator=(const CacheCounters &) = delete;
+
+	/**
+	 * @brief Close the counters
+	 */
+	~CacheCounters() {
+#if defined(__linux__)
+		if (references >= 0) close(references);
+		if (misses >= 0) close(misses);
+#endif
+	}
+
+	/**
+	 * @brief Read a counter, the threads that were started having exited
+	 *
+	 * @return The count, or -1 if the counter is unavailable
+	 */
+	long long read(int counter) const {
+		long long value = -1;
+#if defined(__linux__)
+		if (counter < 0 || ::read(counter, &value, sizeof(value)) != sizeof(value)) return -1;
+#endif
+		return value;
+	}
+
+private:
+#if defined(__linux__)
+	static int open(unsigned long long config) {
+		perf_event_attr attributes;
+		memset(&attributes, 0, sizeof(attributes));
+		attributes.type = PERF_TYPE_HARDWARE;
+		attributes.size = sizeof(attributes);
+		attributes.config = config;
+		attributes.inherit = 1;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+
+		return syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+	}
+#endif
+};
+
+/**
+ * @brief Function that compares the pixel orders on the image of a camera
+ *
+ * Every order renders the image into a row-major framebuffer, with the
+ * hardware cache counters when they are available. Two measures of the
+ * locality of the order do not need them: the fraction of consecutive
+ * pixels of a thread whose primary rays hit different objects, and the
+ * average distance in the framebuffer between consecutive writes. The
+ * reference is the original loop of the renderer, column by column, whose
+ * consecutive writes are a row of the framebuffer apart.
+ *
+ * @param context The committed scene, its pixel order is restored afterwards
+ * @param camera The camera rendering the image
+ */
+inline void benchmarkPixelOrder(RenderContext &context, const Camera &camera) {
+	PixelOrder selected = context.pixel_order;
+	Region region = fullRegion(camera);
+
+	cout << "Pixel order benchmark over " << region.width << "x" << region.height << " pixels, tiles of " << context.tile_size << ":" << endl;
+
+	struct {
+		const char * name; ///< The name printed for the order
+		bool columns; ///< Whether columns rather than rows or tiles are handed to the threads
+		PixelOrder order; ///< The order of the renderer otherwise
+	} orders[] = {{"column", true, ORDER_SCANLINE}, {"scanline", false, ORDER_SCANLINE}, {"morton", false, ORDER_MORTON}, {"hilbert", false, ORDER_HILBERT}};
+
+	for (const auto &candidate : orders) {
+		PixelOrder order = candidate.order;
+		context.pixel_order = order;
+
+		// The pixels a thread renders and writes, every column, row or tile being taken whole
+		vector<glm::ivec2> renders, writes;
+
+		if (candidate.columns) {
+			for (int i = 0; i < region.width; i++) {
+				for (int j = 0; j < region.height; j++) writes.push_back(glm::ivec2(i, j));
+			}
+
+			renders = writes;
+		} else if (order == ORDER_SCANLINE) {
+			for (int j = 0; j < region.height; j++) {
+				for (int i = 0; i < region.width; i++) writes.push_back(glm::ivec2(i, j));
+			}
+
+			renders = writes;
+		} else {
+			int size = context.tile_size;
+			vector<glm::ivec2> tile = tileOrder(order, size);
+
+			for (int y = 0; y < region.height; y += size) {
+				for (int x = 0; x < region.width; x += size) {
+					int width = min(size, region.width - x);
+					int height = min(size, region.height - y);
+
+					for (glm::ivec2 offset : tile) {
+						if (offset.x < width && offset.y < height) renders.push_back(glm::ivec2(x, y) + offset);
+					}
+
+					for (int dy = 0; dy < height; dy++) {
+						for (int dx = 0; dx < width; dx++) writes.push_back(glm::ivec2(x + dx, y + dy));
+					}
+				}
+			}
+		}
+
+		long long switches = 0, jumps = 0;
+		const Object * previous = NULL;
+
+		for (int k = 0; k < (int)renders.size(); k++) {
+			Hit hit = context.bvh.intersect(camera.generateRay(renders[k].x, renders[k].y), context.objects);
+			const Object * object = hit.hit ? hit.object : NULL;
+
+			if (k > 0) {
+				switches += object != previous;
+				jumps += abs((writes[k].y - writes[k - 1].y) * region.width + writes[k].x - writes[k - 1].x);
+			}
+
+			previous = object;
+		}
+
+		vector<glm::vec3> framebuffer((size_t)region.width * region.height);
+		CacheCounters counters;
+		auto start = chrono::steady_clock::now();
+
+		if (candidate.columns) {
+			parallelFor(region.x, region.x + region.width, [&](int i) {
+				for (int j = region.y; j < region.y + region.height; j++) framebuffer[(size_t)j * region.width + i] = renderPixel(context, camera, i, j);
+			});
+		} else {
+			renderRegion(context, camera, region, [&](int i, int j, glm::vec3 color) {
+				framebuffer[(size_t)j * region.width + i] = color;
+			});
+		}
+
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		long long references = counters.read(counters.references);
+		long long misses = counters.read(counters.misses);
+
+		cout << "  " << candidate.name << ": " << seconds << " seconds, ";
+		if (references > 0 && misses >= 0) {
+			cout << misses << " cache misses (" << 100.0 * misses / references << "% of the references), ";
+		} else {
+			cout << "cache counters unavailable, ";
+		}
+		cout << 100.0 * switches / (renders.size() - 1) << "% object switches, " << (double)jumps / (writes.size() - 1) << " pixels between writes" << endl;
+	}
+
+	context.pixel_order = selected;
+}
+
+#endif /* Benchmark_h */
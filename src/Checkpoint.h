@@ -0,0 +1,290 @@
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../lib/glm.hpp"
+#include "./PixelOrder.h"
+#include "./Renderer.h"
+#include "./RenderContext.h"
+#include "./accel/Parallel.h"
+#include "./primitives/Camera.h"
+
+#ifndef Checkpoint_h
+#define Checkpoint_h
+
+using namespace std;
+
+#define CHECKPOINT_MAGIC 0x504B4352 ///< "RCKP" read as a little endian int
+#define CHECKPOINT_VERSION 2 ///< Version of the on-disk layout
+#define CHECKPOINT_TILE 64 ///< Width and height of the tiles whose completion is recorded
+#define CHECKPOINT_INTERVAL 30 ///< Default number of seconds between two checkpoints
+
+/**
+ * @brief CheckpointHeader structure
+ *
+ * This structure starts a checkpoint file. It is followed by one byte per
+ * tile, row by row, set for the completed tiles, then by the float colors
+ * of the completed tiles only, each tile row by row.
+ */
+struct CheckpointHeader {
+	int magic = CHECKPOINT_MAGIC; ///< Identifies the file format
+	int version = CHECKPOINT_VERSION; ///< Version of the layout
+	int width = 0; ///< Width of the image
+	int height = 0; ///< Height of the image
+	int tile_size = CHECKPOINT_TILE; ///< Width and height of a tile
+	int tiles = 0; ///< Number of tiles of the image
+	uint64_t job = 0; ///< Hash of the arguments of the render, see jobHash
+};
+
+static_assert(sizeof(CheckpointHeader) == 32, "The header has no padding, so headers compare bytewise");
+
+/**
+ * @brief Function that hashes the arguments of a render, so a checkpoint is only resumed by the same render
+ *
+ * @param arguments The arguments describing the scene and the render
+ * @return The FNV-1a hash of the arguments
+ */
+inline uint64_t jobHash(const vector<string> &arguments) {
+	uint64_t hash = 0xCBF29CE484222325ULL;
+
+	for (const string &argument : arguments) {
+		for (size_t k = 0; k <= argument.size(); k++) {
+			hash ^= (unsigned char)argument.c_str()[k];
+			hash *= 0x100000001B3ULL;
+		}
+	}
+
+	return hash;
+}
+
+/**
+ * @brief Function that flushes a file or a directory to the disk
+ *
+ * @param path The path of the file or directory
+ * @return False if it cannot be opened or flushed
+ */
+inline bool syncPath(const string &path) {
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0) return false;
+
+	bool synced = fsync(descriptor) == 0;
+	close(descriptor);
+
+	return synced;
+}
+
+/**
+ * @brief Checkpoint class
+ *
+ * This class renders an image tile by tile while a background thread saves
+ * the completed tiles to a file at regular intervals, so that a preempted
+ * render can be resumed. The render threads only write the colors of their
+ * tile and then publish it with a release store; the writer copies the
+ * published tiles without taking a lock, so saving never stalls them. The
+ * file is written aside and renamed over the previous checkpoint, so a
+ * checkpoint is complete even if the process is killed while writing. The
+ * file is flushed before the rename and its directory after it, so the
+ * same holds if the machine loses power.
+ *
+ * The colors are kept as floats and the shading uses counter-based random
+ * numbers, see Random.h, so a resumed render is identical to an
+ * uninterrupted one and there is no sampler state to save.
+ */
+class Checkpoint {
+public:
+	string path; ///< The checkpoint file
+	CheckpointHeader header; ///< Describes the image and the render
+	int tiles_x = 0; ///< Number of tiles in a row
+	int resumed = 0; ///< Number of completed tiles read by resume
+	atomic<int> written{0}; ///< Number of checkpoints written
+
+	/**
+	 * @brief Construct a new Checkpoint with no completed tile
+	 *
+	 * @param path The checkpoint file
+	 * @param width The width of the image
+	 * @param height The height of the image
+	 * @param job The hash of the arguments of the render, see jobHash
+	 */
+	Checkpoint(const string &path, int width, int height, uint64_t job): path(path) {
+		header.width = width;
+		header.height = height;
+		header.job = job;
+		tiles_x = (width + header.tile_size - 1) / header.tile_size;
+		header.tiles = tiles_x * ((height + header.tile_size - 1) / header.tile_size);
+		colors.assign((size_t)width * height, glm::vec3(0.0));
+		completed = vector<atomic<char>>(header.tiles);
+	}
+
+	Checkpoint(const Checkpoint &) = delete;
+	Checkpoint & operator=(const Checkpoint &) = delete;
+
+	/**
+	 * @brief Read the completed tiles of the checkpoint file
+	 *
+	 * @return False if the file does not exist, is damaged or belongs to another render
+	 */
+	bool resume() {
+		ifstream file(path, ios::binary);
+		CheckpointHeader stored;
+
+		if (!file.read((char *)&stored, sizeof(stored))) return false;
+		if (memcmp(&stored, &header, sizeof(header)) != 0) return false;
+
+		vector<char> bitmap(header.tiles);
+		if (!file.read(bitmap.data(), bitmap.size())) return false;
+
+		vector<glm::vec3> tile;
+
+		for (int t = 0; t < header.tiles; t++) {
+			if (!bitmap[t]) continue;
+
+			Region region = tileRegion(t);
+			tile.resize(region.width * region.height);
+			if (!file.read((char *)tile.data(), tile.size() * sizeof(glm::vec3))) return false;
+
+			for (int j = 0; j < region.height; j++) {
+				copy(tile.begin() + j * region.width, tile.begin() + (j + 1) * region.width, colors.begin() + (size_t)(region.y + j) * header.width + region.x);
+			}
+
+			completed[t].store(true, memory_order_relaxed);
+			resumed++;
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Render the tiles that are not completed yet using all the worker threads
+	 *
+	 * @param context The committed scene to render
+	 * @param camera The camera generating the primary rays, of the size of the checkpoint
+	 * @param interval The number of seconds between two checkpoints
+	 * @param store Called as store(i, j, color) once per pixel of the image, completed tiles included, after the render
+	 * @param budget The number of tiles to render before stopping, 0 for all of them
+	 * @return False if the budget stopped the render, the tiles are then saved and store is not called
+	 */
+	template <typename Function>
+	bool render(const RenderContext &context, const Camera &camera, int interval, Function store, int budget=0) {
+		vector<int> pending;
+		for (int t = 0; t < header.tiles; t++) {
+			if (!completed[t].load(memory_order_relaxed)) pending.push_back(t);
+		}
+
+		bool stopped = budget > 0 && budget < (int)pending.size();
+		if (stopped) pending.resize(budget);
+
+		thread writer([&]() {
+			unique_lock<mutex> guard(lock);
+
+			while (!finished) {
+				if (wake.wait_for(guard, chrono::seconds(interval), [&]() { return finished; })) break;
+				write();
+			}
+		});
+
+		vector<glm::ivec2> order = tileOrder(context.pixel_order, context.tile_size);
+
+		parallelFor(0, pending.size(), [&](int k) {
+			Region region = tileRegion(pending[k]);
+
+			renderTile(context, camera, region, order, [&](int i, int j, glm::vec3 color) {
+				colors[(size_t)j * header.width + i] = color;
+			});
+
+			completed[pending[k]].store(true, memory_order_release);
+		});
+
+		{
+			lock_guard<mutex> guard(lock);
+			finished = true;
+		}
+
+		wake.notify_all();
+		writer.join();
+
+		if (stopped) {
+			write();
+			return false;
+		}
+
+		for (int j = 0; j < header.height; j++) {
+			for (int i = 0; i < header.width; i++) store(i, j, colors[(size_t)j * header.width + i]);
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Remove the checkpoint file, once the image is saved
+	 */
+	void remove() {
+		std::remove(path.c_str());
+	}
+
+private:
+	vector<glm::vec3> colors; ///< The colors of the image, row by row
+	vector<atomic<char>> completed; ///< Whether every tile is completed, published with release stores
+	mutex lock; ///< Protects finished
+	condition_variable wake; ///< Wakes the writer when the render ends
+	bool finished = false; ///< Whether the render ended
+
+	/**
+	 * @brief Get the pixels of a tile
+	 */
+	Region tileRegion(int tile) const {
+		Region region;
+		region.x = (tile % tiles_x) * header.tile_size;
+		region.y = (tile / tiles_x) * header.tile_size;
+		region.width = min(header.tile_size, header.width - region.x);
+		region.height = min(header.tile_size, header.height - region.y);
+
+		return region;
+	}
+
+	/**
+	 * @brief Write the tiles completed so far aside, then rename the file over the checkpoint
+	 *
+	 * Without flushing the file first, a crash after the rename could leave
+	 * the checkpoint empty, and without flushing the directory after it, the
+	 * rename itself could be lost.
+	 */
+	void write() {
+		vector<char> bitmap(header.tiles);
+		for (int t = 0; t < header.tiles; t++) bitmap[t] = completed[t].load(memory_order_acquire);
+
+		string temporary = path + ".tmp";
+		ofstream file(temporary, ios::binary);
+		file.write((const char *)&header, sizeof(header));
+		file.write(bitmap.data(), bitmap.size());
+
+		for (int t = 0; t < header.tiles; t++) {
+			if (!bitmap[t]) continue;
+
+			Region region = tileRegion(t);
+
+			for (int j = 0; j < region.height; j++) {
+				file.write((const char *)&colors[(size_t)(region.y + j) * header.width + region.x], region.width * sizeof(glm::vec3));
+			}
+		}
+
+		file.close();
+
+		if (!file.good() || !syncPath(temporary) || rename(temporary.c_str(), path.c_str()) != 0) return;
+
+		size_t slash = path.rfind('/');
+		syncPath(slash == string::npos ? "." : path.substr(0, slash + 1));
+		written++;
+	}
+};
+
+#endif /* Checkpoint_h */
@@ -0,0 +1,339 @@
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "../lib/glm.hpp"
+#include "./accel/Parallel.h"
+#include "./math/FastMath.h"
+#include "./math/CPUDispatch.h"
+#include "./shader/GBuffer.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifndef Denoiser_h
+#define Denoiser_h
+
+using namespace std;
+
+#define DENOISE_PASSES 5 ///< Default number of passes, the taps of the last one being 2^(passes - 1) pixels apart
+#define DENOISE_SIGMA_COLOR 0.5f ///< Default color difference halving the weight of a neighbour in the first pass, shrinking by sqrt(2) per pass
+#define DENOISE_SIGMA_DEPTH 0.02f ///< Default relative depth difference per pixel of distance halving the weight of a neighbour
+#define DENOISE_SIGMA_ALBEDO 0.1f ///< Default albedo difference halving the weight of a neighbour
+#define DENOISE_NORMAL_SQUARINGS 6 ///< The cosine between the normals is raised to the power 2^squarings
+
+/**
+ * @brief DenoisePlanes structure
+ *
+ * This structure holds the image being filtered and its G-buffer as one
+ * array per channel, so that the kernels load consecutive pixels at once.
+ */
+struct DenoisePlanes {
+	int width = 0; ///< Width of the image
+	int height = 0; ///< Height of the image
+	vector<float> color[3]; ///< The colors being filtered
+	vector<float> filtered[3]; ///< The colors written by a pass
+	vector<float> normal[3]; ///< The normals of the primary hits, 0 for no hit
+	vector<float> depth; ///< The distances of the primary hits, 0 for no hit
+	vector<float> albedo[3]; ///< The albedos of the primary hits
+};
+
+/**
+ * @brief DenoisePass structure
+ *
+ * This structure holds the parameters of a pass, the same for all the pixels.
+ */
+struct DenoisePass {
+	int step = 1; ///< Distance between the taps in pixels
+	float color_scale = 0.0; ///< Factor of the squared color difference in the exponent
+	float albedo_scale = 0.0; ///< Factor of the squared albedo difference in the exponent
+	float depth_scale = 0.0; ///< Factor of the relative depth difference in the exponent, divided by the depth of the pixel
+	float weights[9]; ///< Weights of the 3x3 taps, row by row
+};
+
+/**
+ * @brief Function that filters one pixel, skipping the taps outside of the image
+ *
+ * Every kernel computes the same operations in the same order per pixel,
+ * so the result does not depend on the instruction set.
+ */
+inline void denoisePixel(DenoisePlanes &planes, const DenoisePass &pass, int x, int y) {
+	size_t p = (size_t)y * planes.width + x;
+	float depth_scale = pass.depth_scale / max(planes.depth[p], 1e-3f);
+	float weight_sum = pass.weights[4];
+	float sum[3];
+
+	for (int c = 0; c < 3; c++) sum[c] = planes.color[c][p] * weight_sum;
+
+	for (int dy = -1; dy <= 1; dy++) {
+		int yy = y + dy * pass.step;
+		if (yy < 0 || yy >= planes.height) continue;
+
+		for (int dx = -1; dx <= 1; dx++) {
+			int xx = x + dx * pass.step;
+			if (xx < 0 || xx >= planes.width || (dx == 0 && dy == 0)) continue;
+
+			size_t q = (size_t)yy * planes.width + xx;
+			float color_difference = 0.0, albedo_difference = 0.0, cosine = 0.0;
+
+			for (int c = 0; c < 3; c++) {
+				float d = planes.color[c][q] - planes.color[c][p];
+				color_difference = color_difference + d * d;
+
+				float a = planes.albedo[c][q] - planes.albedo[c][p];
+				albedo_difference = albedo_difference + a * a;
+
+				cosine = cosine + planes.normal[c][q] * planes.normal[c][p];
+			}
+
+			cosine = max(cosine, 0.0f);
+			for (int k = 0; k < DENOISE_NORMAL_SQUARINGS; k++) cosine = cosine * cosine;
+
+			float depth_difference = fabsf(planes.depth[q] - planes.depth[p]);
+			float exponent = color_difference * pass.color_scale + albedo_difference * pass.albedo_scale + depth_difference * depth_scale;
+			float weight = pass.weights[(dy + 1) * 3 + dx + 1] * cosine * fastExp2(exponent * -1.44269504f);
+
+			weight_sum = weight_sum + weight;
+			for (int c = 0; c < 3; c++) sum[c] = sum[c] + weight * planes.color[c][q];
+		}
+	}
+
+	for (int c = 0; c < 3; c++) planes.filtered[c][p] = sum[c] / weight_sum;
+}
+
+#if defined(CPU_DISPATCH)
+/**
+ * @brief Define a kernel filtering the pixels [begin, end) of a row whose taps are all inside the image horizontally
+ *
+ * The kernels only differ by the width of the vectors, so they are written
+ * once over the operations below.
+ */
+#define DENOISE_ROW_KERNEL(NAME, TARGET, LANES, VEC, SET1, LOAD, STORE, ADD, SUB, MUL, DIV, MAX, ANDNOT, EXP2) \
+TARGET inline void NAME(DenoisePlanes &planes, const DenoisePass &pass, int y, int begin, int end) { \
+	const VEC sign_mask = SET1(-0.0f); \
+	int x = begin; \
+\
+	for (; x + LANES <= end; x += LANES) { \
+		size_t p = (size_t)y * planes.width + x; \
+		VEC depth_scale = DIV(SET1(pass.depth_scale), MAX(LOAD(&planes.depth[p]), SET1(1e-3f))); \
+		VEC weight_sum = SET1(pass.weights[4]); \
+		VEC color[3], albedo[3], normal[3], sum[3]; \
+		VEC depth = LOAD(&planes.depth[p]); \
+\
+		for (int c = 0; c < 3; c++) { \
+			color[c] = LOAD(&planes.color[c][p]); \
+			albedo[c] = LOAD(&planes.albedo[c][p]); \
+			normal[c] = LOAD(&planes.normal[c][p]); \
+			sum[c] = MUL(color[c], weight_sum); \
+		} \
+\
+		for (int dy = -1; dy <= 1; dy++) { \
+			int yy = y + dy * pass.step; \
+			if (yy < 0 || yy >= planes.height) continue; \
+\
+			for (int dx = -1; dx <= 1; dx++) { \
+				if (dx == 0 && dy == 0) continue; \
+\
+				size_t q = (size_t)yy * planes.width + x + dx * pass.step; \
+				VEC color_difference = SET1(0.0f), albedo_difference = SET1(0.0f), cosine = SET1(0.0f), neighbour[3]; \
+\
+				for (int c = 0; c < 3; c++) { \
+					neighbour[c] = LOAD(&planes.color[c][q]); \
+					VEC d = SUB(neighbour[c], color[c]); \
+					color_difference = ADD(color_difference, MUL(d, d)); \
+\
+					VEC a = SUB(LOAD(&planes.albedo[c][q]), albedo[c]); \
+					albedo_difference = ADD(albedo_difference, MUL(a, a)); \
+\
+					cosine = ADD(cosine, MUL(LOAD(&planes.normal[c][q]), normal[c])); \
+				} \
+\
+				cosine = MAX(cosine, SET1(0.0f)); \
+				for (int k = 0; k < DENOISE_NORMAL_SQUARINGS; k++) cosine = MUL(cosine, cosine); \
+\
+				VEC depth_difference = ANDNOT(sign_mask, SUB(LOAD(&planes.depth[q]), depth)); \
+				VEC exponent = ADD(ADD(MUL(color_difference, SET1(pass.color_scale)), MUL(albedo_difference, SET1(pass.albedo_scale))), MUL(depth_difference, depth_scale)); \
+				VEC weight = MUL(MUL(SET1(pass.weights[(dy + 1) * 3 + dx + 1]), cosine), EXP2(MUL(exponent, SET1(-1.44269504f)))); \
+\
+				weight_sum = ADD(weight_sum, weight); \
+				for (int c = 0; c < 3; c++) sum[c] = ADD(sum[c], MUL(weight, neighbour[c])); \
+			} \
+		} \
+\
+		for (int c = 0; c < 3; c++) STORE(&planes.filtered[c][p], DIV(sum[c], weight_sum)); \
+	} \
+\
+	for (; x < end; x++) denoisePixel(planes, pass, x, y); \
+}
+
+/**
+ * @brief AVX2 version of fastExp2
+ */
+TARGET_AVX2 inline __m256 fastExp28(__m256 x) {
+	x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(127.0f));
+
+	__m256i integer = _mm256_sub_epi32(_mm256_cvttps_epi32(_mm256_add_ps(x, _mm256_set1_ps(128.5f))), _mm256_set1_epi32(128));
+	__m256 f = _mm256_sub_ps(x, _mm256_cvtepi32_ps(integer));
+
+	__m256 series = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(1.5403530e-4f), f), _mm256_set1_ps(1.3333558e-3f));
+	series = _mm256_add_ps(_mm256_mul_ps(series, f), _mm256_set1_ps(9.6181291e-3f));
+	series = _mm256_add_ps(_mm256_mul_ps(series, f), _mm256_set1_ps(5.5504109e-2f));
+	series = _mm256_add_ps(_mm256_mul_ps(series, f), _mm256_set1_ps(2.4022651e-1f));
+	series = _mm256_add_ps(_mm256_mul_ps(series, f), _mm256_set1_ps(6.9314718e-1f));
+	series = _mm256_add_ps(_mm256_mul_ps(series, f), _mm256_set1_ps(1.0f));
+
+	return _mm256_mul_ps(series, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(integer, _mm256_set1_epi32(127)), 23)));
+}
+
+AVX512_WARNINGS_OFF
+
+/**
+ * @brief AVX-512 multiplication that is never fused with an addition
+ *
+ * AVX-512 implies FMA, which the compiler would otherwise use for the
+ * products followed by sums and round differently from the other kernels.
+ */
+TARGET_AVX512 inline __m512 mul16(__m512 a, __m512 b) {
+	return _mm512_mul_round_ps(a, b, _MM_FROUND_CUR_DIRECTION);
+}
+
+/**
+ * @brief AVX-512 version of fastExp2
+ */
+TARGET_AVX512 inline __m512 fastExp216(__m512 x) {
+	x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-126.0f)), _mm512_set1_ps(127.0f));
+
+	__m512i integer = _mm512_sub_epi32(_mm512_cvttps_epi32(_mm512_add_ps(x, _mm512_set1_ps(128.5f))), _mm512_set1_epi32(128));
+	__m512 f = _mm512_sub_ps(x, _mm512_cvtepi32_ps(integer));
+
+	__m512 series = _mm512_add_ps(mul16(_mm512_set1_ps(1.5403530e-4f), f), _mm512_set1_ps(1.3333558e-3f));
+	series = _mm512_add_ps(mul16(series, f), _mm512_set1_ps(9.6181291e-3f));
+	series = _mm512_add_ps(mul16(series, f), _mm512_set1_ps(5.5504109e-2f));
+	series = _mm512_add_ps(mul16(series, f), _mm512_set1_ps(2.4022651e-1f));
+	series = _mm512_add_ps(mul16(series, f), _mm512_set1_ps(6.9314718e-1f));
+	series = _mm512_add_ps(mul16(series, f), _mm512_set1_ps(1.0f));
+
+	return mul16(series, _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(integer, _mm512_set1_epi32(127)), 23)));
+}
+
+/**
+ * @brief AVX-512 foundation has no float and-not, it is done on the integer bits
+ */
+TARGET_AVX512 inline __m512 andNot16(__m512 mask, __m512 x) {
+	return _mm512_castsi512_ps(_mm512_andnot_si512(_mm512_castps_si512(mask), _mm512_castps_si512(x)));
+}
+
+DENOISE_ROW_KERNEL(denoiseRowSSE, , 4, __m128, _mm_set1_ps, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_div_ps, _mm_max_ps, _mm_andnot_ps, fastExp24)
+DENOISE_ROW_KERNEL(denoiseRowAVX2, TARGET_AVX2, 8, __m256, _mm256_set1_ps, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_div_ps, _mm256_max_ps, _mm256_andnot_ps, fastExp28)
+DENOISE_ROW_KERNEL(denoiseRowAVX512, TARGET_AVX512, 16, __m512, _mm512_set1_ps, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps, _mm512_sub_ps, mul16, _mm512_div_ps, _mm512_max_ps, andNot16, fastExp216)
+
+AVX512_WARNINGS_ON
+#endif
+
+/**
+ * @brief Function that filters a row of pixels with the kernel of the selected instruction set
+ */
+inline void denoiseRow(DenoisePlanes &planes, const DenoisePass &pass, int y) {
+	// The pixels whose horizontal taps leave the image are filtered one by one
+	int begin = min(pass.step, planes.width);
+	int end = max(begin, planes.width - pass.step);
+
+	for (int x = 0; x < begin; x++) denoisePixel(planes, pass, x, y);
+
+#if defined(CPU_DISPATCH)
+	switch (active_isa) {
+		case ISA_AVX512:
+			denoiseRowAVX512(planes, pass, y, begin, end);
+			break;
+		case ISA_AVX2:
+			denoiseRowAVX2(planes, pass, y, begin, end);
+			break;
+		default:
+			denoiseRowSSE(planes, pass, y, begin, end);
+	}
+#else
+	for (int x = begin; x < end; x++) denoisePixel(planes, pass, x, y);
+#endif
+
+	for (int x = end; x < planes.width; x++) denoisePixel(planes, pass, x, y);
+}
+
+/**
+ * @brief Denoiser class
+ *
+ * This class removes the noise of renders with few samples, e.g. with
+ * sampled lights, with an edge-avoiding a-trous wavelet filter. Every pass
+ * averages 3x3 taps twice as far apart as the previous one, each weighted
+ * by a binomial kernel and by how similar its color, normal, depth and albedo
+ * are to those of the filtered pixel, so the edges of objects, shadows and
+ * textures are preserved while flat regions are smoothed over a large
+ * radius. The rows are filtered in parallel and vectorized along x.
+ */
+class Denoiser {
+public:
+	int passes = DENOISE_PASSES; ///< Number of passes
+	float sigma_color = DENOISE_SIGMA_COLOR; ///< Color difference halving the weight of a neighbour in the first pass
+	float sigma_depth = DENOISE_SIGMA_DEPTH; ///< Relative depth difference per pixel of distance halving the weight of a neighbour
+	float sigma_albedo = DENOISE_SIGMA_ALBEDO; ///< Albedo difference halving the weight of a neighbour
+
+	/**
+	 * @brief Filter an image
+	 *
+	 * @param width The width of the image
+	 * @param height The height of the image
+	 * @param colors The colors of the image, row by row, replaced by the filtered ones
+	 * @param features The G-buffer of the image, row by row
+	 */
+	void denoise(int width, int height, vector<glm::vec3> &colors, const vector<GBufferSample> &features) {
+		DenoisePlanes planes;
+		planes.width = width;
+		planes.height = height;
+
+		size_t pixels = (size_t)width * height;
+		planes.depth.resize(pixels);
+
+		for (int c = 0; c < 3; c++) {
+			planes.color[c].resize(pixels);
+			planes.filtered[c].resize(pixels);
+			planes.normal[c].resize(pixels);
+			planes.albedo[c].resize(pixels);
+		}
+
+		for (size_t p = 0; p < pixels; p++) {
+			for (int c = 0; c < 3; c++) {
+				planes.color[c][p] = colors[p][c];
+				planes.normal[c][p] = features[p].normal[c];
+				planes.albedo[c][p] = features[p].albedo[c];
+			}
+
+			planes.depth[p] = features[p].depth;
+		}
+
+		const float binomial[3] = {1.0f / 4, 1.0f / 2, 1.0f / 4};
+		DenoisePass pass;
+
+		for (int k = 0; k < 9; k++) pass.weights[k] = binomial[k / 3] * binomial[k % 3];
+
+		// A weight exp(-x) halves at x = ln(2)
+		pass.color_scale = 0.6931472f / (sigma_color * sigma_color);
+		pass.albedo_scale = 0.6931472f / (sigma_albedo * sigma_albedo);
+
+		for (int i = 0; i < passes; i++) {
+			pass.step = 1 << i;
+			pass.depth_scale = 0.6931472f / (sigma_depth * pass.step);
+
+			parallelFor(0, height, [&](int y) {
+				denoiseRow(planes, pass, y);
+			}, 16);
+
+			for (int c = 0; c < 3; c++) planes.color[c].swap(planes.filtered[c]);
+
+			// Later passes average farther pixels, only across smaller color differences
+			pass.color_scale *= 2.0f;
+		}
+
+		for (size_t p = 0; p < pixels; p++) colors[p] = glm::vec3(planes.color[0][p], planes.color[1][p], planes.color[2][p]);
+	}
+};
+
+#endif /* Denoiser_h */
@@ -0,0 +1,670 @@
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <condition_variable>
+#include <poll.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "../lib/glm.hpp"
+#include "./Renderer.h"
+#include "./RenderContext.h"
+#include "./primitives/Camera.h"
+
+#ifndef Distributed_h
+#define Distributed_h
+
+using namespace std;
+
+/**
+ * @file Distributed.h
+ * @brief Rendering of the tiles of a frame by worker processes over TCP
+ *
+ * A coordinator splits the frame into tiles and hands them to the workers
+ * connected to it. Every worker receives the arguments of the job once,
+ * loads the scene from them and then renders the tiles it is sent,
+ * returning their colors as floats so the assembled image is identical to
+ * a local render. The coordinator keeps DISTRIBUTED_IN_FLIGHT tiles queued
+ * on every worker; once no tile is left, idle workers steal a copy of a
+ * tile still in flight elsewhere and the first result wins. The tiles of a
+ * worker that disconnects or stops answering go back to the queue.
+ *
+ * The coordinator never blocks on a worker: its sockets are non-blocking and
+ * every worker has its own input and output buffers, so a peer sending half
+ * a message only delays itself. Workers send a heartbeat while they render,
+ * so a tile may take longer than the timeout as long as its worker is alive.
+ * Once the frame is complete, the coordinator tells the workers and waits
+ * for them to close their connections, so none of them is reset.
+ *
+ * Messages are a type and a payload size followed by the payload, in the
+ * byte order of the machines, which must therefore agree.
+ */
+
+#define DISTRIBUTED_TILE_SIZE 64 ///< Width and height of the tiles sent to the workers
+#define DISTRIBUTED_IN_FLIGHT 2 ///< Tiles queued on a worker, so it never waits for the network
+#define DISTRIBUTED_TIMEOUT 60 ///< Default seconds without a message after which a worker holding tiles, or a coordinator without workers, is given up
+#define DISTRIBUTED_HEARTBEAT 5 ///< Seconds between the heartbeats of a worker
+#define DISTRIBUTED_MAX_MESSAGE (1u << 30) ///< Largest payload accepted, larger ones are malformed
+
+/**
+ * @brief Types of the messages between a coordinator and its workers
+ */
+enum MessageType : uint32_t {
+	MESSAGE_JOB = 1, ///< Coordinator to worker: the camera and the arguments loading the scene
+	MESSAGE_READY, ///< Worker to coordinator: the scene is loaded
+	MESSAGE_TILE, ///< Coordinator to worker: the index and region of a tile to render
+	MESSAGE_RESULT, ///< Worker to coordinator: the index of a tile followed by its colors
+	MESSAGE_DONE, ///< Coordinator to worker: the frame is complete
+	MESSAGE_HEARTBEAT ///< Worker to coordinator: the worker is alive
+};
+
+/**
+ * @brief DistributedStats structure
+ *
+ * This structure collects the metrics of a distributed render.
+ */
+struct DistributedStats {
+	int workers = 0; ///< Number of workers that connected
+	int failed = 0; ///< Number of workers that disconnected or timed out before the end
+	int tiles = 0; ///< Number of tiles of the frame
+	int reassigned = 0; ///< Number of tiles queued again after their worker failed
+	int stolen = 0; ///< Number of tiles copied to an idle worker while in flight elsewhere
+	int discarded = 0; ///< Number of results received for tiles already done
+};
+
+/**
+ * @brief Function that sends a buffer completely
+ *
+ * @return False if the connection failed
+ */
+inline bool sendAll(int socket, const void * data, size_t size) {
+	const char * bytes = (const char *)data;
+
+	while (size > 0) {
+		ssize_t sent = send(socket, bytes, size, MSG_NOSIGNAL);
+		if (sent <= 0) return false;
+
+		bytes += sent;
+		size -= sent;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Function that receives a buffer completely
+ *
+ * @return False if the connection was closed, failed or timed out
+ */
+inline bool receiveAll(int socket, void * data, size_t size) {
+	char * bytes = (char *)data;
+
+	while (size > 0) {
+		ssize_t received = recv(socket, bytes, size, 0);
+		if (received <= 0) return false;
+
+		bytes += received;
+		size -= received;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Function that sends a message
+ *
+ * @param socket The connection
+ * @param type The type of the message
+ * @param payload The payload
+ * @param size The size of the payload in bytes
+ * @return False if the connection failed
+ */
+inline bool sendMessage(int socket, MessageType type, const void * payload, uint32_t size) {
+	uint32_t header[2] = {type, size};
+	return sendAll(socket, header, sizeof(header)) && sendAll(socket, payload, size);
+}
+
+/**
+ * @brief Function that receives a message
+ *
+ * @param socket The connection
+ * @param type Set to the type of the message
+ * @param payload Set to the payload
+ * @return False if the connection failed or the message is malformed
+ */
+inline bool receiveMessage(int socket, MessageType &type, vector<char> &payload) {
+	uint32_t header[2];
+	if (!receiveAll(socket, header, sizeof(header)) || header[1] > DISTRIBUTED_MAX_MESSAGE) return false;
+
+	type = (MessageType)header[0];
+	payload.resize(header[1]);
+
+	return receiveAll(socket, payload.data(), payload.size());
+}
+
+/**
+ * @brief Function that sets up a connection between a coordinator and a worker
+ *
+ * Messages are sent as soon as they are written, and keepalive probes close
+ * the connection within a minute if the machine of the peer goes away
+ * without closing it.
+ */
+inline void configureSocket(int socket) {
+	int enabled = 1, idle = 30, interval = 10, probes = 3;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+	setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, &enabled, sizeof(enabled));
+	setsockopt(socket, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+	setsockopt(socket, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+	setsockopt(socket, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+}
+
+/**
+ * @brief Function that opens the socket of a coordinator on all the interfaces
+ *
+ * @param port The port, 0 for any free port
+ * @return The listening socket, -1 on failure; port is set to the bound port
+ */
+inline int listenSocket(int &port) {
+	int listener = socket(AF_INET6, SOCK_STREAM, 0);
+	if (listener < 0) return -1;
+
+	int enabled = 1, disabled = 0;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+	setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &disabled, sizeof(disabled));
+
+	sockaddr_in6 address;
+	memset(&address, 0, sizeof(address));
+	address.sin6_family = AF_INET6;
+	address.sin6_addr = in6addr_any;
+	address.sin6_port = htons(port);
+	socklen_t length = sizeof(address);
+
+	if (bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 64) < 0 || getsockname(listener, (sockaddr *)&address, &length) < 0) {
+		close(listener);
+		return -1;
+	}
+
+	port = ntohs(address.sin6_port);
+	return listener;
+}
+
+/**
+ * @brief Function that connects to a coordinator, retrying while it starts
+ *
+ * @param host The name or address of the coordinator
+ * @param port The port of the coordinator
+ * @return The connected socket, -1 if the coordinator cannot be reached within DISTRIBUTED_TIMEOUT seconds
+ */
+inline int connectSocket(const char * host, int port) {
+	addrinfo hints, * addresses;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(host, to_string(port).c_str(), &hints, &addresses) != 0) return -1;
+
+	auto start = chrono::steady_clock::now();
+	int connection = -1;
+
+	while (connection < 0 && chrono::steady_clock::now() - start < chrono::seconds(DISTRIBUTED_TIMEOUT)) {
+		for (addrinfo * address = addresses; address != NULL && connection < 0; address = address->ai_next) {
+			connection = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+			if (connection >= 0 && connect(connection, address->ai_addr, address->ai_addrlen) < 0) {
+				close(connection);
+				connection = -1;
+			}
+		}
+
+		if (connection < 0) usleep(100000);
+	}
+
+	freeaddrinfo(addresses);
+	return connection;
+}
+
+/**
+ * @brief Function that runs a worker until its coordinator completes the frame
+ *
+ * @param host The name or address of the coordinator
+ * @param port The port of the coordinator
+ * @param load Called as load(arguments, context) once per job to fill and commit the context
+ * @return True if the job was completed
+ */
+template <typename Function>
+bool runWorker(const char * host, int port, Function load) {
+	int connection = connectSocket(host, port);
+
+	if (connection < 0) {
+		cerr << "Cannot connect to the coordinator " << host << ":" << port << "." << endl;
+		return false;
+	}
+
+	configureSocket(connection);
+
+	// Only the sends time out, a coordinator may have no tile for a worker for a while
+	timeval timeout = {DISTRIBUTED_TIMEOUT, 0};
+	setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	MessageType type;
+	vector<char> payload;
+
+	if (!receiveMessage(connection, type, payload) || type != MESSAGE_JOB || payload.size() < 3 * sizeof(int32_t)) {
+		close(connection);
+		return false;
+	}
+
+	// The job is the camera then the arguments of the coordinator, each terminated by a null character
+	int32_t camera_size[2];
+	float fov;
+	memcpy(camera_size, payload.data(), sizeof(camera_size));
+	memcpy(&fov, payload.data() + sizeof(camera_size), sizeof(fov));
+
+	vector<string> arguments;
+	for (size_t k = 3 * sizeof(int32_t); k < payload.size(); k += arguments.back().size() + 1) arguments.push_back(string(payload.data() + k));
+
+	Camera camera(camera_size[0], camera_size[1], fov);
+	RenderContext context;
+	load(arguments, context);
+
+	bool completed = false;
+	mutex sending;
+	condition_variable stop;
+	bool stopped = false;
+
+	// The coordinator gives up on workers it does not hear from, however long their tiles take
+	thread heartbeat([&]() {
+		unique_lock<mutex> guard(sending);
+
+		while (!stop.wait_for(guard, chrono::seconds(DISTRIBUTED_HEARTBEAT), [&]() { return stopped; })) {
+			if (!sendMessage(connection, MESSAGE_HEARTBEAT, NULL, 0)) break;
+		}
+	});
+
+	bool ready;
+	{
+		lock_guard<mutex> guard(sending);
+		ready = sendMessage(connection, MESSAGE_READY, NULL, 0);
+	}
+
+	if (ready) {
+		while (receiveMessage(connection, type, payload)) {
+			if (type == MESSAGE_DONE) {
+				completed = true;
+				break;
+			}
+
+			if (type != MESSAGE_TILE || payload.size() != 5 * sizeof(int32_t)) break;
+
+			int32_t tile[5];
+			memcpy(tile, payload.data(), sizeof(tile));
+
+			Region region;
+			region.x = tile[1];
+			region.y = tile[2];
+			region.width = tile[3];
+			region.height = tile[4];
+
+			vector<float> result(1 + 3 * region.width * region.height);
+			memcpy(result.data(), &tile[0], sizeof(int32_t));
+
+			renderRegion(context, camera, region, [&](int i, int j, glm::vec3 color) {
+				memcpy(&result[1 + 3 * ((j - region.y) * region.width + i - region.x)], &color, sizeof(color));
+			});
+
+			lock_guard<mutex> guard(sending);
+			if (!sendMessage(connection, MESSAGE_RESULT, result.data(), result.size() * sizeof(float))) break;
+		}
+	}
+
+	{
+		lock_guard<mutex> guard(sending);
+		stopped = true;
+	}
+
+	stop.notify_one();
+	heartbeat.join();
+
+	close(connection);
+	return completed;
+}
+
+/**
+ * @brief Function that starts worker processes connected to a local coordinator
+ *
+ * Must be called before the process starts any thread.
+ *
+ * @param listener The listening socket of the coordinator, closed in the workers so they do not hold its port
+ * @param count The number of workers
+ * @param port The port of the coordinator on the loopback interface
+ * @param load The function loading the scene, see runWorker
+ * @return The process identifiers of the workers
+ */
+template <typename Function>
+vector<pid_t> spawnWorkers(int listener, int count, int port, Function load) {
+	vector<pid_t> workers;
+
+	for (int k = 0; k < count; k++) {
+		pid_t pid = fork();
+
+		if (pid == 0) {
+			close(listener);
+			_exit(runWorker("localhost", port, load) ? 0 : 1);
+		} else if (pid > 0) {
+			workers.push_back(pid);
+		}
+	}
+
+	return workers;
+}
+
+/**
+ * @brief Function that waits for the worker processes started by spawnWorkers
+ *
+ * @return The number of workers that did not exit successfully
+ */
+inline int waitWorkers(const vector<pid_t> &workers) {
+	int failed = 0;
+
+	for (pid_t pid : workers) {
+		int status;
+		if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+	}
+
+	return failed;
+}
+
+/**
+ * @brief Function that coordinates the render of a frame by the workers connecting to a socket
+ *
+ * @param listener The listening socket, see listenSocket
+ * @param camera The camera of the frame
+ * @param arguments The arguments sent to the workers to load the scene
+ * @param store Called as store(i, j, color) once per pixel as the tiles arrive
+ * @param stats Set to the metrics of the render
+ * @param timeout Seconds without a message after which a worker holding tiles is given up, and without workers after which the render is
+ * @return False if no worker was connected for timeout seconds before the frame was complete
+ */
+template <typename Function>
+bool renderDistributed(int listener, const Camera &camera, const vector<string> &arguments, Function store, DistributedStats &stats, int timeout=DISTRIBUTED_TIMEOUT) {
+	struct Worker {
+		int socket; ///< The connection to the worker, non-blocking
+		bool ready = false; ///< Whether the worker loaded the scene
+		vector<int> tiles; ///< The tiles sent to the worker and not returned yet
+		chrono::steady_clock::time_point heard; ///< When the worker last sent a message
+		vector<char> input; ///< Received bytes not forming a complete message yet
+		vector<char> output; ///< Messages not sent yet
+		bool finished = false; ///< Whether the sending side of the connection is shut down, once the frame is complete
+	};
+
+	// The job, see runWorker
+	vector<char> job(3 * sizeof(int32_t));
+	int32_t camera_size[2] = {camera.width, camera.height};
+	memcpy(job.data(), camera_size, sizeof(camera_size));
+	memcpy(job.data() + sizeof(camera_size), &camera.fov, sizeof(float));
+
+	for (const string &argument : arguments) job.insert(job.end(), argument.c_str(), argument.c_str() + argument.size() + 1);
+
+	vector<Region> regions;
+
+	for (int y = 0; y < camera.height; y += DISTRIBUTED_TILE_SIZE) {
+		for (int x = 0; x < camera.width; x += DISTRIBUTED_TILE_SIZE) {
+			Region region;
+			region.x = x;
+			region.y = y;
+			region.width = min(DISTRIBUTED_TILE_SIZE, camera.width - x);
+			region.height = min(DISTRIBUTED_TILE_SIZE, camera.height - y);
+			regions.push_back(region);
+		}
+	}
+
+	int tiles = regions.size();
+	stats = DistributedStats();
+	stats.tiles = tiles;
+
+	deque<int> pending;
+	for (int tile = 0; tile < tiles; tile++) pending.push_back(tile);
+
+	vector<char> done(tiles, false);
+	vector<int> copies(tiles, 0);
+	int remaining = tiles;
+	vector<Worker> workers;
+	auto idle_since = chrono::steady_clock::now();
+
+	auto fail = [&](int w) {
+		close(workers[w].socket);
+		stats.failed++;
+
+		for (int tile : workers[w].tiles) {
+			if (--copies[tile] == 0 && !done[tile]) {
+				pending.push_front(tile);
+				stats.reassigned++;
+			}
+		}
+
+		workers.erase(workers.begin() + w);
+	};
+
+	// Send as much of the queued messages as the socket takes, false if the connection failed
+	auto flush = [&](Worker &worker) {
+		ssize_t sent = send(worker.socket, worker.output.data(), worker.output.size(), MSG_NOSIGNAL);
+		if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+		if (sent > 0) worker.output.erase(worker.output.begin(), worker.output.begin() + sent);
+
+		return true;
+	};
+
+	// Queue a message and send what the socket takes
+	auto queue = [&](Worker &worker, MessageType type, const void * payload, uint32_t size) {
+		uint32_t header[2] = {type, size};
+		worker.output.insert(worker.output.end(), (const char *)header, (const char *)header + sizeof(header));
+		worker.output.insert(worker.output.end(), (const char *)payload, (const char *)payload + size);
+
+		return flush(worker);
+	};
+
+	// Handle a complete message, false if the worker misbehaved
+	auto handle = [&](Worker &worker, MessageType type, const char * payload, size_t size) {
+		if (type == MESSAGE_READY) {
+			worker.ready = true;
+		} else if (type == MESSAGE_RESULT && size >= sizeof(int32_t)) {
+			int32_t tile;
+			memcpy(&tile, payload, sizeof(tile));
+
+			auto held = find(worker.tiles.begin(), worker.tiles.end(), tile);
+			if (held == worker.tiles.end()) return false;
+
+			const Region &region = regions[tile];
+			if (size != sizeof(int32_t) + 3 * sizeof(float) * region.width * region.height) return false;
+
+			worker.tiles.erase(held);
+			copies[tile]--;
+
+			if (done[tile]) {
+				stats.discarded++;
+				return true;
+			}
+
+			const float * colors = (const float *)(payload + sizeof(int32_t));
+
+			for (int j = 0; j < region.height; j++) {
+				for (int i = 0; i < region.width; i++, colors += 3) store(region.x + i, region.y + j, glm::vec3(colors[0], colors[1], colors[2]));
+			}
+
+			done[tile] = true;
+			remaining--;
+		} else if (type != MESSAGE_HEARTBEAT) {
+			return false;
+		}
+
+		return true;
+	};
+
+	// Read what the socket holds and handle the complete messages, false if the worker failed
+	auto receive = [&](Worker &worker) {
+		char buffer[1 << 16];
+		ssize_t received;
+
+		while ((received = recv(worker.socket, buffer, sizeof(buffer), 0)) > 0) worker.input.insert(worker.input.end(), buffer, buffer + received);
+		if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) return false;
+
+		size_t offset = 0;
+		uint32_t header[2];
+
+		while (worker.input.size() - offset >= sizeof(header)) {
+			memcpy(header, &worker.input[offset], sizeof(header));
+			if (header[1] > DISTRIBUTED_MAX_MESSAGE) return false;
+			if (worker.input.size() - offset - sizeof(header) < header[1]) break;
+
+			worker.heard = chrono::steady_clock::now();
+			if (!handle(worker, (MessageType)header[0], &worker.input[offset + sizeof(header)], header[1])) return false;
+
+			offset += sizeof(header) + header[1];
+		}
+
+		worker.input.erase(worker.input.begin(), worker.input.begin() + offset);
+		return true;
+	};
+
+	// The next queued tile, or a copy of a tile only in flight on another worker
+	auto next = [&](const Worker &worker) {
+		while (!pending.empty()) {
+			int tile = pending.front();
+			pending.pop_front();
+			if (!done[tile]) return tile;
+		}
+
+		for (int tile = 0; tile < tiles; tile++) {
+			if (!done[tile] && copies[tile] == 1 && find(worker.tiles.begin(), worker.tiles.end(), tile) == worker.tiles.end()) {
+				stats.stolen++;
+				return tile;
+			}
+		}
+
+		return -1;
+	};
+
+	while (remaining > 0) {
+		vector<pollfd> descriptors(1 + workers.size());
+		descriptors[0] = {listener, POLLIN, 0};
+
+		for (size_t w = 0; w < workers.size(); w++) {
+			descriptors[1 + w] = {workers[w].socket, (short)(POLLIN | (workers[w].output.empty() ? 0 : POLLOUT)), 0};
+		}
+
+		if (poll(descriptors.data(), descriptors.size(), 1000) < 0) continue;
+
+		// Backwards, so failed workers can be removed
+		for (int w = workers.size() - 1; w >= 0; w--) {
+			short events = descriptors[1 + w].revents;
+
+			if ((events & POLLOUT) && !flush(workers[w])) {
+				fail(w);
+			} else if ((events & (POLLIN | POLLHUP | POLLERR)) && !receive(workers[w])) {
+				fail(w);
+			} else if (!workers[w].tiles.empty() && chrono::steady_clock::now() - workers[w].heard > chrono::seconds(timeout)) {
+				// A worker holding tiles that stopped answering is as good as dead
+				fail(w);
+			}
+		}
+
+		if (descriptors[0].revents & POLLIN) {
+			int connection = accept(listener, NULL, NULL);
+
+			if (connection >= 0) {
+				configureSocket(connection);
+				fcntl(connection, F_SETFL, fcntl(connection, F_GETFL) | O_NONBLOCK);
+				stats.workers++;
+
+				Worker worker;
+				worker.socket = connection;
+				worker.heard = chrono::steady_clock::now();
+				workers.push_back(worker);
+				if (!queue(workers.back(), MESSAGE_JOB, job.data(), job.size())) fail(workers.size() - 1);
+			}
+		}
+
+		for (int w = workers.size() - 1; w >= 0; w--) {
+			while (workers[w].ready && workers[w].tiles.size() < DISTRIBUTED_IN_FLIGHT) {
+				int tile = next(workers[w]);
+				if (tile < 0) break;
+				if (workers[w].tiles.empty()) workers[w].heard = chrono::steady_clock::now();
+
+				const Region &region = regions[tile];
+				int32_t message[5] = {tile, region.x, region.y, region.width, region.height};
+
+				workers[w].tiles.push_back(tile);
+				copies[tile]++;
+
+				if (!queue(workers[w], MESSAGE_TILE, message, sizeof(message))) {
+					fail(w);
+					break;
+				}
+			}
+		}
+
+		if (!workers.empty()) {
+			idle_since = chrono::steady_clock::now();
+		} else if (chrono::steady_clock::now() - idle_since > chrono::seconds(timeout)) {
+			break;
+		}
+	}
+
+	// The workers leave once they are told the frame is complete, after the copies of tiles they were already sent
+	for (Worker &worker : workers) {
+		queue(worker, MESSAGE_DONE, NULL, 0);
+		worker.heard = chrono::steady_clock::now();
+	}
+
+	// Closing with unsent messages or unread results would reset the connections, so wait for the workers to close them
+	while (!workers.empty()) {
+		vector<pollfd> descriptors(workers.size());
+
+		for (size_t w = 0; w < workers.size(); w++) {
+			if (workers[w].output.empty() && !workers[w].finished) {
+				shutdown(workers[w].socket, SHUT_WR);
+				workers[w].finished = true;
+			}
+
+			descriptors[w] = {workers[w].socket, (short)(POLLIN | (workers[w].output.empty() ? 0 : POLLOUT)), 0};
+		}
+
+		if (poll(descriptors.data(), descriptors.size(), 1000) < 0) continue;
+
+		for (int w = workers.size() - 1; w >= 0; w--) {
+			short events = descriptors[w].revents;
+			bool closed = false;
+
+			if ((events & POLLOUT) && !flush(workers[w])) {
+				closed = true;
+			} else if ((events & (POLLIN | POLLHUP | POLLERR)) && !receive(workers[w])) {
+				closed = true;
+			} else if (chrono::steady_clock::now() - workers[w].heard > chrono::seconds(2 * DISTRIBUTED_HEARTBEAT)) {
+				// A live worker sends a heartbeat while it renders its last tiles
+				closed = true;
+			}
+
+			if (closed) {
+				close(workers[w].socket);
+				workers.erase(workers.begin() + w);
+			}
+		}
+	}
+
+	return remaining == 0;
+}
+
+#endif /* Distributed_h */
@@ -0,0 +1,179 @@
+#include <vector>
+#include "../lib/glm.hpp"
+#include "./PixelOrder.h"
+#include "./Renderer.h"
+#include "./RenderContext.h"
+#include "./accel/AABB.h"
+#include "./accel/Parallel.h"
+#include "./accel/DependencyGrid.h"
+#include "./primitives/Camera.h"
+#include "./primitives/Object.h"
+
+#ifndef IncrementalRenderer_h
+#define IncrementalRenderer_h
+
+using namespace std;
+
+/**
+ * @brief IncrementalRenderer class
+ *
+ * This class keeps the image of a camera between edits of a scene and only
+ * renders again the tiles an edit can change. While a tile is rendered, the
+ * cells of a coarse grid crossed by its primary, secondary and shadow rays
+ * and the objects they hit are recorded. An edited object invalidates the
+ * tiles that crossed the cells of its old or new bounds or hit it; the
+ * others keep their pixels, which are identical to a full render.
+ *
+ * Edits the dependencies cannot describe (unbounded objects, bounds leaving
+ * the grid, lights, the camera) fall back to invalidate.
+ */
+class IncrementalRenderer {
+public:
+	const Camera &camera; ///< The camera generating the primary rays
+	int tiles_x = 0; ///< Number of tiles along the width of the image
+	int tiles_y = 0; ///< Number of tiles along the height of the image
+	int tile_size = PIXEL_TILE_SIZE; ///< Width and height of the tiles
+	int rendered = 0; ///< Number of tiles rendered by the last call to render
+
+	/**
+	 * @brief Construct a new IncrementalRenderer with every tile to render
+	 *
+	 * @param camera The camera generating the primary rays, kept by reference
+	 * @param tile_size The width and height of the tiles, a power of two
+	 */
+	IncrementalRenderer(const Camera &camera, int tile_size=PIXEL_TILE_SIZE): camera(camera), tile_size(tile_size) {
+		tiles_x = (camera.width + tile_size - 1) / tile_size;
+		tiles_y = (camera.height + tile_size - 1) / tile_size;
+		colors.assign(camera.width * camera.height, glm::vec3(0.0));
+		tiles.resize(tiles_x * tiles_y);
+		dirty.assign(tiles_x * tiles_y, true);
+	}
+
+	/**
+	 * @brief Mark every tile to be rendered again
+	 */
+	void invalidate() {
+		fill(dirty.begin(), dirty.end(), true);
+	}
+
+	/**
+	 * @brief Mark the tiles affected by an edited object, which must be followed by a commit of the context
+	 *
+	 * @param object The moved, reshaped or added object
+	 * @param old_bounds The bounds of the object before the edit, an empty box for added objects
+	 */
+	void objectChanged(Object * object, AABB old_bounds) {
+		AABB new_bounds = object->getBounds();
+		bool added = old_bounds.min.x > old_bounds.max.x;
+
+		if (!grid.contains(new_bounds) || (!added && !grid.contains(old_bounds))) {
+			invalidate();
+			return;
+		}
+
+		vector<int> cells;
+		grid.boxCells(new_bounds, [&](int cell) { cells.push_back(cell); });
+		if (!added) grid.boxCells(old_bounds, [&](int cell) { cells.push_back(cell); });
+
+		for (int tile = 0; tile < (int)tiles.size(); tile++) {
+			if (dirty[tile]) continue;
+			if (tiles[tile].hits(object)) dirty[tile] = true;
+
+			for (int k = 0; k < (int)cells.size() && !dirty[tile]; k++) {
+				if (tiles[tile].crosses(cells[k])) dirty[tile] = true;
+			}
+		}
+	}
+
+	/**
+	 * @brief Mark the tiles whose rays hit an object using an edited material
+	 *
+	 * @param context The scene being rendered
+	 * @param material The index of the edited material in the material table
+	 */
+	void materialChanged(const RenderContext &context, int material) {
+		for (const Object * object : context.objects) {
+			if (object->getMaterial() != material) continue;
+
+			for (int tile = 0; tile < (int)tiles.size(); tile++) {
+				if (tiles[tile].hits(object)) dirty[tile] = true;
+			}
+		}
+	}
+
+	/**
+	 * @brief Render the marked tiles using all the worker threads
+	 *
+	 * @param context The committed scene to render
+	 * @return The number of tiles rendered
+	 */
+	int render(const RenderContext &context) {
+		// The grid only changes when nothing is kept, so the recorded cells stay comparable
+		if (find(dirty.begin(), dirty.end(), false) == dirty.end()) buildGrid(context);
+
+		vector<int> pending;
+		for (int tile = 0; tile < (int)tiles.size(); tile++) {
+			if (dirty[tile]) pending.push_back(tile);
+		}
+
+		vector<glm::ivec2> order = tileOrder(context.pixel_order, tile_size);
+
+		parallelFor(0, pending.size(), [&](int k) {
+			int tile = pending[k];
+			Region region;
+			region.x = (tile % tiles_x) * tile_size;
+			region.y = (tile / tiles_x) * tile_size;
+			region.width = min(tile_size, camera.width - region.x);
+			region.height = min(tile_size, camera.height - region.y);
+
+			DependencyRecorder recorder;
+			recorder.grid = &grid;
+			recorder.tile = &tiles[tile];
+			recorder.tile->clear();
+			dependencyRecorder() = &recorder;
+
+			renderTile(context, camera, region, order, [&](int i, int j, glm::vec3 color) {
+				colors[j * camera.width + i] = color;
+			});
+
+			dependencyRecorder() = NULL;
+			recorder.tile->finish();
+			dirty[tile] = false;
+		});
+
+		rendered = pending.size();
+		return rendered;
+	}
+
+	/**
+	 * @brief Get the color of a rendered pixel
+	 */
+	glm::vec3 pixel(int i, int j) const {
+		return colors[j * camera.width + i];
+	}
+
+private:
+	vector<glm::vec3> colors; ///< The pixels of the image, row by row
+	vector<TileDependencies> tiles; ///< What every tile depends on, row by row
+	vector<char> dirty; ///< Whether every tile must be rendered again
+	DependencyGrid grid; ///< The cells the dependencies refer to
+
+	/**
+	 * @brief Fit the grid around the bounded objects, the lights and the camera
+	 */
+	void buildGrid(const RenderContext &context) {
+		AABB box;
+
+		for (Object * object : context.objects) {
+			AABB bounds = object->getBounds();
+			if (bounds.isFinite()) box.expand(bounds);
+		}
+
+		for (const Light * light : context.lights) box.expand(light->position);
+		box.expand(camera.generateRay(0, 0).origin);
+
+		grid.build(box);
+	}
+};
+
+#endif /* IncrementalRenderer_h */
@@ -0,0 +1,252 @@
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include "../lib/glm.hpp"
+#include "./PixelOrder.h"
+#include "./Checkpoint.h"
+#include "./Distributed.h"
+#include "./StreamingImage.h"
+#include "./Stitch.h"
+#include "./Denoiser.h"
+#include "./PreviewRenderer.h"
+#include "./accel/BVH.h"
+#include "./math/CPUDispatch.h"
+
+#ifndef Options_h
+#define Options_h
+
+using namespace std;
+
+/**
+ * @brief Options structure
+ *
+ * This structure collects the options of a render given on the command line.
+ * Arguments that are not flags are kept, in order, as positional arguments.
+ */
+struct Options {
+	bool verbose = false; ///< Print the render metrics
+	BVHBuilder builder = BUILDER_SAH; ///< Algorithm used to build the BVH
+	int width = 2; ///< Branching factor of the BVH: 2, 4 or 8
+	int precision = 32; ///< Bits per child box coordinate of the BVH: 8, 16 or 32
+	float split_budget = 0.3; ///< Fraction of duplicated references allowed by the SBVH builder
+	bool benchmark = false; ///< Compare the BVH node layouts on the primary rays
+	bool fast_math = false; ///< Use the approximations of FastMath.h
+	bool ray_differentials = true; ///< Filter the texture lookups over the footprints of the rays
+	ISALevel isa = detectISA(); ///< Instruction set level of the SIMD kernels
+	float light_threshold = 0.0; ///< Contribution below which lights are culled, 0 to shade with every light
+	int light_samples = 0; ///< Lights sampled per shading point, 0 to shade with every light
+	bool shadow_cache = true; ///< Test the last occluder of every light before traversing the BVH for shadows
+	PixelOrder pixel_order = ORDER_MORTON; ///< Order in which the pixels are rendered
+	int tile_size = PIXEL_TILE_SIZE; ///< Width and height of the tiles of the tiled orders
+	int lights = 0; ///< Number of dim lights scattered in the demo scene
+	int move_object = -1; ///< Index of an object moved by move_offset, -1 for none
+	glm::vec3 move_offset = glm::vec3(0.0); ///< Translation applied to the moved object
+	bool incremental = false; ///< Render before the move, then only the tiles it affects
+	int coordinator_port = -1; ///< Port on which to coordinate worker processes, 0 for any, -1 to render locally
+	int local_workers = 0; ///< Worker processes started on this machine by the coordinator
+	string worker_host; ///< Coordinator to render tiles for, empty to render the frame
+	int worker_port = 0; ///< Port of the coordinator to render tiles for
+	int worker_timeout = DISTRIBUTED_TIMEOUT; ///< Seconds without a message after which the coordinator gives up a worker holding tiles, at least two heartbeats
+	const char * checkpoint = NULL; ///< File the completed tiles are saved to, NULL for none
+	int checkpoint_interval = CHECKPOINT_INTERVAL; ///< Seconds between two checkpoints
+	bool resume = false; ///< Continue from the checkpoint file instead of starting over
+	int tile_budget = 0; ///< Checkpoint tiles rendered before saving and stopping, 0 to finish the render
+	int image_width = 1024; ///< Width of the image in pixels
+	int image_height = 768; ///< Height of the image in pixels
+	bool out_of_core = false; ///< Stream the tiles to a file instead of keeping the image in memory
+	int memory_cap = STREAMING_IMAGE_MEMORY; ///< Memory budget of the out-of-core image in MB
+	vector<Region> crops; ///< Regions of the frame rendered to separate images, empty for the full frame
+	bool denoise = false; ///< Filter the image guided by the G-buffer of the primary hits
+	int denoise_passes = DENOISE_PASSES; ///< Number of passes of the denoiser
+	int preview = 0; ///< Shade one pixel per block of preview x preview pixels and upsample, 0 for every pixel
+	const char * stitch_output = NULL; ///< Image assembled from the crops given as positional arguments, NULL to render
+	const char * texture = NULL; ///< Tiled texture file mapped on the large sphere
+	int texture_cache = 64; ///< Memory budget of the texture tile cache in MB
+	const char * convert_input = NULL; ///< Image to convert to a tiled texture file instead of rendering
+	const char * convert_output = NULL; ///< Tiled texture file written by the conversion
+	vector<const char *> positional; ///< Arguments that are not flags
+	bool valid = true; ///< False if an argument cannot be honoured, the program then exits with an error
+};
+
+/**
+ * @brief Function that parses the command line arguments
+ *
+ * @param argc The number of arguments
+ * @param argv The arguments, the first one being the program name
+ * @return The parsed options, not valid if the arguments cannot be honoured
+ */
+inline Options parseOptions(int argc, const char * argv[]) {
+	Options options;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--verbose") || !strcmp(argv[i], "-v")) {
+			options.verbose = true;
+		} else if (!strcmp(argv[i], "--builder") && i + 1 < argc) {
+			if (!parseBuilder(argv[++i], options.builder)) {
+				cerr << "Unknown builder " << argv[i] << ", using " << builderName(options.builder) << "." << endl;
+			}
+		} else if (!strcmp(argv[i], "--bvh-width") && i + 1 < argc) {
+			options.width = atoi(argv[++i]);
+
+			if (options.width != 2 && options.width != 4 && options.width != 8) {
+				cerr << "Unsupported BVH width " << argv[i] << ", using 2." << endl;
+				options.width = 2;
+			}
+		} else if (!strcmp(argv[i], "--bvh-precision") && i + 1 < argc) {
+			options.precision = atoi(argv[++i]);
+
+			if (options.precision != 8 && options.precision != 16 && options.precision != 32) {
+				cerr << "Unsupported BVH precision " << argv[i] << ", using 32." << endl;
+				options.precision = 32;
+			}
+		} else if (!strcmp(argv[i], "--sbvh-budget") && i + 1 < argc) {
+			options.split_budget = max(0.0, atof(argv[++i]));
+		} else if (!strcmp(argv[i], "--benchmark")) {
+			options.benchmark = true;
+		} else if (!strcmp(argv[i], "--fast-math")) {
+			options.fast_math = true;
+		} else if (!strcmp(argv[i], "--no-ray-differentials")) {
+			options.ray_differentials = false;
+		} else if (!strcmp(argv[i], "--isa") && i + 1 < argc) {
+			if (!parseISA(argv[++i], options.isa)) {
+				cerr << "Unknown instruction set " << argv[i] << ", using " << isaName(options.isa) << "." << endl;
+			}
+		} else if (!strcmp(argv[i], "--light-threshold") && i + 1 < argc) {
+			options.light_threshold = max(0.0, atof(argv[++i]));
+		} else if (!strcmp(argv[i], "--light-samples") && i + 1 < argc) {
+			options.light_samples = max(0, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--no-shadow-cache")) {
+			options.shadow_cache = false;
+		} else if (!strcmp(argv[i], "--pixel-order") && i + 1 < argc) {
+			if (!parsePixelOrder(argv[++i], options.pixel_order)) {
+				cerr << "Unknown pixel order " << argv[i] << ", using " << pixelOrderName(options.pixel_order) << "." << endl;
+			}
+		} else if (!strcmp(argv[i], "--tile-size") && i + 1 < argc) {
+			options.tile_size = atoi(argv[++i]);
+
+			if (options.tile_size <= 0 || (options.tile_size & (options.tile_size - 1))) {
+				cerr << "Tile size " << argv[i] << " is not a power of two, using " << PIXEL_TILE_SIZE << "." << endl;
+				options.tile_size = PIXEL_TILE_SIZE;
+			}
+		} else if (!strcmp(argv[i], "--lights") && i + 1 < argc) {
+			options.lights = max(0, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--move-object") && i + 4 < argc) {
+			options.move_object = atoi(argv[++i]);
+			options.move_offset.x = atof(argv[++i]);
+			options.move_offset.y = atof(argv[++i]);
+			options.move_offset.z = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "--incremental")) {
+			options.incremental = true;
+		} else if (!strcmp(argv[i], "--coordinator") && i + 1 < argc) {
+			options.coordinator_port = max(0, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--workers") && i + 1 < argc) {
+			options.local_workers = max(0, atoi(argv[++i]));
+			if (options.coordinator_port < 0) options.coordinator_port = 0;
+		} else if (!strcmp(argv[i], "--worker-timeout") && i + 1 < argc) {
+			options.worker_timeout = max(2 * DISTRIBUTED_HEARTBEAT, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--worker") && i + 1 < argc) {
+			const char * address = argv[++i];
+			const char * colon = strrchr(address, ':');
+
+			if (colon == NULL) {
+				cerr << "The coordinator " << address << " is not given as host:port." << endl;
+				options.valid = false;
+			} else {
+				options.worker_host.assign(address, colon - address);
+				options.worker_port = atoi(colon + 1);
+			}
+		} else if (!strcmp(argv[i], "--checkpoint") && i + 1 < argc) {
+			options.checkpoint = argv[++i];
+		} else if (!strcmp(argv[i], "--checkpoint-interval") && i + 1 < argc) {
+			options.checkpoint_interval = max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--resume")) {
+			options.resume = true;
+		} else if (!strcmp(argv[i], "--tile-budget") && i + 1 < argc) {
+			options.tile_budget = max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &options.image_width, &options.image_height) != 2 || options.image_width <= 0 || options.image_height <= 0) {
+				cerr << "The size " << argv[i] << " is not given as WIDTHxHEIGHT, using 1024x768." << endl;
+				options.image_width = 1024;
+				options.image_height = 768;
+			}
+		} else if (!strcmp(argv[i], "--out-of-core")) {
+			options.out_of_core = true;
+		} else if (!strcmp(argv[i], "--memory-cap") && i + 1 < argc) {
+			options.memory_cap = max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--crop") && i + 1 < argc) {
+			Region region;
+
+			if (parseRegion(argv[++i], region)) {
+				options.crops.push_back(region);
+			} else {
+				cerr << "The crop " << argv[i] << " is not given as WIDTHxHEIGHT+X+Y." << endl;
+				options.valid = false;
+			}
+		} else if (!strcmp(argv[i], "--stitch") && i + 1 < argc) {
+			options.stitch_output = argv[++i];
+		} else if (!strcmp(argv[i], "--denoise")) {
+			options.denoise = true;
+		} else if (!strcmp(argv[i], "--denoise-passes") && i + 1 < argc) {
+			options.denoise_passes = max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--preview") && i + 1 < argc) {
+			options.preview = max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--texture") && i + 1 < argc) {
+			options.texture = argv[++i];
+		} else if (!strcmp(argv[i], "--texture-cache") && i + 1 < argc) {
+			options.texture_cache = max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--convert-texture") && i + 2 < argc) {
+			options.convert_input = argv[++i];
+			options.convert_output = argv[++i];
+		} else {
+			options.positional.push_back(argv[i]);
+		}
+	}
+
+	if ((options.resume || options.tile_budget > 0) && options.checkpoint == NULL) options.checkpoint = "./out/result.checkpoint";
+
+	// Each of these replaces the render of the full frame, so they exclude each other
+	vector<const char *> modes;
+	if (!options.crops.empty()) modes.push_back("--crop");
+	if (options.out_of_core) modes.push_back("--out-of-core");
+	if (options.incremental) modes.push_back("--incremental");
+	if (options.checkpoint) modes.push_back(options.resume ? "--resume" : "--checkpoint");
+	if (options.preview > 0) modes.push_back("--preview");
+	if (options.denoise) modes.push_back("--denoise");
+	if (options.coordinator_port >= 0) modes.push_back("--coordinator");
+
+	if (modes.size() > 1) {
+		cerr << modes[0] << " cannot be combined with " << modes[1] << "." << endl;
+		options.valid = false;
+	}
+
+	return options;
+}
+
+/**
+ * @brief Function that gets the arguments describing the scene and the render
+ *
+ * These are the arguments a coordinator sends to its workers and that a
+ * checkpoint is tied to.
+ *
+ * @param argc The number of arguments
+ * @param argv The arguments, the first one being the program name
+ * @return The arguments without the program name and the distribution, checkpoint and verbosity flags
+ */
+inline vector<string> jobArguments(int argc, const char * argv[]) {
+	vector<string> arguments;
+
+	for (int i = 1; i < argc; i++) {
+		if ((!strcmp(argv[i], "--coordinator") || !strcmp(argv[i], "--workers") || !strcmp(argv[i], "--worker") || !strcmp(argv[i], "--worker-timeout") || !strcmp(argv[i], "--checkpoint") || !strcmp(argv[i], "--checkpoint-interval") || !strcmp(argv[i], "--tile-budget")) && i + 1 < argc) {
+			i++;
+		} else if (strcmp(argv[i], "--resume") && strcmp(argv[i], "--verbose") && strcmp(argv[i], "-v")) {
+			arguments.push_back(argv[i]);
+		}
+	}
+
+	return arguments;
+}
+
+#endif /* Options_h */
@@ -0,0 +1,130 @@
+#include <vector>
+#include <cstring>
+#include "../lib/glm.hpp"
+
+#ifndef PixelOrder_h
+#define PixelOrder_h
+
+using namespace std;
+
+#define PIXEL_TILE_SIZE 16 ///< Default width and height of the tiles of the tiled orders, a power of two
+
+/**
+ * @brief Orders in which the pixels of an image are rendered
+ *
+ * The tiled orders hand square tiles to the threads and walk every tile
+ * along a space filling curve, so that consecutive rays are close in both
+ * directions and touch the same BVH nodes, objects and cached occluders.
+ */
+enum PixelOrder {
+	ORDER_SCANLINE, ///< Rows handed to the threads, left to right
+	ORDER_MORTON, ///< Tiles walked along the Z-order curve
+	ORDER_HILBERT ///< Tiles walked along the Hilbert curve, whose steps are always to a neighbour
+};
+
+/**
+ * @brief Get the name of a pixel order
+ *
+ * @param order The pixel order
+ * @return The name used on the command line
+ */
+inline const char * pixelOrderName(PixelOrder order) {
+	switch (order) {
+		case ORDER_MORTON:
+			return "morton";
+		case ORDER_HILBERT:
+			return "hilbert";
+		default:
+			return "scanline";
+	}
+}
+
+/**
+ * @brief Parse the name of a pixel order
+ *
+ * @param name The name used on the command line
+ * @param order Set to the parsed order
+ * @return True if the name is known
+ */
+inline bool parsePixelOrder(const char * name, PixelOrder &order) {
+	for (PixelOrder candidate : {ORDER_SCANLINE, ORDER_MORTON, ORDER_HILBERT}) {
+		if (!strcmp(name, pixelOrderName(candidate))) {
+			order = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief Get the position of a point of the Z-order curve
+ *
+ * @param index The index of the point, its even bits giving x and its odd bits y
+ * @return The position of the point
+ */
+inline glm::ivec2 mortonPosition(int index) {
+	glm::ivec2 position(0);
+
+	for (int bit = 0; bit < 16; bit++) {
+		position.x |= ((index >> (2 * bit)) & 1) << bit;
+		position.y |= ((index >> (2 * bit + 1)) & 1) << bit;
+	}
+
+	return position;
+}
+
+/**
+ * @brief Get the position of a point of the Hilbert curve filling a square
+ *
+ * @param size The width of the square, a power of two
+ * @param index The index of the point along the curve
+ * @return The position of the point
+ */
+inline glm::ivec2 hilbertPosition(int size, int index) {
+	glm::ivec2 position(0);
+
+	for (int scale = 1; scale < size; scale *= 2) {
+		int rx = 1 & (index / 2);
+		int ry = 1 & (index ^ rx);
+
+		// Rotate the quadrant so that the curves of the sub-squares connect
+		if (ry == 0) {
+			if (rx == 1) position = scale - 1 - position;
+			swap(position.x, position.y);
+		}
+
+		position += scale * glm::ivec2(rx, ry);
+		index /= 4;
+	}
+
+	return position;
+}
+
+/**
+ * @brief Get the positions of the pixels of a tile in the order they are rendered
+ *
+ * @param order The pixel order, ORDER_SCANLINE walking the tile row by row
+ * @param size The width and height of the tile, a power of two
+ * @return The positions of the size * size pixels relative to the corner of the tile
+ */
+inline vector<glm::ivec2> tileOrder(PixelOrder order, int size) {
+	vector<glm::ivec2> positions;
+
+	for (int index = 0; index < size * size; index++) {
+		switch (order) {
+			case ORDER_MORTON:
+				positions.push_back(mortonPosition(index));
+				break;
+			case ORDER_HILBERT:
+				positions.push_back(hilbertPosition(size, index));
+				break;
+			default:
+				positions.push_back(glm::ivec2(index % size, index / size));
+		}
+	}
+
+	return positions;
+}
+
+#endif /* PixelOrder_h */
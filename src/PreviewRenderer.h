@@ -0,0 +1,176 @@
+#include <cmath>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include "../lib/glm.hpp"
+#include "./Renderer.h"
+#include "./RenderContext.h"
+#include "./accel/Parallel.h"
+#include "./shader/GBuffer.h"
+#include "./primitives/Camera.h"
+#include "./primitives/Object.h"
+
+#ifndef PreviewRenderer_h
+#define PreviewRenderer_h
+
+using namespace std;
+
+#define PREVIEW_FACTOR 2 ///< Default ratio between the resolution of the image and that of the shading
+#define PREVIEW_SIGMA_DEPTH 0.05f ///< Relative depth difference halving the weight of a coarse sample
+#define PREVIEW_NORMAL_SQUARINGS 3 ///< The cosine between the normals is raised to the power 2^squarings
+#define PREVIEW_MIN_WEIGHT 1e-3f ///< Below this total weight a pixel is shaded at full resolution
+
+/**
+ * @brief PreviewRenderer class
+ *
+ * This class renders fast previews by shading one pixel out of every block
+ * of factor x factor pixels, while the primary visibility (object, depth
+ * and normal) is traced for every pixel. Each pixel interpolates the four
+ * nearest shaded samples with a joint-bilateral filter: the bilinear
+ * weights are multiplied by how similar the depth and normal of a sample
+ * are to those of the pixel, and samples on other objects are rejected,
+ * so the edges of objects stay sharp. A pixel no sample matches, e.g. on
+ * an object thinner than a block, is shaded on its own.
+ *
+ * A coarse sample is the pixel at the center of its block, so a factor of
+ * 1 renders the same image as renderRegion.
+ */
+class PreviewRenderer {
+public:
+	const Camera &camera; ///< The camera generating the primary rays
+	int factor = PREVIEW_FACTOR; ///< Width and height of the blocks of pixels sharing a shaded sample
+	int coarse_width = 0; ///< Number of shaded samples along the width of the image
+	int coarse_height = 0; ///< Number of shaded samples along the height of the image
+	int shaded = 0; ///< Number of pixels shaded by the last call to render, coarse samples included
+
+	/**
+	 * @brief Construct a new PreviewRenderer
+	 *
+	 * @param camera The camera generating the primary rays, kept by reference
+	 * @param factor The width and height of the blocks of pixels sharing a shaded sample, at least 1
+	 */
+	PreviewRenderer(const Camera &camera, int factor=PREVIEW_FACTOR): camera(camera), factor(max(1, factor)) {
+		coarse_width = (camera.width + this->factor - 1) / this->factor;
+		coarse_height = (camera.height + this->factor - 1) / this->factor;
+	}
+
+	/**
+	 * @brief Render the preview of a scene
+	 *
+	 * @param context The committed scene to render
+	 * @param store Called as store(i, j, color) once per pixel, from several threads
+	 */
+	template <typename Function>
+	void render(const RenderContext &context, Function store) {
+		vector<GBufferSample> features((size_t)camera.width * camera.height);
+		vector<GBufferSample> coarse_features((size_t)coarse_width * coarse_height);
+		vector<glm::vec3> coarse_colors((size_t)coarse_width * coarse_height);
+		atomic<int> fallbacks(0);
+
+		// Primary visibility at full resolution, without shading
+		parallelFor(0, camera.height, [&](int j) {
+			for (int i = 0; i < camera.width; i++) {
+				Hit hit = context.bvh.intersect(camera.generateRay(i, j), context.objects);
+				if (!hit.hit) continue;
+
+				GBufferSample &sample = features[(size_t)j * camera.width + i];
+				sample.normal = hit.normal;
+				sample.depth = hit.distance;
+				sample.object = hit.object;
+			}
+		});
+
+		// Shading at the center of every block
+		parallelFor(0, coarse_height, [&](int y) {
+			for (int x = 0; x < coarse_width; x++) {
+				size_t k = (size_t)y * coarse_width + x;
+				coarse_colors[k] = renderPixel(context, camera, samplePosition(x, camera.width), samplePosition(y, camera.height), &coarse_features[k]);
+			}
+		});
+
+		parallelFor(0, camera.height, [&](int j) {
+			int y0, y1;
+			float ty = interpolation(j, camera.height, coarse_height, y0, y1);
+
+			for (int i = 0; i < camera.width; i++) {
+				int x0, x1;
+				float tx = interpolation(i, camera.width, coarse_width, x0, x1);
+
+				const GBufferSample &pixel = features[(size_t)j * camera.width + i];
+
+				// The pixel of a coarse sample keeps its shaded color
+				if (tx == 0.0f && ty == 0.0f && samplePosition(x0, camera.width) == i && samplePosition(y0, camera.height) == j) {
+					store(i, j, coarse_colors[(size_t)y0 * coarse_width + x0]);
+					continue;
+				}
+
+				const int xs[4] = {x0, x1, x0, x1}, ys[4] = {y0, y0, y1, y1};
+				const float bilinear[4] = {(1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty};
+				glm::vec3 color(0.0);
+				float weight_sum = 0.0;
+
+				for (int s = 0; s < 4; s++) {
+					size_t k = (size_t)ys[s] * coarse_width + xs[s];
+					float weight = bilinear[s] * similarity(pixel, coarse_features[k]);
+
+					color += weight * coarse_colors[k];
+					weight_sum += weight;
+				}
+
+				if (weight_sum >= PREVIEW_MIN_WEIGHT) {
+					store(i, j, color / weight_sum);
+				} else {
+					store(i, j, renderPixel(context, camera, i, j));
+					fallbacks++;
+				}
+			}
+		});
+
+		shaded = coarse_width * coarse_height + fallbacks;
+	}
+
+private:
+	/**
+	 * @brief Get the pixel of the image where a coarse sample is shaded, the center of its block
+	 */
+	int samplePosition(int coarse, int size) const {
+		return min(coarse * factor + factor / 2, size - 1);
+	}
+
+	/**
+	 * @brief Find the two coarse samples around a pixel along one axis
+	 *
+	 * @param pixel The coordinate of the pixel
+	 * @param size The size of the image along the axis
+	 * @param coarse_size The number of coarse samples along the axis
+	 * @param first Set to the coarse sample before the pixel, or the first one
+	 * @param second Set to the coarse sample after the pixel, or the last one
+	 * @return The weight of the second sample
+	 */
+	float interpolation(int pixel, int size, int coarse_size, int &first, int &second) const {
+		first = glm::clamp((pixel - factor / 2) / factor, 0, coarse_size - 1);
+		second = min(first + 1, coarse_size - 1);
+
+		int from = samplePosition(first, size), to = samplePosition(second, size);
+		if (to == from) return 0.0f;
+
+		return glm::clamp((float)(pixel - from) / (to - from), 0.0f, 1.0f);
+	}
+
+	/**
+	 * @brief Weight of a coarse sample for a pixel given their primary hits, 0 on different objects
+	 */
+	static float similarity(const GBufferSample &pixel, const GBufferSample &sample) {
+		if (pixel.object != sample.object) return 0.0f;
+		if (pixel.object == NULL) return 1.0f;
+
+		float cosine = max(glm::dot(pixel.normal, sample.normal), 0.0f);
+		for (int k = 0; k < PREVIEW_NORMAL_SQUARINGS; k++) cosine = cosine * cosine;
+
+		// A weight exp(-x) halves at x = ln(2)
+		float depth_difference = fabsf(sample.depth - pixel.depth) / max(pixel.depth, 1e-3f);
+		return cosine * expf(-0.6931472f * depth_difference / PREVIEW_SIGMA_DEPTH);
+	}
+};
+
+#endif /* PreviewRenderer_h */
@@ -0,0 +1,129 @@
+#include <cmath>
+#include "../lib/glm.hpp"
+#include "./RenderContext.h"
+#include "./accel/Parallel.h"
+#include "./primitives/Ray.h"
+#include "./primitives/Object.h"
+
+#ifndef RayQuery_h
+#define RayQuery_h
+
+#define RAY_QUERY_GRAIN 256 ///< Number of consecutive rays handled by a thread at once
+
+/**
+ * @brief RayBatch structure
+ *
+ * This structure describes a batch of rays stored as structure of arrays.
+ * Directions need not be normalized, t_max is a distance along the ray.
+ */
+struct RayBatch {
+	int count = 0; ///< Number of rays
+	const float * origin[3] = {NULL, NULL, NULL}; ///< x, y and z coordinates of the origins
+	const float * direction[3] = {NULL, NULL, NULL}; ///< x, y and z coordinates of the directions
+	const float * t_max = NULL; ///< Maximum hit distance of every ray, NULL for no limit
+};
+
+/**
+ * @brief HitBatch structure
+ *
+ * This structure receives the results of a batch of closest hit queries as
+ * structure of arrays. Arrays that are NULL are not written. Rays that hit
+ * nothing get an infinite distance and the object -1.
+ */
+struct HitBatch {
+	float * distance = NULL; ///< Distance from the origin to the hit
+	int * object = NULL; ///< Index of the hit object in the context
+	float * normal[3] = {NULL, NULL, NULL}; ///< x, y and z coordinates of the normal at the hit
+	float * uv[2] = {NULL, NULL}; ///< Texture coordinates of the hit
+};
+
+/**
+ * @brief Get one ray of a batch
+ *
+ * @param rays The batch
+ * @param k The index of the ray
+ * @param t_max Set to the maximum hit distance of the ray
+ * @return The ray with a normalized direction
+ */
+inline Ray batchRay(const RayBatch &rays, int k, float &t_max) {
+	glm::vec3 origin(rays.origin[0][k], rays.origin[1][k], rays.origin[2][k]);
+	glm::vec3 direction(rays.direction[0][k], rays.direction[1][k], rays.direction[2][k]);
+
+	t_max = rays.t_max ? rays.t_max[k] : INFINITY;
+
+	return Ray(origin, glm::normalize(direction));
+}
+
+/**
+ * @brief Function that finds the closest hit of every ray of a batch using all the worker threads
+ *
+ * Follows the semantics of Object::intersect and Hit, keeping only hits
+ * closer than the maximum distance of the ray.
+ *
+ * @param context The committed scene
+ * @param rays The rays to trace
+ * @param hits The arrays receiving the results
+ */
+inline void intersectRays(const RenderContext &context, const RayBatch &rays, HitBatch &hits) {
+	parallelFor(0, rays.count, [&](int k) {
+		float t_max;
+		Ray ray = batchRay(rays, k, t_max);
+
+		Hit closest_hit;
+		closest_hit.hit = false;
+		closest_hit.distance = t_max;
+		int closest_object = -1;
+
+		context.bvh.traverse(ray, t_max, [&](int index) {
+			Hit hit = context.objects[index]->intersect(ray);
+
+			if (hit.hit == true && hit.distance < closest_hit.distance) {
+				closest_hit = hit;
+				closest_object = index;
+				t_max = hit.distance;
+			}
+
+			return false;
+		});
+
+		if (hits.distance) hits.distance[k] = closest_hit.hit ? closest_hit.distance : INFINITY;
+		if (hits.object) hits.object[k] = closest_object;
+
+		for (int axis = 0; axis < 3; axis++) {
+			if (hits.normal[axis]) hits.normal[axis][k] = closest_hit.hit ? closest_hit.normal[axis] : 0.0f;
+		}
+
+		for (int axis = 0; axis < 2; axis++) {
+			if (hits.uv[axis]) hits.uv[axis][k] = closest_hit.hit ? closest_hit.uv[axis] : 0.0f;
+		}
+	}, RAY_QUERY_GRAIN);
+}
+
+/**
+ * @brief Function that checks which rays of a batch hit any object using all the worker threads
+ *
+ * The traversal of a ray stops at the first hit closer than its maximum distance.
+ *
+ * @param context The committed scene
+ * @param rays The rays to trace
+ * @param occluded Set to 1 for the rays hitting an object, 0 otherwise
+ */
+inline void occludedRays(const RenderContext &context, const RayBatch &rays, int * occluded) {
+	parallelFor(0, rays.count, [&](int k) {
+		float t_max;
+		Ray ray = batchRay(rays, k, t_max);
+		float limit = t_max;
+		bool blocked = false;
+
+		context.bvh.traverse(ray, t_max, [&](int index) {
+			Hit hit = context.objects[index]->intersect(ray);
+			blocked = hit.hit == true && hit.distance < limit;
+
+			return blocked;
+		});
+
+		occluded[k] = blocked;
+	}, RAY_QUERY_GRAIN);
+}
+
+#endif /* RayQuery_h */
@@ -0,0 +1,231 @@
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include "../lib/glm.hpp"
+#include "./PixelOrder.h"
+#include "./accel/BVH.h"
+#include "./accel/LightGrid.h"
+#include "./accel/LightTree.h"
+#include "./primitives/Light.h"
+#include "./primitives/Object.h"
+#include "./attributes/Material.h"
+#include "./attributes/TextureCache.h"
+
+#ifndef RenderContext_h
+#define RenderContext_h
+
+using namespace std;
+
+/**
+ * @brief ShadowCounters structure
+ *
+ * This structure counts the shadow rays traced by one thread with the
+ * occluder cache. It fills its own cache lines, so that the threads counting
+ * at the same time never write to the same line.
+ */
+struct alignas(64) ShadowCounters {
+	long long rays = 0; ///< Number of shadow rays traced with the cache
+	long long blocked = 0; ///< Number of them blocked by an opaque object
+	long long cache_hits = 0; ///< Number of them blocked by the cached occluder
+};
+
+/**
+ * @brief ShadowCounterPool class
+ *
+ * This class owns the shadow counters of the threads rendering a context. A
+ * thread takes counters when it first traces a shadow ray in the context and
+ * gives them back, with their counts, when it exits, so the pool grows to the
+ * largest number of threads rendering at once. The occluder caches of the
+ * threads share the pool, as they may outlive the context.
+ */
+class ShadowCounterPool {
+public:
+	/**
+	 * @brief Take counters for the calling thread
+	 *
+	 * @return Counters used by no other thread, which keep their counts
+	 */
+	ShadowCounters * acquire() {
+		lock_guard<mutex> guard(lock);
+
+		if (available.empty()) {
+			counters.emplace_back();
+			return &counters.back();
+		}
+
+		ShadowCounters * taken = available.back();
+		available.pop_back();
+		return taken;
+	}
+
+	/**
+	 * @brief Give back counters taken with acquire
+	 *
+	 * @param released The counters, whose counts are kept in the totals
+	 */
+	void release(ShadowCounters * released) {
+		lock_guard<mutex> guard(lock);
+		available.push_back(released);
+	}
+
+	/**
+	 * @brief Sum the counters of all the threads, must not be called while rendering
+	 */
+	ShadowCounters total() const {
+		lock_guard<mutex> guard(lock);
+		ShadowCounters sum;
+
+		for (const ShadowCounters &thread : counters) {
+			sum.rays += thread.rays;
+			sum.blocked += thread.blocked;
+			sum.cache_hits += thread.cache_hits;
+		}
+
+		return sum;
+	}
+
+private:
+	mutable mutex lock; ///< Protects the lists of counters
+	deque<ShadowCounters> counters; ///< Counters of every thread, at stable addresses
+	vector<ShadowCounters *> available; ///< Counters released by the threads that exited
+};
+
+/**
+ * @brief RenderContext class
+ *
+ * This class owns everything needed to render a scene: the objects, the
+ * table of materials they refer to by index, the image textures with their
+ * tile cache, the lights and the acceleration structures. Contexts are
+ * independent, so several scenes can be built and rendered concurrently in
+ * one process. Once committed, a context is only read during rendering.
+ */
+class RenderContext {
+public:
+	vector<Object *> objects; ///< A list of all objects in the scene, owned by the context
+	vector<Material> materials; ///< The material table, indexed by Object::material and Hit::material
+	TextureCache textures; ///< The image textures, indexed by Material::image
+	vector<Light *> lights; ///< A list of lights in the scene, owned by the context
+	glm::vec3 ambient_light = glm::vec3(1.0); ///< Intensity of the ambient light
+	BVH bvh; ///< The acceleration structure over the objects in the scene
+	LightGrid light_grid; ///< The lights that can contribute to every region of the scene
+	float light_threshold = 0.0; ///< Contribution below which lights are culled, 0 to shade with every light
+	LightTree light_tree; ///< The hierarchy the lights are sampled from
+	int light_samples = 0; ///< Lights sampled per shading point, 0 to shade with every light
+	bool shadow_cache = true; ///< Test the last occluder of every light before traversing the BVH for shadows
+	shared_ptr<ShadowCounterPool> shadow_counters = make_shared<ShadowCounterPool>(); ///< Shadow rays counted by the threads, see shadowStats
+	bool ray_differentials = true; ///< Filter the texture lookups over the footprints of the rays
+	bool fast_math = false; ///< Use the approximations of FastMath.h, see setFastMath
+	PixelOrder pixel_order = ORDER_MORTON; ///< Order in which the pixels are rendered
+	int tile_size = PIXEL_TILE_SIZE; ///< Width and height of the tiles of the tiled orders, a power of two
+
+	/**
+	 * @brief Construct an empty RenderContext
+	 */
+	RenderContext() {}
+
+	RenderContext(const RenderContext &) = delete;
+	RenderContext & operator=(const RenderContext &) = delete;
+
+	/**
+	 * @brief Destroy the RenderContext object with its objects and lights
+	 */
+	~RenderContext() {
+		for (Object * object : objects) delete object;
+		for (Light * light : lights) delete light;
+	}
+
+	/**
+	 * @brief Add an object to the scene, the context takes its ownership
+	 *
+	 * @param object The object to add
+	 */
+	void addObject(Object * object) {
+		object->fast_math = fast_math;
+		objects.push_back(object);
+	}
+
+	/**
+	 * @brief Choose between the libm functions and the approximations of FastMath.h
+	 *
+	 * The fast mode trades a small, documented error in the shapes, the
+	 * shading and the tone mapping for speed. Must not be called while rendering.
+	 *
+	 * @param enabled Whether to use the approximations
+	 */
+	void setFastMath(bool enabled) {
+		fast_math = enabled;
+		for (Object * object : objects) object->fast_math = enabled;
+	}
+
+	/**
+	 * @brief Get the shadow rays traced with the occluder cache by all the threads, must not be called while rendering
+	 */
+	ShadowCounters shadowStats() const {
+		return shadow_counters->total();
+	}
+
+	/**
+	 * @brief Get the fraction of the blocked shadow rays resolved by the occluder cache, must not be called while rendering
+	 */
+	float shadowCacheHitRate() const {
+		ShadowCounters stats = shadowStats();
+		return stats.blocked > 0 ? (float)stats.cache_hits / stats.blocked : 0.0f;
+	}
+
+	/**
+	 * @brief Add a material to the material table
+	 *
+	 * @param material The material to add
+	 * @return The index of the material, to be given to the objects using it
+	 */
+	int addMaterial(const Material &material) {
+		materials.push_back(material);
+		return materials.size() - 1;
+	}
+
+	/**
+	 * @brief Get a material of the table
+	 *
+	 * @param index The index of the material
+	 * @return A reference to the material, valid until the next material is added
+	 */
+	const Material & getMaterial(int index) const {
+		return materials[index];
+	}
+
+	/**
+	 * @brief Add an image texture from a tiled texture file, see convertTexture
+	 *
+	 * @param path The path of the file
+	 * @return The index of the texture, to be given to the materials using it, or -1 if the file cannot be opened
+	 */
+	int addImageTexture(const char * path) {
+		return textures.add(path);
+	}
+
+	/**
+	 * @brief Add a light to the scene, the context takes its ownership
+	 *
+	 * @param light The light to add
+	 */
+	void addLight(Light * light) {
+		lights.push_back(light);
+	}
+
+	/**
+	 * @brief Build the acceleration structures, must be called after the scene is edited
+	 *
+	 * @param builder The algorithm used to build the BVH
+	 * @param width The branching factor of the BVH: 2, 4 or 8
+	 * @param precision The bits per child box coordinate of the BVH: 8, 16 or 32
+	 * @param split_budget The fraction of duplicated references allowed by the SBVH builder
+	 */
+	void commit(BVHBuilder builder=BUILDER_SAH, int width=2, int precision=32, float split_budget=0.3) {
+		bvh.build(objects, builder, width, precision, split_budget);
+		light_grid.build(lights, light_threshold);
+		light_tree.build(lights);
+	}
+};
+
+#endif /* RenderContext_h */
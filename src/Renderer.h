@@ -0,0 +1,140 @@
+#include <cmath>
+#include <vector>
+#include "./PixelOrder.h"
+#include "./RenderContext.h"
+#include "./accel/Parallel.h"
+#include "./shader/Phong.h"
+#include "./shader/GBuffer.h"
+#include "./primitives/Camera.h"
+
+#ifndef Renderer_h
+#define Renderer_h
+
+/**
+ * @brief Region structure
+ *
+ * This structure represents a rectangle of pixels of the image of a camera.
+ */
+struct Region {
+	int x = 0; ///< Column of the top left pixel
+	int y = 0; ///< Row of the top left pixel
+	int width = 0; ///< Width of the rectangle in pixels
+	int height = 0; ///< Height of the rectangle in pixels
+};
+
+/**
+ * @brief Function that renders one pixel of the image of a camera
+ *
+ * @param context The committed scene to render
+ * @param camera The camera generating the primary rays
+ * @param i The column of the pixel
+ * @param j The row of the pixel
+ * @param sample Filled with the features of the primary hit, or NULL
+ * @return The color of the pixel
+ */
+inline glm::vec3 renderPixel(const RenderContext &context, const Camera &camera, int i, int j, GBufferSample * sample=NULL) {
+	RayDifferential differential = context.ray_differentials ? camera.generateDifferential(i, j) : RayDifferential();
+	gbufferSample() = sample;
+
+	return trace_ray(context, camera.generateRay(i, j), false, differential);
+}
+
+/**
+ * @brief Function that renders a tile of the image of a camera on the calling thread
+ *
+ * The tile is walked in square sub-tiles, left to right and top to bottom,
+ * each in the given order. Sub-tiles are cut by the tile.
+ *
+ * @param context The committed scene to render
+ * @param camera The camera generating the primary rays
+ * @param region The rectangle of pixels of the tile
+ * @param order The positions of the pixels of a sub-tile in the order they are rendered, see tileOrder
+ * @param store Called as store(i, j, color) once per pixel, in the order they are rendered
+ * @param features The G-buffer of the image, row by row, filled for the pixels of the tile, or NULL
+ */
+template <typename Function>
+void renderTile(const RenderContext &context, const Camera &camera, Region region, const vector<glm::ivec2> &order, Function store, GBufferSample * features=NULL) {
+	int size = (int)sqrt((double)order.size());
+
+	for (int y = 0; y < region.height; y += size) {
+		for (int x = 0; x < region.width; x += size) {
+			for (glm::ivec2 offset : order) {
+				int dx = x + offset.x, dy = y + offset.y;
+				if (dx >= region.width || dy >= region.height) continue;
+
+				int i = region.x + dx, j = region.y + dy;
+				store(i, j, renderPixel(context, camera, i, j, features ? &features[(size_t)j * camera.width + i] : NULL));
+			}
+		}
+	}
+}
+
+/**
+ * @brief Function that renders a region of the image of a camera using all the worker threads
+ *
+ * The pixels are rendered in the order of context.pixel_order, which does
+ * not change their colors, and stored row by row within a row or tile.
+ *
+ * @param context The committed scene to render
+ * @param camera The camera generating the primary rays
+ * @param region The rectangle of pixels to render
+ * @param store Called as store(i, j, color) once per pixel, from several threads
+ * @param features The G-buffer of the image, row by row, filled for the pixels of the region, or NULL
+ */
+template <typename Function>
+void renderRegion(const RenderContext &context, const Camera &camera, Region region, Function store, GBufferSample * features=NULL) {
+	auto feature = [&](int i, int j) {
+		return features ? &features[(size_t)j * camera.width + i] : NULL;
+	};
+
+	if (context.pixel_order == ORDER_SCANLINE) {
+		parallelFor(region.y, region.y + region.height, [&](int j) {
+			for (int i = region.x; i < region.x + region.width; i++) store(i, j, renderPixel(context, camera, i, j, feature(i, j)));
+		});
+
+		return;
+	}
+
+	int size = context.tile_size;
+	int tiles_x = (region.width + size - 1) / size;
+	int tiles_y = (region.height + size - 1) / size;
+	vector<glm::ivec2> order = tileOrder(context.pixel_order, size);
+
+	parallelFor(0, tiles_x * tiles_y, [&](int tile) {
+		int x = region.x + (tile % tiles_x) * size;
+		int y = region.y + (tile / tiles_x) * size;
+
+		// Border tiles are cut by the region
+		Region tile_region;
+		tile_region.x = x;
+		tile_region.y = y;
+		tile_region.width = min(size, region.x + region.width - x);
+		tile_region.height = min(size, region.y + region.height - y);
+		vector<glm::vec3> colors(size * size);
+
+		renderTile(context, camera, tile_region, order, [&](int i, int j, glm::vec3 color) {
+			colors[(j - y) * size + (i - x)] = color;
+		}, features);
+
+		// Stored row by row, so the writes to a row-major image are contiguous
+		for (int dy = 0; dy < tile_region.height; dy++) {
+			for (int dx = 0; dx < tile_region.width; dx++) store(x + dx, y + dy, colors[dy * size + dx]);
+		}
+	});
+}
+
+/**
+ * @brief Get the region covering the whole image of a camera
+ *
+ * @param camera The camera
+ * @return The full image region
+ */
+inline Region fullRegion(const Camera &camera) {
+	Region region;
+	region.width = camera.width;
+	region.height = camera.height;
+
+	return region;
+}
+
+#endif /* Renderer_h */
@@ -1,8 +1,9 @@
+#include <iostream>
 #include "../lib/glm.hpp"
 #include "./shapes/Cone.h"
 #include "./shapes/Plane.h"
 #include "./shapes/Sphere.h"
-#include "./shader/Shadows.h"
+#include "./RenderContext.h"
 #include "./primitives/Light.h"
 #include "./primitives/Object.h"
 #include "./attributes/Material.h"
@@ -12,7 +13,15 @@
 #ifndef Scene_h
 #define Scene_h
 
-void sceneDefinition(float x=0, float y=12) {
+/**
+ * @brief Function that defines the demo scene
+ *
+ * @param context The context the objects and lights are added to
+ * @param x The x coordinate of the movable light
+ * @param y The z coordinate of the movable light
+ * @param texture A tiled texture file mapped on the large sphere instead of the rainbow texture, or NULL
+ */
+inline void sceneDefinition(RenderContext &context, float x=0, float y=12, const char * texture=NULL) {
 	// Materials
 	Material blue;
 	blue.ambient = glm::vec3(0.06f, 0.06f, 0.09f);
@@ -79,6 +88,22 @@ void sceneDefinition(float x=0, float y=12) {
 	Material rainbow;
 	rainbow.texture = &rainbowTexture;
 
+	if (texture) {
+		rainbow.image = context.addImageTexture(texture);
+		if (rainbow.image < 0) cerr << "Cannot open the texture " << texture << ", using the rainbow texture." << endl;
+	}
+
+	// Material table
+	int red_id = context.addMaterial(red);
+	int mirror_id = context.addMaterial(mirror);
+	int glass_id = context.addMaterial(glass);
+	int rainbow_id = context.addMaterial(rainbow);
+	int green_id = context.addMaterial(green);
+	int blue_matte_id = context.addMaterial(blue_matte);
+	int red_matte_id = context.addMaterial(red_matte);
+	int white_id = context.addMaterial(white);
+	int yellow_id = context.addMaterial(yellow);
+
 	// Transformation Matrices
 	glm::mat4 ST1 = glm::translate(glm::vec3(-1.0, -2.5, 6.0));
 	glm::mat4 SS1 = glm::scale(glm::vec3(0.5, 0.5, 0.5));
@@ -105,45 +130,88 @@ void sceneDefinition(float x=0, float y=12) {
 	glm::mat4 CM2 = CT2 * CR2 * CS2;
 
 	// Normal Spheres
-	Sphere * sphere1 = new Sphere(red);
+	Sphere * sphere1 = new Sphere(red_id);
 	sphere1->setTransformation(SM1);
-	objects.push_back(sphere1);
+	context.addObject(sphere1);
 
 	// Special Spheres
-	Sphere * sphere2 = new Sphere(mirror);
+	Sphere * sphere2 = new Sphere(mirror_id);
 	sphere2->setTransformation(SM2);
-	objects.push_back(sphere2);
+	context.addObject(sphere2);
 
-	Sphere * sphere3 = new Sphere(glass);
+	Sphere * sphere3 = new Sphere(glass_id);
 	sphere3->setTransformation(SM3);
-	objects.push_back(sphere3);
+	context.addObject(sphere3);
 
 	// Textured spheres
-	Sphere * sphere4 = new Sphere(rainbow);
+	Sphere * sphere4 = new Sphere(rainbow_id);
 	sphere4->setTransformation(SM4);
-	objects.push_back(sphere4);
+	context.addObject(sphere4);
 
 	// Planes
-	objects.push_back(new Plane(glm::vec3(0, 0, 30.0), glm::normalize(glm::vec3(0, 0, 30.0)), green));
-	objects.push_back(new Plane(glm::vec3(0, 0, -0.01), glm::normalize(glm::vec3(0, 0, -0.01)), green));
-	objects.push_back(new Plane(glm::vec3(15.0, 0, 0), glm::normalize(glm::vec3(15.0, 0, 0)), blue_matte));
-	objects.push_back(new Plane(glm::vec3(-15.0, 0, 0), glm::normalize(glm::vec3(-15.0, 0, 0)), red_matte));
-	objects.push_back(new Plane(glm::vec3(0, 27.0, 0), glm::normalize(glm::vec3(0, 27.0, 0)), white));
-	objects.push_back(new Plane(glm::vec3(0, -3.0, 0), glm::normalize(glm::vec3(0, -3.0, 0)), white));
+	context.addObject(new Plane(glm::vec3(0, 0, 30.0), glm::normalize(glm::vec3(0, 0, 30.0)), green_id));
+	context.addObject(new Plane(glm::vec3(0, 0, -0.01), glm::normalize(glm::vec3(0, 0, -0.01)), green_id));
+	context.addObject(new Plane(glm::vec3(15.0, 0, 0), glm::normalize(glm::vec3(15.0, 0, 0)), blue_matte_id));
+	context.addObject(new Plane(glm::vec3(-15.0, 0, 0), glm::normalize(glm::vec3(-15.0, 0, 0)), red_matte_id));
+	context.addObject(new Plane(glm::vec3(0, 27.0, 0), glm::normalize(glm::vec3(0, 27.0, 0)), white_id));
+	context.addObject(new Plane(glm::vec3(0, -3.0, 0), glm::normalize(glm::vec3(0, -3.0, 0)), white_id));
 	
 	// Cones
-	Cone * cone1 = new Cone(yellow);
+	Cone * cone1 = new Cone(yellow_id);
 	cone1->setTransformation(CM1);
-	objects.push_back(cone1);
+	context.addObject(cone1);
 
-	Cone * cone2 = new Cone(green);
+	Cone * cone2 = new Cone(green_id);
 	cone2->setTransformation(CM2);
-	objects.push_back(cone2);
+	context.addObject(cone2);
 
 	// Light sources
-	lights.push_back(new Light(glm::vec3(0, 26, 5), glm::vec3(0.2)));
-	lights.push_back(new Light(glm::vec3(x, 1, y), glm::vec3(0.2)));
-	lights.push_back(new Light(glm::vec3(0, 5, 1), glm::vec3(0.2)));
+	context.addLight(new Light(glm::vec3(0, 26, 5), glm::vec3(0.2)));
+	context.addLight(new Light(glm::vec3(x, 1, y), glm::vec3(0.2)));
+	context.addLight(new Light(glm::vec3(0, 5, 1), glm::vec3(0.2)));
+}
+
+/**
+ * @brief Function that scatters dim lights in the room of the demo scene
+ *
+ * The lights share the intensity of one of the main lights, so the image
+ * keeps its brightness whatever their number. Their positions are the same
+ * from run to run.
+ *
+ * @param context The context the lights are added to
+ * @param count The number of lights to add
+ */
+inline void scatterLights(RenderContext &context, int count) {
+	unsigned int state = 1;
+	auto random = [&state]() {
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) / 16777216.0f;
+	};
+
+	for (int k = 0; k < count; k++) {
+		glm::vec3 position(30.0f * random() - 15.0f, 30.0f * random() - 3.0f, 30.0f * random());
+		glm::vec3 color = glm::vec3(random(), random(), random()) * (0.4f / count);
+		context.addLight(new Light(position, color));
+	}
+}
+
+/**
+ * @brief Function that translates an object of a scene
+ *
+ * The context must be committed again before rendering.
+ *
+ * @param context The context of the object
+ * @param index The index of the object in the context
+ * @param offset The translation in global coordinates
+ * @return False if there is no such object
+ */
+inline bool moveObject(RenderContext &context, int index, glm::vec3 offset) {
+	if (index < 0 || index >= (int)context.objects.size()) return false;
+
+	Object * object = context.objects[index];
+	object->setTransformation(glm::translate(offset) * object->getTransformation());
+
+	return true;
 }
 
 #endif /* Scene_h */
@@ -0,0 +1,156 @@
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include "./Renderer.h"
+#include "./primitives/Image.h"
+
+#ifndef Stitch_h
+#define Stitch_h
+
+using namespace std;
+
+/**
+ * @file Stitch.h
+ * @brief Rendering of rectangles of a frame and assembly of the rectangles into the frame
+ *
+ * A crop is a PPM image of a region of the frame of a camera. Its pixels
+ * are those of the same region of a full render, since every pixel only
+ * depends on its position in the frame. The position of the region and the
+ * size of the frame are kept in a comment of the header, see regionComment,
+ * so crops rendered separately, e.g. on several machines, can be stitched.
+ */
+
+/**
+ * @brief Function that parses a region given as WIDTHxHEIGHT+X+Y
+ *
+ * @param geometry The region, e.g. 256x128+512+0
+ * @param region Set to the parsed region
+ * @return False if the region is malformed or empty
+ */
+inline bool parseRegion(const char * geometry, Region &region) {
+	char end;
+	if (sscanf(geometry, "%dx%d+%d+%d%c", &region.width, &region.height, &region.x, &region.y, &end) != 4) return false;
+
+	return region.width > 0 && region.height > 0 && region.x >= 0 && region.y >= 0;
+}
+
+/**
+ * @brief Function that clips a region to a frame
+ *
+ * @param region The region
+ * @param width The width of the frame
+ * @param height The height of the frame
+ * @return The part of the region inside the frame, of zero width or height if there is none
+ */
+inline Region clipRegion(Region region, int width, int height) {
+	region.width = max(0, min(region.x + region.width, width) - region.x);
+	region.height = max(0, min(region.y + region.height, height) - region.y);
+
+	return region;
+}
+
+/**
+ * @brief Function that describes the place of a crop in its frame, written in the header of the crop
+ *
+ * @param region The region of the crop
+ * @param width The width of the frame
+ * @param height The height of the frame
+ * @return The comment, "region X Y WIDTH HEIGHT" with the size of the frame
+ */
+inline string regionComment(const Region &region, int width, int height) {
+	return "region " + to_string(region.x) + " " + to_string(region.y) + " " + to_string(width) + " " + to_string(height);
+}
+
+/**
+ * @brief Function that assembles crops into the image of their frame
+ *
+ * The pixels not covered by any crop are black, and crops that overlap
+ * are written in the order they are given.
+ *
+ * @param output The path of the PPM image of the frame
+ * @param inputs The paths of the crops, plain (P3) PPM images with a region comment
+ * @return False if a crop cannot be read, has no region comment or does not fit the frame of the first crop
+ */
+inline bool stitchImages(const char * output, const vector<const char *> &inputs) {
+	unique_ptr<Image> image;
+	int frame_width = 0, frame_height = 0;
+
+	for (const char * input : inputs) {
+		ifstream file(input);
+		string format, line;
+		Region region;
+		int width = -1, height = -1, max_value, crop_width = 0, crop_height = 0;
+
+		if (!(file >> format) || format != "P3") {
+			cerr << input << " is not a plain PPM image." << endl;
+			return false;
+		}
+
+		// Comments follow the format, the region comment among them
+		while (file >> ws && file.peek() == '#') {
+			getline(file, line);
+
+			string keyword;
+			istringstream comment(line.substr(1));
+			if (comment >> keyword && keyword == "region") comment >> region.x >> region.y >> width >> height;
+		}
+
+		if (!(file >> crop_width >> crop_height >> max_value) || crop_width <= 0 || crop_height <= 0) {
+			cerr << input << " has a malformed size." << endl;
+			return false;
+		}
+
+		if (max_value != 255) {
+			cerr << input << " has a maximum value of " << max_value << ", not 255." << endl;
+			return false;
+		}
+
+		if (width <= 0 || height <= 0) {
+			cerr << input << " has no region comment." << endl;
+			return false;
+		}
+
+		region.width = crop_width;
+		region.height = crop_height;
+
+		if (!image) {
+			frame_width = width;
+			frame_height = height;
+			image.reset(new Image(width, height));
+
+			for (int y = 0; y < height; y++) {
+				for (int x = 0; x < width; x++) image->setPixel(x, y, 0, 0, 0);
+			}
+		}
+
+		if (width != frame_width || height != frame_height || region.x < 0 || region.y < 0 || region.x + region.width > width || region.y + region.height > height) {
+			cerr << input << " does not fit the frame of " << inputs[0] << "." << endl;
+			return false;
+		}
+
+		for (int y = 0; y < region.height; y++) {
+			for (int x = 0; x < region.width; x++) {
+				int r, g, b;
+
+				if (!(file >> r >> g >> b)) {
+					cerr << input << " is truncated." << endl;
+					return false;
+				}
+
+				image->setPixel(region.x + x, region.y + y, r, g, b);
+			}
+		}
+	}
+
+	if (!image) return false;
+
+	image->writeImage(output);
+	return true;
+}
+
+#endif /* Stitch_h */
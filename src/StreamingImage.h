@@ -0,0 +1,224 @@
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../lib/glm.hpp"
+#include "./PixelOrder.h"
+#include "./Renderer.h"
+#include "./RenderContext.h"
+#include "./accel/Parallel.h"
+#include "./primitives/Camera.h"
+
+#ifndef StreamingImage_h
+#define StreamingImage_h
+
+using namespace std;
+
+#define STREAMING_IMAGE_MAGIC 0x42465452 ///< "RTFB" read as a little endian int
+#define STREAMING_IMAGE_VERSION 1 ///< Version of the on-disk layout
+#define STREAMING_IMAGE_TILE 64 ///< Width and height of the tiles of the file
+#define STREAMING_IMAGE_MEMORY 256 ///< Default memory budget of the tiles in flight in MB
+
+/**
+ * @brief StreamingImageHeader structure
+ *
+ * This structure starts a tiled image file. It is followed by the tiles,
+ * row by row, each one as tile_size * tile_size RGB pixels of one byte per
+ * channel, so that the offset of every tile is known before it is rendered.
+ * The pixels of the tiles on the right and bottom borders past the image
+ * are left at zero.
+ */
+struct StreamingImageHeader {
+	int magic = STREAMING_IMAGE_MAGIC; ///< Identifies the file format
+	int version = STREAMING_IMAGE_VERSION; ///< Version of the layout
+	int width = 0; ///< Width of the image
+	int height = 0; ///< Height of the image
+	int tile_size = STREAMING_IMAGE_TILE; ///< Width and height of a tile
+	int tiles_x = 0; ///< Number of tiles in a row
+	int tiles_y = 0; ///< Number of tiles in a column
+};
+
+/**
+ * @brief StreamingImage class
+ *
+ * This class is an image kept in a tiled file rather than in memory, for
+ * renders too large for Image. Every tile is rendered into a small buffer
+ * and written at its place in the file by the thread that rendered it, so
+ * only the tiles in flight are resident. Their number is bounded by a
+ * memory budget. The file is then converted to a PPM image a strip of rows
+ * at a time.
+ *
+ * The channels are stored as Image::setPixel stores them, truncated to an
+ * integer, and clamped to a byte, so the PPM images are the same for
+ * colors in [0, 1].
+ */
+class StreamingImage {
+public:
+	string path; ///< The tiled image file
+	StreamingImageHeader header; ///< Describes the image
+	size_t memory = (size_t)STREAMING_IMAGE_MEMORY << 20; ///< Memory budget of the tiles in flight and of the conversion in bytes
+	int peak = 0; ///< Largest number of tiles that were in flight together
+
+	/**
+	 * @brief Construct a new StreamingImage and create its file
+	 *
+	 * @param path The tiled image file, replaced if it exists
+	 * @param width The width of the image
+	 * @param height The height of the image
+	 * @param memory The memory budget in bytes, at least one tile is always in flight
+	 */
+	StreamingImage(const string &path, int width, int height, size_t memory): path(path), memory(memory) {
+		header.width = width;
+		header.height = height;
+		header.tiles_x = (width + header.tile_size - 1) / header.tile_size;
+		header.tiles_y = (height + header.tile_size - 1) / header.tile_size;
+
+		file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+		// The size of the file is set at once, the tiles filling its holes as they are written
+		if (file >= 0 && (pwrite(file, &header, sizeof(header), 0) != sizeof(header) || ftruncate(file, tileOffset(header.tiles_x * header.tiles_y)) != 0)) {
+			close(file);
+			file = -1;
+		}
+	}
+
+	StreamingImage(const StreamingImage &) = delete;
+	StreamingImage & operator=(const StreamingImage &) = delete;
+
+	/**
+	 * @brief Close the file of the image
+	 */
+	~StreamingImage() {
+		if (file >= 0) close(file);
+	}
+
+	/**
+	 * @brief Check whether the file of the image was created
+	 */
+	bool isOpen() const {
+		return file >= 0;
+	}
+
+	/**
+	 * @brief Render the image tile by tile using all the worker threads
+	 *
+	 * @param context The committed scene to render
+	 * @param camera The camera generating the primary rays, of the size of the image
+	 * @return False if a tile could not be written
+	 */
+	bool render(const RenderContext &context, const Camera &camera) {
+		int tile_size = header.tile_size;
+		size_t tile_bytes = 3 * tile_size * tile_size;
+		int slots = max<size_t>(1, memory / tile_bytes);
+		int in_flight = 0;
+		bool written = true;
+		mutex lock;
+		condition_variable available;
+
+		vector<glm::ivec2> order = tileOrder(context.pixel_order, context.tile_size);
+
+		parallelFor(0, header.tiles_x * header.tiles_y, [&](int tile) {
+			{
+				// Wait for a slot of the budget before allocating the tile
+				unique_lock<mutex> guard(lock);
+				available.wait(guard, [&]() { return in_flight < slots; });
+				peak = max(peak, ++in_flight);
+			}
+
+			vector<unsigned char> pixels(tile_bytes, 0);
+			Region region;
+			region.x = (tile % header.tiles_x) * tile_size;
+			region.y = (tile / header.tiles_x) * tile_size;
+			region.width = min(tile_size, header.width - region.x);
+			region.height = min(tile_size, header.height - region.y);
+
+			renderTile(context, camera, region, order, [&](int i, int j, glm::vec3 color) {
+				size_t index = 3 * ((j - region.y) * tile_size + (i - region.x));
+				for (int c = 0; c < 3; c++) pixels[index + c] = glm::clamp((int)(float)(255 * color[c]), 0, 255);
+			});
+
+			bool stored = pwrite(file, pixels.data(), tile_bytes, tileOffset(tile)) == (ssize_t)tile_bytes;
+			pixels = vector<unsigned char>();
+
+			{
+				lock_guard<mutex> guard(lock);
+				written = written && stored;
+				in_flight--;
+			}
+
+			available.notify_one();
+		});
+
+		return written;
+	}
+
+	/**
+	 * @brief Convert the tiled file to a plain (P3) PPM image, written as Image::writeImage writes it
+	 *
+	 * The tiles are read a row of tiles at a time, or a row of pixels at a
+	 * time if a row of tiles exceeds the memory budget.
+	 *
+	 * @param output The path of the PPM image
+	 * @return False if the tiled file could not be read or the image written
+	 */
+	bool writeImage(const char * output) {
+		int tile_size = header.tile_size;
+		int rows = (size_t)3 * header.tiles_x * tile_size * tile_size <= memory ? tile_size : 1;
+		vector<unsigned char> strip((size_t)3 * header.tiles_x * tile_size * rows);
+
+		ofstream image;
+		image.open(output);
+		image << "P3" << endl;
+		image << header.width << " " << header.height << endl;
+		image << 255 << endl;
+
+		for (int y = 0; y < header.height; y += rows) {
+			int ty = y / tile_size;
+
+			// Strip of rows y to y + rows of every tile of the row of tiles, tile after tile
+			for (int tx = 0; tx < header.tiles_x; tx++) {
+				size_t bytes = (size_t)3 * tile_size * rows;
+				off_t offset = tileOffset(ty * header.tiles_x + tx) + (off_t)3 * tile_size * (y % tile_size);
+
+				if (pread(file, &strip[tx * bytes], bytes, offset) != (ssize_t)bytes) return false;
+			}
+
+			for (int dy = 0; dy < rows && y + dy < header.height; dy++) {
+				for (int x = 0; x < header.width; x++) {
+					const unsigned char * pixel = &strip[(size_t)3 * tile_size * rows * (x / tile_size) + 3 * (dy * tile_size + x % tile_size)];
+					image << (int)pixel[0] << " " << (int)pixel[1] << " " << (int)pixel[2] << "  ";
+				}
+
+				image << endl;
+			}
+		}
+
+		image.close();
+		return image.good();
+	}
+
+	/**
+	 * @brief Remove the tiled file, once it is converted
+	 */
+	void remove() {
+		std::remove(path.c_str());
+	}
+
+private:
+	int file = -1; ///< Descriptor of the tiled file, -1 if it could not be created
+
+	/**
+	 * @brief Get the offset of a tile in the file
+	 */
+	off_t tileOffset(int tile) const {
+		return sizeof(header) + (off_t)tile * 3 * header.tile_size * header.tile_size;
+	}
+};
+
+#endif /* StreamingImage_h */
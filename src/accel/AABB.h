@@ -0,0 +1,104 @@
+#include <cmath>
+#include "../../lib/glm.hpp"
+#include "../primitives/Ray.h"
+
+#ifndef AABB_h
+#define AABB_h
+
+/**
+ * @brief AABB structure
+ *
+ * This structure represents an axis aligned bounding box in global coordinates.
+ * A default constructed box is empty and grows as points or boxes are added.
+ */
+struct AABB {
+	glm::vec3 min = glm::vec3(INFINITY); ///< Lower corner of the box
+	glm::vec3 max = glm::vec3(-INFINITY); ///< Upper corner of the box
+
+	/**
+	 * @brief Construct an empty AABB
+	 */
+	AABB() {}
+
+	/**
+	 * @brief Construct a new AABB from its corners
+	 *
+	 * @param min The lower corner of the box
+	 * @param max The upper corner of the box
+	 */
+	AABB(glm::vec3 min, glm::vec3 max): min(min), max(max) {}
+
+	/**
+	 * @brief Grow the box so that it contains a point
+	 *
+	 * @param point The point to include
+	 */
+	void expand(glm::vec3 point) {
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	/**
+	 * @brief Grow the box so that it contains another box
+	 *
+	 * @param box The box to include
+	 */
+	void expand(const AABB &box) {
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	/**
+	 * @brief Check whether the box is finite, i.e. it belongs to a bounded object
+	 *
+	 * @return True if all the coordinates of the box are finite
+	 */
+	bool isFinite() const {
+		return glm::all(glm::lessThan(glm::abs(min), glm::vec3(INFINITY))) && glm::all(glm::lessThan(glm::abs(max), glm::vec3(INFINITY)));
+	}
+
+	/**
+	 * @brief Get the centroid of the box
+	 *
+	 * @return The center point of the box
+	 */
+	glm::vec3 centroid() const {
+		return 0.5f * (min + max);
+	}
+
+	/**
+	 * @brief Get the surface area of the box, used by the SAH cost model
+	 *
+	 * @return The surface area, 0 for empty boxes
+	 */
+	float surfaceArea() const {
+		glm::vec3 extent = max - min;
+		if (extent.x < 0 || extent.y < 0 || extent.z < 0) return 0.0;
+
+		return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+
+	/**
+	 * @brief Slab test of a ray against the box
+	 *
+	 * @param origin The origin of the ray to test
+	 * @param inv_direction The component-wise inverse of the ray direction
+	 * @param t_max The maximum distance along the ray that is of interest
+	 * @param t_near Set to the entry distance of the ray into the box
+	 * @return True if the ray enters the box before t_max
+	 */
+	bool intersect(glm::vec3 origin, glm::vec3 inv_direction, float t_max, float &t_near) const {
+		glm::vec3 t0 = (min - origin) * inv_direction;
+		glm::vec3 t1 = (max - origin) * inv_direction;
+
+		glm::vec3 t_small = glm::min(t0, t1);
+		glm::vec3 t_big = glm::max(t0, t1);
+
+		t_near = glm::max(glm::max(t_small.x, t_small.y), glm::max(t_small.z, 0.0f));
+		float t_far = glm::min(glm::min(t_big.x, t_big.y), glm::min(t_big.z, t_max));
+
+		return t_near <= t_far;
+	}
+};
+
+#endif /* AABB_h */
@@ -0,0 +1,381 @@
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include "AABB.h"
+#include "BVHNode.h"
+#include "Parallel.h"
+#include "SAHBuilder.h"
+#include "LBVHBuilder.h"
+#include "SBVHBuilder.h"
+#include "WideBVH.h"
+#include "QuantizedBVH.h"
+#include "../primitives/Ray.h"
+#include "../primitives/Object.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifndef BVH_h
+#define BVH_h
+
+using namespace std;
+
+#define BVH_MAX_LEAF 4 ///< Maximum number of primitives in a leaf
+
+/**
+ * @brief Algorithms available for building the BVH
+ */
+enum BVHBuilder {
+	BUILDER_SAH, ///< Sequential top-down binned SAH, best trace quality
+	BUILDER_LBVH, ///< Parallel linear BVH from sorted Morton codes, fastest build
+	BUILDER_HLBVH, ///< LBVH with the top levels rebuilt with the binned SAH
+	BUILDER_SBVH ///< Binned SAH with spatial splits, slowest build and best trace quality
+};
+
+/**
+ * @brief Get the name of a builder
+ *
+ * @param builder The builder
+ * @return The name used on the command line
+ */
+inline const char * builderName(BVHBuilder builder) {
+	switch (builder) {
+		case BUILDER_LBVH:
+			return "lbvh";
+		case BUILDER_HLBVH:
+			return "hlbvh";
+		case BUILDER_SBVH:
+			return "sbvh";
+		default:
+			return "sah";
+	}
+}
+
+/**
+ * @brief Parse the name of a builder
+ *
+ * @param name The name used on the command line
+ * @param builder Set to the parsed builder
+ * @return True if the name is known
+ */
+inline bool parseBuilder(const char * name, BVHBuilder &builder) {
+	for (BVHBuilder candidate : {BUILDER_SAH, BUILDER_LBVH, BUILDER_HLBVH, BUILDER_SBVH}) {
+		if (!strcmp(name, builderName(candidate))) {
+			builder = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief BVHBuildStats structure
+ *
+ * This structure collects the metrics of the last build of a BVH.
+ */
+struct BVHBuildStats {
+	BVHBuilder builder = BUILDER_SAH; ///< Builder that was used
+	int primitives = 0; ///< Number of bounded primitives in the hierarchy
+	int references = 0; ///< Number of primitive references in the leaves, more than primitives with spatial splits
+	int nodes = 0; ///< Number of nodes in the hierarchy
+	int width = 2; ///< Branching factor of the traversed hierarchy
+	int precision = 32; ///< Bits per child box coordinate of the traversed hierarchy
+	size_t bytes = 0; ///< Memory used by the nodes of the traversed hierarchy
+	size_t full_bytes = 0; ///< Memory the nodes would use with full precision boxes
+	double seconds = 0.0; ///< Wall clock time of the build
+
+	/**
+	 * @brief Get the build throughput
+	 *
+	 * @return Millions of primitives built per second
+	 */
+	double throughput() const {
+		return seconds > 0 ? primitives / seconds / 1e6 : 0.0;
+	}
+};
+
+/**
+ * @brief Test a ray against the two children of a binary node
+ *
+ * With SSE every box takes one register per corner, then the slabs of both
+ * boxes are reduced together. The reductions keep the operand order of
+ * AABB::intersect, glm::max(a, b) being _mm_max_ps(b, a), so the results are
+ * the same as two calls to it.
+ *
+ * @param left The bounding box of the left child
+ * @param right The bounding box of the right child
+ * @param ray The ray to test
+ * @param t_max The maximum distance along the ray
+ * @param t_near Set to the entry distance of the ray into both children
+ * @return The mask of the children hit by the ray, bit 0 for the left one
+ */
+inline int intersectChildren2(const AABB &left, const AABB &right, const WideRay &ray, float t_max, float t_near[2]) {
+#if defined(__SSE2__)
+	static_assert(sizeof(AABB) == 6 * sizeof(float), "The corners of a box are loaded as consecutive floats");
+
+	__m128 origin = _mm_loadu_ps(ray.origin);
+	__m128 inv_direction = _mm_loadu_ps(ray.inv_direction);
+	__m128 small[2], big[2];
+	const AABB * boxes[2] = {&left, &right};
+
+	for (int i = 0; i < 2; i++) {
+		// The upper corner is loaded with the last coordinate of the lower one, then shifted
+		__m128 low = _mm_loadu_ps(&boxes[i]->min.x);
+		__m128 high = _mm_loadu_ps(&boxes[i]->min.z);
+		high = _mm_shuffle_ps(high, high, _MM_SHUFFLE(3, 3, 2, 1));
+
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(low, origin), inv_direction);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(high, origin), inv_direction);
+
+		small[i] = _mm_min_ps(t1, t0);
+		big[i] = _mm_max_ps(t1, t0);
+	}
+
+	// Lanes 0 and 1 hold the left and right boxes
+	__m128 small_xy = _mm_unpacklo_ps(small[0], small[1]), small_z = _mm_unpackhi_ps(small[0], small[1]);
+	__m128 big_xy = _mm_unpacklo_ps(big[0], big[1]), big_z = _mm_unpackhi_ps(big[0], big[1]);
+
+	__m128 entry = _mm_max_ps(_mm_max_ps(_mm_setzero_ps(), small_z), _mm_max_ps(_mm_movehl_ps(small_xy, small_xy), small_xy));
+	__m128 exit = _mm_min_ps(_mm_min_ps(_mm_set1_ps(t_max), big_z), _mm_min_ps(_mm_movehl_ps(big_xy, big_xy), big_xy));
+
+	_mm_storel_pi((__m64 *)t_near, entry);
+	return _mm_movemask_ps(_mm_cmple_ps(entry, exit)) & 3;
+#else
+	glm::vec3 origin(ray.origin[0], ray.origin[1], ray.origin[2]);
+	glm::vec3 inv_direction(ray.inv_direction[0], ray.inv_direction[1], ray.inv_direction[2]);
+
+	return left.intersect(origin, inv_direction, t_max, t_near[0]) | right.intersect(origin, inv_direction, t_max, t_near[1]) << 1;
+#endif
+}
+
+/**
+ * @brief BVH class
+ *
+ * This class represents a bounding volume hierarchy over the objects of a scene.
+ * Objects without finite bounds (e.g. planes) are kept in a separate list
+ * that is tested by every ray.
+ */
+class BVH {
+public:
+	vector<BVHNode> nodes; ///< Nodes of the hierarchy
+	vector<int> indices; ///< Object indices referenced by the leaves
+	vector<int> unbounded; ///< Indices of the objects that are not in the hierarchy
+	int root = -1; ///< Index of the root node, -1 if the hierarchy is empty
+	int width = 2; ///< Branching factor used for traversal: 2, 4 or 8
+	WideBVH<4> bvh4; ///< Collapsed 4-ary hierarchy, used when width is 4
+	WideBVH<8> bvh8; ///< Collapsed 8-ary hierarchy, used when width is 8
+	int precision = 32; ///< Bits per child box coordinate used for traversal: 8, 16 or 32
+	QuantizedBVH<uint8_t, 4> qbvh4_8; ///< Compressed 4-ary hierarchy with 8 bit boxes
+	QuantizedBVH<uint8_t, 8> qbvh8_8; ///< Compressed 8-ary hierarchy with 8 bit boxes
+	QuantizedBVH<uint16_t, 4> qbvh4_16; ///< Compressed 4-ary hierarchy with 16 bit boxes
+	QuantizedBVH<uint16_t, 8> qbvh8_16; ///< Compressed 8-ary hierarchy with 16 bit boxes
+	BVHBuildStats stats; ///< Metrics of the last build
+
+	/**
+	 * @brief Build the hierarchy over a list of objects
+	 *
+	 * @param objects The objects of the scene
+	 * @param builder The algorithm used to build the hierarchy
+	 * @param width The branching factor of the hierarchy used for traversal: 2, 4 or 8
+	 * @param precision The bits per child box coordinate: 32 for floats, 8 or 16 for
+	 * compressed nodes, which are always at least 4-ary
+	 * @param split_budget The fraction of duplicated references allowed by the SBVH builder
+	 */
+	void build(const vector<Object *> &objects, BVHBuilder builder=BUILDER_SAH, int width=2, int precision=32, float split_budget=0.3) {
+		auto start = chrono::steady_clock::now();
+
+		nodes.clear();
+		indices.clear();
+		unbounded.clear();
+		root = -1;
+
+		vector<int> bounded;
+		vector<AABB> bounds;
+		vector<glm::vec3> centroids;
+
+		for (int k = 0; k < (int)objects.size(); k++) {
+			AABB box = objects[k]->getBounds();
+
+			if (box.isFinite()) {
+				bounded.push_back(k);
+				bounds.push_back(box);
+				centroids.push_back(box.centroid());
+			} else {
+				unbounded.push_back(k);
+			}
+		}
+
+		if (!bounded.empty()) {
+			nodes.reserve(2 * bounded.size());
+
+			if (builder == BUILDER_SAH) {
+				indices.resize(bounded.size());
+				for (int i = 0; i < (int)indices.size(); i++) indices[i] = i;
+
+				root = buildBinnedSAH(nodes, indices, 0, indices.size(), bounds, centroids, BVH_MAX_LEAF, [&](int begin, int end, AABB box) {
+					BVHNode leaf;
+					leaf.bounds = box;
+					leaf.left = begin;
+					leaf.count = end - begin;
+
+					nodes.push_back(leaf);
+					return (int)nodes.size() - 1;
+				});
+			} else if (builder == BUILDER_SBVH) {
+				vector<Object *> primitives;
+				for (int k : bounded) primitives.push_back(objects[k]);
+
+				SBVHBuilder sbvh(primitives, split_budget);
+				root = sbvh.build(nodes, indices, bounds, BVH_MAX_LEAF);
+			} else {
+				root = buildLBVH(nodes, indices, bounds, centroids, BVH_MAX_LEAF, builder == BUILDER_HLBVH);
+			}
+
+			limitDepth(nodes, root);
+			for (int &index : indices) index = bounded[index];
+		}
+
+		if (precision != 32 && width == 2) width = 4;
+
+		this->width = width;
+		this->precision = precision;
+		bvh4.nodes.clear();
+		bvh8.nodes.clear();
+		qbvh4_8.nodes.clear();
+		qbvh8_8.nodes.clear();
+		qbvh4_16.nodes.clear();
+		qbvh8_16.nodes.clear();
+
+		stats.builder = builder;
+		stats.primitives = bounded.size();
+		stats.references = indices.size();
+		stats.width = width;
+		stats.precision = precision;
+
+		if (width == 4) {
+			bvh4.build(nodes, root);
+			stats.nodes = bvh4.nodes.size();
+			stats.full_bytes = bvh4.nodes.size() * sizeof(WideBVHNode<4>);
+
+			if (precision == 8) qbvh4_8.build(bvh4);
+			if (precision == 16) qbvh4_16.build(bvh4);
+			stats.bytes = precision == 8 ? stats.nodes * sizeof(QuantizedBVHNode<uint8_t, 4>) : precision == 16 ? stats.nodes * sizeof(QuantizedBVHNode<uint16_t, 4>) : stats.full_bytes;
+			if (precision != 32) bvh4.nodes = vector<WideBVHNode<4>>();
+		} else if (width == 8) {
+			bvh8.build(nodes, root);
+			stats.nodes = bvh8.nodes.size();
+			stats.full_bytes = bvh8.nodes.size() * sizeof(WideBVHNode<8>);
+
+			if (precision == 8) qbvh8_8.build(bvh8);
+			if (precision == 16) qbvh8_16.build(bvh8);
+			stats.bytes = precision == 8 ? stats.nodes * sizeof(QuantizedBVHNode<uint8_t, 8>) : precision == 16 ? stats.nodes * sizeof(QuantizedBVHNode<uint16_t, 8>) : stats.full_bytes;
+			if (precision != 32) bvh8.nodes = vector<WideBVHNode<8>>();
+		} else {
+			stats.nodes = nodes.size();
+			stats.bytes = nodes.size() * sizeof(BVHNode);
+			stats.full_bytes = stats.bytes;
+		}
+
+		// Only the collapsed hierarchy is traversed, the binary one is released
+		if (width != 2) nodes = vector<BVHNode>();
+
+		stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+
+	/**
+	 * @brief Visit the objects whose bounds are crossed by a ray
+	 *
+	 * Unbounded objects are visited first, then the leaves of the hierarchy
+	 * from near to far. The visit stops as soon as the function returns true.
+	 *
+	 * @param ray The ray to test
+	 * @param t_max The maximum distance along the ray, may be shrunk by the function
+	 * @param function Called as function(object_index) for every candidate
+	 */
+	template <typename Function>
+	void traverse(const Ray &ray, float &t_max, Function function) const {
+		for (int k : unbounded) {
+			if (function(k)) return;
+		}
+
+		if (root < 0) return;
+
+		if (width == 4) {
+			if (precision == 8) qbvh4_8.traverse(ray, t_max, indices, function);
+			else if (precision == 16) qbvh4_16.traverse(ray, t_max, indices, function);
+			else bvh4.traverse(ray, t_max, indices, function);
+			return;
+		}
+
+		if (width == 8) {
+			if (precision == 8) qbvh8_8.traverse(ray, t_max, indices, function);
+			else if (precision == 16) qbvh8_16.traverse(ray, t_max, indices, function);
+			else bvh8.traverse(ray, t_max, indices, function);
+			return;
+		}
+
+		WideRay wide_ray(ray);
+		int stack[BVH_STACK_SIZE];
+		int size = 0;
+		float t_near[2];
+
+		if (!nodes[root].bounds.intersect(ray.origin, 1.0f / ray.direction, t_max, t_near[0])) return;
+		stack[size++] = root;
+
+		while (size > 0) {
+			const BVHNode &node = nodes[stack[--size]];
+
+			if (node.isLeaf()) {
+				for (int i = node.left; i < node.left + node.count; i++) {
+					if (function(indices[i])) return;
+				}
+				continue;
+			}
+
+			int mask = intersectChildren2(nodes[node.left].bounds, nodes[node.right].bounds, wide_ray, t_max, t_near);
+
+			// Push the far child first so that the near one is popped next
+			if (mask == 3) {
+				stack[size++] = t_near[0] < t_near[1] ? node.right : node.left;
+				stack[size++] = t_near[0] < t_near[1] ? node.left : node.right;
+			} else if (mask == 1) {
+				stack[size++] = node.left;
+			} else if (mask == 2) {
+				stack[size++] = node.right;
+			}
+		}
+	}
+
+	/**
+	 * @brief Find the closest intersection of a ray with the objects
+	 *
+	 * @param ray The ray to trace
+	 * @param objects The objects the hierarchy was built over
+	 * @return The closest hit, with hit set to false if nothing was hit
+	 */
+	Hit intersect(const Ray &ray, const vector<Object *> &objects) const {
+		Hit closest_hit;
+
+		closest_hit.hit = false;
+		closest_hit.distance = INFINITY;
+
+		float t_max = INFINITY;
+
+		traverse(ray, t_max, [&](int k) {
+			Hit hit = objects[k]->intersect(ray);
+
+			if (hit.hit == true && hit.distance < closest_hit.distance) {
+				closest_hit = hit;
+				t_max = hit.distance;
+			}
+
+			return false;
+		});
+
+		return closest_hit;
+	}
+};
+
+#endif /* BVH_h */
@@ -0,0 +1,164 @@
+#include <vector>
+#include <algorithm>
+#include "AABB.h"
+
+#ifndef BVHNode_h
+#define BVHNode_h
+
+using namespace std;
+
+#define BVH_STACK_SIZE 128 ///< Size of the traversal stack, per child of a node for the wide hierarchies
+#define BVH_MAX_DEPTH 64 ///< Maximum depth of a leaf, which keeps the traversal stacks from overflowing
+
+static_assert(BVH_MAX_DEPTH < BVH_STACK_SIZE, "A traversal stack holds at most one node per level and the root");
+
+/**
+ * @brief BVHNode structure
+ *
+ * This structure represents a node of a binary bounding volume hierarchy.
+ * Interior nodes reference their two children, leaves reference a range of
+ * the primitive index array of the hierarchy.
+ */
+struct BVHNode {
+	AABB bounds; ///< Bounding box of everything below the node
+	int left = -1; ///< Index of the left child, or of the first primitive for leaves
+	int right = -1; ///< Index of the right child
+	int count = 0; ///< Number of primitives in the leaf, 0 for interior nodes
+
+	/**
+	 * @brief Check whether the node is a leaf
+	 *
+	 * @return True if the node references primitives
+	 */
+	bool isLeaf() const {
+		return count > 0;
+	}
+};
+
+/**
+ * @brief Create an interior node over two existing nodes
+ *
+ * @param nodes The node array of the hierarchy
+ * @param left The index of the left child
+ * @param right The index of the right child
+ * @return The index of the new node
+ */
+inline int makeInteriorNode(vector<BVHNode> &nodes, int left, int right) {
+	BVHNode node;
+	node.left = left;
+	node.right = right;
+	node.bounds = nodes[left].bounds;
+	node.bounds.expand(nodes[right].bounds);
+
+	nodes.push_back(node);
+	return nodes.size() - 1;
+}
+
+/**
+ * @brief Link a balanced tree over a list of nodes, reusing existing interior nodes
+ *
+ * @param nodes The node array of the hierarchy
+ * @param leaves The nodes to link, in order
+ * @param begin The first position of the range in leaves
+ * @param end One past the last position of the range in leaves
+ * @param slots The interior nodes to reuse, one less than the leaves
+ * @param used The number of slots already used, incremented
+ * @return The index of the root of the range
+ */
+inline int linkBalanced(vector<BVHNode> &nodes, const vector<int> &leaves, int begin, int end, const vector<int> &slots, int &used) {
+	if (end - begin == 1) return leaves[begin];
+
+	int slot = slots[used++];
+	int middle = begin + (end - begin) / 2;
+	int left = linkBalanced(nodes, leaves, begin, middle, slots, used);
+	int right = linkBalanced(nodes, leaves, middle, end, slots, used);
+
+	nodes[slot].left = left;
+	nodes[slot].right = right;
+	nodes[slot].bounds = nodes[left].bounds;
+	nodes[slot].bounds.expand(nodes[right].bounds);
+
+	return slot;
+}
+
+/**
+ * @brief Rebalance the subtrees of a hierarchy whose leaves are deeper than BVH_MAX_DEPTH
+ *
+ * The builders only go that deep on degenerate inputs, e.g. a binned SAH
+ * split peeling off one primitive per level. The highest subtrees that
+ * cannot keep their shape are relinked as balanced trees over their leaves,
+ * in the same order and reusing their interior nodes, so the leaves and the
+ * primitive indices are unchanged.
+ *
+ * @param nodes The node array of the hierarchy
+ * @param root The index of the root node
+ */
+inline void limitDepth(vector<BVHNode> &nodes, int root) {
+	if (root < 0) return;
+
+	// Breadth first order, parents before children
+	vector<int> order(1, root), depth(nodes.size(), 0), height(nodes.size(), 0), leaves(nodes.size(), 1);
+
+	for (size_t k = 0; k < order.size(); k++) {
+		const BVHNode &node = nodes[order[k]];
+		if (node.isLeaf()) continue;
+
+		depth[node.left] = depth[node.right] = depth[order[k]] + 1;
+		order.push_back(node.left);
+		order.push_back(node.right);
+	}
+
+	if (order.size() <= 1) return;
+
+	for (size_t k = order.size(); k-- > 0;) {
+		const BVHNode &node = nodes[order[k]];
+		if (node.isLeaf()) continue;
+
+		height[order[k]] = max(height[node.left], height[node.right]) + 1;
+		leaves[order[k]] = leaves[node.left] + leaves[node.right];
+	}
+
+	// A balanced tree over n leaves has a height of ceil(log2(n))
+	auto balancedHeight = [](int count) {
+		int bits = 0;
+		while ((1 << bits) < count) bits++;
+		return bits;
+	};
+
+	vector<int> pending(1, root);
+
+	while (!pending.empty()) {
+		int index = pending.back();
+		pending.pop_back();
+
+		const BVHNode node = nodes[index];
+		if (node.isLeaf() || depth[index] + height[index] <= BVH_MAX_DEPTH) continue;
+
+		// Descend while both children can still be balanced within the limit
+		if (depth[index] + 1 + max(balancedHeight(leaves[node.left]), balancedHeight(leaves[node.right])) <= BVH_MAX_DEPTH) {
+			pending.push_back(node.left);
+			pending.push_back(node.right);
+			continue;
+		}
+
+		vector<int> subtree(1, index), slots, leaf_nodes;
+
+		while (!subtree.empty()) {
+			int current = subtree.back();
+			subtree.pop_back();
+
+			if (nodes[current].isLeaf()) {
+				leaf_nodes.push_back(current);
+			} else {
+				slots.push_back(current);
+				subtree.push_back(nodes[current].right);
+				subtree.push_back(nodes[current].left);
+			}
+		}
+
+		int used = 0;
+		linkBalanced(nodes, leaf_nodes, 0, leaf_nodes.size(), slots, used);
+	}
+}
+
+#endif /* BVHNode_h */
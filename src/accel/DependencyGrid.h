@@ -0,0 +1,220 @@
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "AABB.h"
+#include "../../lib/glm.hpp"
+#include "../primitives/Ray.h"
+
+#ifndef DependencyGrid_h
+#define DependencyGrid_h
+
+using namespace std;
+
+class Object;
+
+#define DEPENDENCY_GRID_RESOLUTION 16 ///< Number of cells of the dependency grid along every axis
+
+/**
+ * @brief DependencyGrid class
+ *
+ * This class divides a box around a scene into a coarse uniform grid. The
+ * region of space a set of rays depends on is recorded as the set of cells
+ * their segments cross, which is compared with the cells of the bounds of
+ * edited objects.
+ */
+class DependencyGrid {
+public:
+	AABB bounds; ///< Box divided by the grid
+	glm::vec3 cell_size = glm::vec3(0.0); ///< Size of a cell
+
+	/**
+	 * @brief Set the box divided by the grid
+	 *
+	 * @param box The box, grown slightly so that objects on its faces are inside
+	 */
+	void build(AABB box) {
+		glm::vec3 margin = 0.05f * (box.max - box.min) + 1e-3f;
+		bounds = AABB(box.min - margin, box.max + margin);
+		cell_size = (bounds.max - bounds.min) / (float)DEPENDENCY_GRID_RESOLUTION;
+	}
+
+	/**
+	 * @brief Get the number of cells of the grid
+	 */
+	static int cells() {
+		return DEPENDENCY_GRID_RESOLUTION * DEPENDENCY_GRID_RESOLUTION * DEPENDENCY_GRID_RESOLUTION;
+	}
+
+	/**
+	 * @brief Check whether a box is inside the grid, so that its cells cover it
+	 */
+	bool contains(const AABB &box) const {
+		return box.isFinite() && glm::all(glm::greaterThanEqual(box.min, bounds.min)) && glm::all(glm::lessThanEqual(box.max, bounds.max));
+	}
+
+	/**
+	 * @brief Call function(cell) for every cell overlapped by a box inside the grid
+	 *
+	 * The box is padded by a small fraction of a cell, so that rounding in
+	 * the walk of the segments cannot miss a cell it touches.
+	 */
+	template <typename Function>
+	void boxCells(const AABB &box, Function function) const {
+		glm::vec3 padding = 0.01f * cell_size;
+		glm::ivec3 first = cellOf(box.min - padding), last = cellOf(box.max + padding);
+
+		for (int z = first.z; z <= last.z; z++) {
+			for (int y = first.y; y <= last.y; y++) {
+				for (int x = first.x; x <= last.x; x++) function(index(glm::ivec3(x, y, z)));
+			}
+		}
+	}
+
+	/**
+	 * @brief Call function(cell) for every cell crossed by a segment, walking the grid from cell to cell
+	 *
+	 * @param ray The ray carrying the segment
+	 * @param t_max The length of the segment, may be infinite
+	 */
+	template <typename Function>
+	void segmentCells(const Ray &ray, float t_max, Function function) const {
+		// Clip the segment to the grid with the slab test
+		float t_enter = 0.0f, t_exit = t_max;
+
+		for (int axis = 0; axis < 3; axis++) {
+			float inverse = 1.0f / ray.direction[axis];
+			float t0 = (bounds.min[axis] - ray.origin[axis]) * inverse;
+			float t1 = (bounds.max[axis] - ray.origin[axis]) * inverse;
+
+			if (t0 > t1) swap(t0, t1);
+
+			// Rays starting on a slab and parallel to it give NaN, which does not clip
+			if (!isnan(t0)) t_enter = max(t_enter, t0);
+			if (!isnan(t1)) t_exit = min(t_exit, t1);
+		}
+
+		if (t_enter > t_exit) return;
+
+		glm::vec3 start = ray.origin + t_enter * ray.direction;
+		glm::ivec3 cell = cellOf(start);
+		glm::ivec3 step, last = cellOf(ray.origin + t_exit * ray.direction);
+		glm::vec3 t_next, t_delta;
+
+		for (int axis = 0; axis < 3; axis++) {
+			float direction = ray.direction[axis];
+			step[axis] = direction > 0.0f ? 1 : (direction < 0.0f ? -1 : 0);
+
+			float boundary = bounds.min[axis] + (cell[axis] + (step[axis] > 0 ? 1 : 0)) * cell_size[axis];
+			t_next[axis] = step[axis] != 0 ? t_enter + (boundary - start[axis]) / direction : INFINITY;
+			t_delta[axis] = step[axis] != 0 ? cell_size[axis] / fabsf(direction) : INFINITY;
+		}
+
+		// Bounded by the number of cells on a line through the grid
+		for (int visited = 0; visited < 3 * DEPENDENCY_GRID_RESOLUTION; visited++) {
+			function(index(cell));
+			if (cell == last) return;
+
+			int axis = t_next.x < t_next.y ? (t_next.x < t_next.z ? 0 : 2) : (t_next.y < t_next.z ? 1 : 2);
+			if (t_next[axis] > t_exit) return;
+
+			cell[axis] += step[axis];
+			if (cell[axis] < 0 || cell[axis] >= DEPENDENCY_GRID_RESOLUTION) return;
+			t_next[axis] += t_delta[axis];
+		}
+	}
+
+private:
+	/**
+	 * @brief Get the cell containing a point, clamped to the grid
+	 */
+	glm::ivec3 cellOf(glm::vec3 point) const {
+		return glm::clamp(glm::ivec3(glm::floor((point - bounds.min) / cell_size)), glm::ivec3(0), glm::ivec3(DEPENDENCY_GRID_RESOLUTION - 1));
+	}
+
+	/**
+	 * @brief Get the index of a cell
+	 */
+	static int index(glm::ivec3 cell) {
+		return (cell.z * DEPENDENCY_GRID_RESOLUTION + cell.y) * DEPENDENCY_GRID_RESOLUTION + cell.x;
+	}
+};
+
+/**
+ * @brief TileDependencies structure
+ *
+ * This structure records what the pixels of a tile depend on: the cells of
+ * the dependency grid crossed by their rays and the objects those rays hit.
+ */
+struct TileDependencies {
+	vector<uint64_t> cells = vector<uint64_t>((DependencyGrid::cells() + 63) / 64); ///< Bit set of the crossed cells
+	vector<const Object *> objects; ///< Objects hit by a primary, secondary or shadow ray, sorted once the tile is done
+
+	/**
+	 * @brief Forget the recorded dependencies
+	 */
+	void clear() {
+		fill(cells.begin(), cells.end(), 0);
+		objects.clear();
+	}
+
+	/**
+	 * @brief Sort the objects and remove the duplicates
+	 */
+	void finish() {
+		sort(objects.begin(), objects.end());
+		objects.erase(unique(objects.begin(), objects.end()), objects.end());
+	}
+
+	/**
+	 * @brief Check whether a cell was crossed
+	 */
+	bool crosses(int cell) const {
+		return cells[cell / 64] >> (cell % 64) & 1;
+	}
+
+	/**
+	 * @brief Check whether an object was hit
+	 */
+	bool hits(const Object * object) const {
+		return binary_search(objects.begin(), objects.end(), object);
+	}
+};
+
+/**
+ * @brief DependencyRecorder structure
+ *
+ * This structure is installed on a thread while it renders a tile, see
+ * dependencyRecorder, and receives the rays traced by the shading code.
+ */
+struct DependencyRecorder {
+	const DependencyGrid * grid = NULL; ///< The grid the cells refer to
+	TileDependencies * tile = NULL; ///< The dependencies being recorded
+
+	/**
+	 * @brief Record a ray segment and the object it hit
+	 *
+	 * @param ray The ray
+	 * @param t_max The length of the segment, infinite for rays leaving the scene
+	 * @param object The object hit at the end of the segment, or NULL
+	 */
+	void record(const Ray &ray, float t_max, const Object * object) {
+		grid->segmentCells(ray, t_max, [&](int cell) {
+			tile->cells[cell / 64] |= 1ULL << (cell % 64);
+		});
+
+		if (object) tile->objects.push_back(object);
+	}
+};
+
+/**
+ * @brief Get the recorder of the calling thread
+ *
+ * @return A reference to the recorder pointer, NULL when nothing is recorded
+ */
+inline DependencyRecorder *& dependencyRecorder() {
+	thread_local DependencyRecorder * recorder = NULL;
+	return recorder;
+}
+
+#endif /* DependencyGrid_h */
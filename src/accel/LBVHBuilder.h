@@ -0,0 +1,244 @@
+#include <vector>
+#include <cstdint>
+#include "AABB.h"
+#include "BVHNode.h"
+#include "Parallel.h"
+#include "SAHBuilder.h"
+
+#ifndef LBVHBuilder_h
+#define LBVHBuilder_h
+
+using namespace std;
+
+#define MORTON_BITS 30 ///< Number of bits of a Morton code, 10 per axis
+#define CLUSTER_BITS 12 ///< Number of leading Morton bits shared by the primitives of a cluster
+#define RADIX_BITS 10 ///< Number of bits sorted per radix sort pass
+
+/**
+ * @brief MortonPrimitive structure
+ *
+ * This structure pairs the Morton code of a primitive centroid with the
+ * index of the primitive.
+ */
+struct MortonPrimitive {
+	uint32_t code; ///< Morton code of the centroid
+	uint32_t index; ///< Index of the primitive
+};
+
+/**
+ * @brief Spread the lower 10 bits of a value so that there are two zeros between each bit
+ *
+ * @param value The value to expand
+ * @return The expanded value
+ */
+inline uint32_t expandBits(uint32_t value) {
+	value &= 0x3ff;
+	value = (value | (value << 16)) & 0x030000ff;
+	value = (value | (value << 8)) & 0x0300f00f;
+	value = (value | (value << 4)) & 0x030c30c3;
+	value = (value | (value << 2)) & 0x09249249;
+
+	return value;
+}
+
+/**
+ * @brief Compute the 30 bit Morton code of a point
+ *
+ * @param point The point, normalized to the unit cube
+ * @return The Morton code interleaving 10 bits per axis
+ */
+inline uint32_t mortonCode(glm::vec3 point) {
+	glm::vec3 scaled = glm::clamp(point * 1024.0f, glm::vec3(0.0), glm::vec3(1023.0));
+
+	return (expandBits(scaled.x) << 2) | (expandBits(scaled.y) << 1) | expandBits(scaled.z);
+}
+
+/**
+ * @brief Function that sorts Morton primitives by code with a parallel LSD radix sort
+ *
+ * Every pass builds one digit histogram per block of the input in parallel,
+ * turns them into per-block output offsets, and scatters the blocks in
+ * parallel. Scattering each block in order keeps the sort stable.
+ *
+ * @param primitives The primitives to sort
+ */
+inline void radixSort(vector<MortonPrimitive> &primitives) {
+	const int buckets = 1 << RADIX_BITS;
+	int count = primitives.size();
+	int blocks = min(workerCount(), max(1, count / 4096));
+
+	vector<MortonPrimitive> buffer(count);
+	vector<int> offsets(blocks * buckets);
+
+	for (int shift = 0; shift < MORTON_BITS; shift += RADIX_BITS) {
+		fill(offsets.begin(), offsets.end(), 0);
+
+		parallelBlocks(count, blocks, [&](int block, int first, int last) {
+			int *histogram = &offsets[block * buckets];
+			for (int i = first; i < last; i++) histogram[(primitives[i].code >> shift) & (buckets - 1)]++;
+		});
+
+		int sum = 0;
+		for (int digit = 0; digit < buckets; digit++) {
+			for (int block = 0; block < blocks; block++) {
+				int value = offsets[block * buckets + digit];
+				offsets[block * buckets + digit] = sum;
+				sum += value;
+			}
+		}
+
+		parallelBlocks(count, blocks, [&](int block, int first, int last) {
+			int *offset = &offsets[block * buckets];
+			for (int i = first; i < last; i++) buffer[offset[(primitives[i].code >> shift) & (buckets - 1)]++] = primitives[i];
+		});
+
+		primitives.swap(buffer);
+	}
+}
+
+/**
+ * @brief Function that emits a hierarchy from a range of sorted Morton codes
+ *
+ * Each node splits its range where the highest remaining bit of the codes
+ * flips. Ranges whose codes are all equal are split in the middle.
+ *
+ * @param nodes The node array the new nodes are appended to
+ * @param codes The sorted Morton codes
+ * @param begin The first position of the range
+ * @param end One past the last position of the range
+ * @param bit The highest bit that can still differ in the range
+ * @param stop_bit The lowest bit considered for splitting
+ * @param leaf_size The number of items at or below which a leaf is created
+ * @param make_leaf Called as make_leaf(begin, end) to create a leaf, returns its node index
+ * @return The index of the root node of the range
+ */
+template <typename CodeFunction, typename LeafFunction>
+int emitMortonTree(vector<BVHNode> &nodes, CodeFunction codes, int begin, int end, int bit, int stop_bit, int leaf_size, LeafFunction make_leaf) {
+	if (end - begin <= leaf_size) return make_leaf(begin, end);
+
+	int split = begin + (end - begin) / 2;
+
+	for (; bit >= stop_bit; bit--) {
+		uint32_t mask = 1u << bit;
+		if ((codes(begin) & mask) == (codes(end - 1) & mask)) continue;
+
+		// The range is sorted and shares all the higher bits, so find the first code with the bit set
+		int low = begin, high = end - 1;
+		while (low < high) {
+			int middle = (low + high) / 2;
+			if (codes(middle) & mask) high = middle;
+			else low = middle + 1;
+		}
+
+		split = low;
+		break;
+	}
+
+	int left = emitMortonTree(nodes, codes, begin, split, bit - 1, stop_bit, leaf_size, make_leaf);
+	int right = emitMortonTree(nodes, codes, split, end, bit - 1, stop_bit, leaf_size, make_leaf);
+
+	return makeInteriorNode(nodes, left, right);
+}
+
+/**
+ * @brief Function that builds a linear BVH (LBVH) from Morton codes
+ *
+ * The centroids are mapped to Morton codes and radix sorted in parallel.
+ * The sorted primitives are grouped into clusters sharing the top
+ * CLUSTER_BITS bits, the subtree of every cluster is emitted in parallel, and
+ * the top levels over the clusters are either emitted from the Morton bits as
+ * well or, for the hybrid HLBVH, rebuilt with the binned SAH.
+ *
+ * @param nodes The node array of the hierarchy
+ * @param indices Set to the primitive indices in leaf order
+ * @param bounds The bounding box of every primitive
+ * @param centroids The centroid of every primitive
+ * @param max_leaf The maximum number of primitives stored in a leaf
+ * @param sah_top Whether to build the levels above the clusters with the binned SAH
+ * @return The index of the root node
+ */
+inline int buildLBVH(vector<BVHNode> &nodes, vector<int> &indices, const vector<AABB> &bounds, const vector<glm::vec3> &centroids, int max_leaf, bool sah_top) {
+	int count = bounds.size();
+
+	AABB centroid_bounds;
+	for (const glm::vec3 &centroid : centroids) centroid_bounds.expand(centroid);
+	glm::vec3 extent = glm::max(centroid_bounds.max - centroid_bounds.min, glm::vec3(1e-6));
+
+	vector<MortonPrimitive> primitives(count);
+	parallelFor(0, count, [&](int i) {
+		primitives[i].code = mortonCode((centroids[i] - centroid_bounds.min) / extent);
+		primitives[i].index = i;
+	}, 4096);
+
+	radixSort(primitives);
+
+	indices.resize(count);
+	parallelFor(0, count, [&](int i) { indices[i] = primitives[i].index; }, 4096);
+
+	// Clusters are the runs of primitives sharing the top bits of their codes
+	int cluster_shift = MORTON_BITS - CLUSTER_BITS;
+	vector<int> cluster_start;
+	for (int i = 0; i < count; i++) {
+		if (i == 0 || (primitives[i].code >> cluster_shift) != (primitives[i - 1].code >> cluster_shift)) cluster_start.push_back(i);
+	}
+	cluster_start.push_back(count);
+
+	int clusters = cluster_start.size() - 1;
+	vector<vector<BVHNode>> cluster_nodes(clusters);
+	vector<int> cluster_root(clusters);
+
+	auto code = [&](int i) { return primitives[i].code; };
+
+	parallelFor(0, clusters, [&](int c) {
+		vector<BVHNode> &local = cluster_nodes[c];
+
+		cluster_root[c] = emitMortonTree(local, code, cluster_start[c], cluster_start[c + 1], cluster_shift - 1, 0, max_leaf, [&](int begin, int end) {
+			BVHNode leaf;
+			leaf.left = begin;
+			leaf.count = end - begin;
+			for (int i = begin; i < end; i++) leaf.bounds.expand(bounds[primitives[i].index]);
+
+			local.push_back(leaf);
+			return (int)local.size() - 1;
+		});
+	});
+
+	// Concatenate the cluster subtrees, relocating the child indices of interior nodes
+	int offset = nodes.size();
+	for (int c = 0; c < clusters; c++) {
+		for (BVHNode node : cluster_nodes[c]) {
+			if (!node.isLeaf()) {
+				node.left += offset;
+				node.right += offset;
+			}
+			nodes.push_back(node);
+		}
+
+		cluster_root[c] += offset;
+		offset += cluster_nodes[c].size();
+	}
+
+	if (sah_top) {
+		vector<int> items(clusters);
+		vector<AABB> cluster_bounds(clusters);
+		vector<glm::vec3> cluster_centroids(clusters);
+
+		for (int c = 0; c < clusters; c++) {
+			items[c] = c;
+			cluster_bounds[c] = nodes[cluster_root[c]].bounds;
+			cluster_centroids[c] = cluster_bounds[c].centroid();
+		}
+
+		return buildBinnedSAH(nodes, items, 0, clusters, cluster_bounds, cluster_centroids, 1, [&](int begin, int, AABB) {
+			return cluster_root[items[begin]];
+		});
+	}
+
+	auto cluster_code = [&](int c) { return primitives[cluster_start[c]].code; };
+
+	return emitMortonTree(nodes, cluster_code, 0, clusters, MORTON_BITS - 1, cluster_shift, 1, [&](int begin, int) {
+		return cluster_root[begin];
+	});
+}
+
+#endif /* LBVHBuilder_h */
@@ -0,0 +1,180 @@
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "AABB.h"
+#include "../../lib/glm.hpp"
+#include "../primitives/Light.h"
+
+#ifndef LightGrid_h
+#define LightGrid_h
+
+using namespace std;
+
+#define LIGHT_GRID_MAX_RESOLUTION 128 ///< Maximum number of cells along an axis
+#define LIGHT_GRID_MAX_REFERENCES (1 << 24) ///< Maximum number of light references stored in the cells
+
+/**
+ * @brief LightGrid class
+ *
+ * This class culls the lights that cannot contribute to a point. Every light
+ * gets a radius of influence from a contribution threshold, see
+ * Light::influenceRadius, and is referenced by the cells of a uniform grid
+ * that its sphere of influence overlaps. A shading point then only visits the
+ * lights of its cell. The cells are stored as one array of light indices with
+ * the offset of every cell, the indices of a cell being increasing.
+ */
+class LightGrid {
+public:
+	bool culling = false; ///< Whether lights are culled, otherwise every light is visited
+	vector<float> radii; ///< Radius of influence of every light
+	AABB bounds; ///< Box covering the spheres of influence of all the lights
+	glm::ivec3 resolution = glm::ivec3(0); ///< Number of cells along every axis
+	glm::vec3 cell_size = glm::vec3(0.0); ///< Size of a cell
+	vector<int> cell_start; ///< Offset of the lights of every cell in cell_lights, one more entry than cells
+	vector<int> cell_lights; ///< Indices of the lights referenced by the cells
+
+	/**
+	 * @brief Build the grid over a list of lights
+	 *
+	 * The cells are about as large as the average radius of influence, so a
+	 * light is referenced by a few cells along every axis.
+	 *
+	 * @param lights The lights of the scene
+	 * @param threshold The smallest contribution that matters, 0 to disable culling
+	 */
+	void build(const vector<Light *> &lights, float threshold) {
+		culling = threshold > 0.0f;
+		radii.clear();
+		cell_start.clear();
+		cell_lights.clear();
+		bounds = AABB();
+		resolution = glm::ivec3(0);
+
+		if (!culling) return;
+
+		float total_radius = 0.0;
+		int influential = 0;
+
+		for (Light * light : lights) {
+			float radius = light->influenceRadius(threshold);
+			radii.push_back(radius);
+
+			if (radius > 0.0f) {
+				bounds.expand(AABB(light->position - radius, light->position + radius));
+				total_radius += radius;
+				influential++;
+			}
+		}
+
+		if (influential == 0) return;
+
+		glm::vec3 extent = glm::max(bounds.max - bounds.min, glm::vec3(1e-6f));
+		float cell = total_radius / influential;
+
+		while (true) {
+			resolution = glm::clamp(glm::ivec3(glm::ceil(extent / cell)), glm::ivec3(1), glm::ivec3(LIGHT_GRID_MAX_RESOLUTION));
+			cell_size = extent / glm::vec3(resolution);
+
+			if (references(lights) <= LIGHT_GRID_MAX_REFERENCES || resolution == glm::ivec3(1)) break;
+			cell *= 2.0f;
+		}
+
+		// Count the lights of every cell, then fill them in increasing order
+		cell_start.assign(resolution.x * resolution.y * resolution.z + 1, 0);
+
+		forEachCell(lights, [&](int, int cell) {
+			cell_start[cell + 1]++;
+		});
+
+		for (size_t c = 1; c < cell_start.size(); c++) cell_start[c] += cell_start[c - 1];
+
+		cell_lights.resize(cell_start.back());
+		vector<int> filled(cell_start.begin(), cell_start.end() - 1);
+
+		forEachCell(lights, [&](int light, int cell) {
+			cell_lights[filled[cell]++] = light;
+		});
+	}
+
+	/**
+	 * @brief Visit the lights that can contribute to a point, in increasing index order
+	 *
+	 * @param lights The lights the grid was built over
+	 * @param point The shaded point
+	 * @param function Called as function(light) with the index of every light that matters
+	 */
+	template <typename Function>
+	void visit(const vector<Light *> &lights, glm::vec3 point, Function function) const {
+		if (!culling) {
+			for (int light = 0; light < (int)lights.size(); light++) function(light);
+			return;
+		}
+
+		if (cell_start.empty()) return;
+
+		glm::ivec3 cell = glm::ivec3(glm::floor((point - bounds.min) / cell_size));
+		if (glm::any(glm::lessThan(cell, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(cell, resolution))) return;
+
+		int index = (cell.z * resolution.y + cell.y) * resolution.x + cell.x;
+
+		for (int k = cell_start[index]; k < cell_start[index + 1]; k++) {
+			int light = cell_lights[k];
+			if (glm::distance(lights[light]->position, point) <= radii[light]) function(light);
+		}
+	}
+
+	/**
+	 * @brief Get the number of light references stored in the cells
+	 */
+	size_t size() const {
+		return cell_lights.size();
+	}
+
+private:
+	/**
+	 * @brief Get the range of cells overlapped by the sphere of influence of a light
+	 */
+	void cellRange(glm::vec3 position, float radius, glm::ivec3 &first, glm::ivec3 &last) const {
+		first = glm::clamp(glm::ivec3(glm::floor((position - radius - bounds.min) / cell_size)), glm::ivec3(0), resolution - 1);
+		last = glm::clamp(glm::ivec3(glm::floor((position + radius - bounds.min) / cell_size)), glm::ivec3(0), resolution - 1);
+	}
+
+	/**
+	 * @brief Count the references the current resolution would store
+	 */
+	size_t references(const vector<Light *> &lights) const {
+		size_t total = 0;
+
+		for (int light = 0; light < (int)lights.size(); light++) {
+			if (radii[light] <= 0.0f) continue;
+
+			glm::ivec3 first, last;
+			cellRange(lights[light]->position, radii[light], first, last);
+			glm::ivec3 cells = last - first + 1;
+			total += (size_t)cells.x * cells.y * cells.z;
+		}
+
+		return total;
+	}
+
+	/**
+	 * @brief Call function(light, cell) for every cell overlapped by every light, lights in increasing order
+	 */
+	template <typename Function>
+	void forEachCell(const vector<Light *> &lights, Function function) const {
+		for (int light = 0; light < (int)lights.size(); light++) {
+			if (radii[light] <= 0.0f) continue;
+
+			glm::ivec3 first, last;
+			cellRange(lights[light]->position, radii[light], first, last);
+
+			for (int z = first.z; z <= last.z; z++) {
+				for (int y = first.y; y <= last.y; y++) {
+					for (int x = first.x; x <= last.x; x++) function(light, (z * resolution.y + y) * resolution.x + x);
+				}
+			}
+		}
+	}
+};
+
+#endif /* LightGrid_h */
@@ -0,0 +1,167 @@
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "AABB.h"
+#include "../../lib/glm.hpp"
+#include "../math/Random.h"
+#include "../primitives/Light.h"
+
+#ifndef LightTree_h
+#define LightTree_h
+
+using namespace std;
+
+#define LIGHT_TREE_MAX_DEPTH 64 ///< Random numbers drawn per light sample, at least the depth of the tree
+
+/**
+ * @brief LightTreeNode structure
+ *
+ * This structure represents a node of the light tree, bounding the positions
+ * and the total power of the lights below it.
+ */
+struct LightTreeNode {
+	AABB bounds; ///< Bounding box of the positions of the lights
+	float power = 0.0; ///< Sum of the brightest channels of the lights
+	int left = -1; ///< Index of the left child, -1 for leaves
+	int right = -1; ///< Index of the right child, -1 for leaves
+	int light = -1; ///< Index of the light of a leaf, -1 for interior nodes
+};
+
+/**
+ * @brief LightTree class
+ *
+ * This class picks lights at random in proportion to an estimate of their
+ * contribution to a shading point, so that a few shadow rays per point
+ * replace one per light. A light is reached by walking down the tree, each
+ * child being chosen with a probability proportional to its importance,
+ * and the probability of the light is the product of the choices. Dividing
+ * the contribution of a sampled light by that probability keeps the
+ * estimate unbiased: every light that can light the point has a non-zero
+ * probability.
+ */
+class LightTree {
+public:
+	vector<LightTreeNode> nodes; ///< Nodes of the tree, the root first
+	int depth = 0; ///< Number of levels of the tree
+
+	/**
+	 * @brief Build the tree by splitting the lights at the median of the longest axis
+	 *
+	 * @param lights The lights of the scene
+	 */
+	void build(const vector<Light *> &lights) {
+		nodes.clear();
+		depth = 0;
+
+		vector<int> order;
+		for (int k = 0; k < (int)lights.size(); k++) order.push_back(k);
+
+		if (!order.empty()) split(lights, order, 0, order.size(), 1);
+	}
+
+	/**
+	 * @brief Estimate how much the lights below a node can contribute to a point
+	 *
+	 * The power is attenuated by the distance to the center of the node,
+	 * which is taken no smaller than half the diagonal of the node so that
+	 * near lights are not overestimated. Nodes entirely below the tangent
+	 * plane of the point cannot light it.
+	 *
+	 * @param node The node
+	 * @param point The shaded point
+	 * @param normal The normal at the point
+	 * @return The importance of the node, 0 if it cannot light the point
+	 */
+	float importance(const LightTreeNode &node, glm::vec3 point, glm::vec3 normal) const {
+		glm::vec3 center = node.bounds.centroid();
+		glm::vec3 half_extent = 0.5f * (node.bounds.max - node.bounds.min);
+
+		if (glm::dot(center - point, normal) + glm::dot(half_extent, glm::abs(normal)) < 0.0f) return 0.0;
+
+		float distance = glm::max(glm::distance(center, point), glm::length(half_extent));
+		return node.power / (LIGHT_ATTENUATION_CONSTANT + LIGHT_ATTENUATION_LINEAR * distance + LIGHT_ATTENUATION_QUADRATIC * distance * distance);
+	}
+
+	/**
+	 * @brief Pick a light for a shading point
+	 *
+	 * @param point The shaded point
+	 * @param normal The normal at the point
+	 * @param key The random stream of the point, see pointKey
+	 * @param sample The index of the sample in the stream
+	 * @param probability Set to the probability of picking the returned light
+	 * @return The index of the light, or -1 if no light can light the point
+	 */
+	int sample(glm::vec3 point, glm::vec3 normal, uint64_t key, int sample, float &probability) const {
+		probability = 1.0;
+		if (nodes.empty()) return -1;
+
+		int index = 0;
+
+		for (int level = 0; nodes[index].light < 0; level++) {
+			const LightTreeNode &node = nodes[index];
+			float left = importance(nodes[node.left], point, normal);
+			float right = importance(nodes[node.right], point, normal);
+
+			if (left + right <= 0.0f) return -1;
+
+			float p_left = left / (left + right);
+			bool go_left = counterRandom(key, (uint64_t)sample * LIGHT_TREE_MAX_DEPTH + level) < p_left;
+
+			probability *= go_left ? p_left : 1.0f - p_left;
+			index = go_left ? node.left : node.right;
+		}
+
+		return nodes[index].light;
+	}
+
+private:
+	/**
+	 * @brief Create the node over a range of the lights
+	 *
+	 * @param lights The lights of the scene
+	 * @param order The indices of the lights, reordered by the function
+	 * @param first The first index of the range
+	 * @param last One past the last index of the range
+	 * @param level The level of the node, 1 for the root
+	 * @return The index of the node
+	 */
+	int split(const vector<Light *> &lights, vector<int> &order, int first, int last, int level) {
+		int index = nodes.size();
+		nodes.push_back(LightTreeNode());
+		depth = max(depth, level);
+
+		if (last - first == 1) {
+			const Light &light = *lights[order[first]];
+			nodes[index].bounds = AABB(light.position, light.position);
+			nodes[index].power = glm::max(light.color.r, glm::max(light.color.g, light.color.b));
+			nodes[index].light = order[first];
+			return index;
+		}
+
+		AABB centroids;
+		for (int k = first; k < last; k++) centroids.expand(lights[order[k]]->position);
+
+		glm::vec3 extent = centroids.max - centroids.min;
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+		int middle = (first + last) / 2;
+
+		nth_element(order.begin() + first, order.begin() + middle, order.begin() + last, [&](int a, int b) {
+			return lights[a]->position[axis] < lights[b]->position[axis];
+		});
+
+		int left = split(lights, order, first, middle, level + 1);
+		int right = split(lights, order, middle, last, level + 1);
+
+		nodes[index].left = left;
+		nodes[index].right = right;
+		nodes[index].bounds = nodes[left].bounds;
+		nodes[index].bounds.expand(nodes[right].bounds);
+		nodes[index].power = nodes[left].power + nodes[right].power;
+
+		return index;
+	}
+};
+
+#endif /* LightTree_h */
@@ -0,0 +1,77 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#ifndef Parallel_h
+#define Parallel_h
+
+using namespace std;
+
+/**
+ * @brief Get the number of worker threads used by the parallel helpers
+ *
+ * @return The number of hardware threads, at least 1
+ */
+inline int workerCount() {
+	int count = thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+/**
+ * @brief Run a function over a range of indices using all the worker threads
+ *
+ * The range is split into chunks of consecutive indices that the threads
+ * take from a shared counter, so uneven work is balanced dynamically.
+ *
+ * @param begin The first index of the range
+ * @param end One past the last index of the range
+ * @param function The function called once per index
+ * @param grain The number of consecutive indices taken at once by a thread
+ */
+template <typename Function>
+void parallelFor(int begin, int end, Function function, int grain=1) {
+	int threads = min(workerCount(), (end - begin + grain - 1) / max(grain, 1));
+
+	if (threads <= 1) {
+		for (int i = begin; i < end; i++) function(i);
+		return;
+	}
+
+	atomic<int> next(begin);
+	auto worker = [&]() {
+		for (int first = next.fetch_add(grain); first < end; first = next.fetch_add(grain)) {
+			int last = min(first + grain, end);
+			for (int i = first; i < last; i++) function(i);
+		}
+	};
+
+	vector<thread> pool;
+	for (int t = 1; t < threads; t++) pool.push_back(thread(worker));
+	worker();
+
+	for (thread &t : pool) t.join();
+}
+
+/**
+ * @brief Run a function once per worker thread over contiguous blocks of a range
+ *
+ * Block b covers the indices [begin + b * size, begin + (b + 1) * size), which
+ * keeps per-block state (e.g. histograms) deterministic.
+ *
+ * @param count The number of indices in the range
+ * @param blocks The number of blocks to split the range into
+ * @param function The function called as function(block, first, last)
+ */
+template <typename Function>
+void parallelBlocks(int count, int blocks, Function function) {
+	int size = (count + blocks - 1) / blocks;
+
+	parallelFor(0, blocks, [&](int block) {
+		int first = min(block * size, count);
+		int last = min(first + size, count);
+		function(block, first, last);
+	});
+}
+
+#endif /* Parallel_h */
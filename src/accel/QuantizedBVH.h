@@ -0,0 +1,192 @@
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include "AABB.h"
+#include "WideBVH.h"
+#include "../primitives/Ray.h"
+
+#ifndef QuantizedBVH_h
+#define QuantizedBVH_h
+
+using namespace std;
+
+/**
+ * @brief QuantizedBVHNode structure
+ *
+ * This structure represents a compressed node of an N-ary BVH. The boxes of
+ * the children are stored as T-bit integers on a grid spanning the box of the
+ * node, whose cell size is a power of two per axis. Nodes are aligned like
+ * WideBVHNode rather than to whole cache lines, which would pad the 16 bit
+ * BVH4 node to the size of its full precision one.
+ */
+template <typename T, int N>
+struct alignas(32) QuantizedBVHNode {
+	float origin[3]; ///< Lower corner of the grid
+	int8_t exponent[3]; ///< Base 2 logarithm of the cell size of the grid on every axis
+	int8_t count[N]; ///< Number of primitives of a leaf child, 0 for nodes, -1 for empty slots
+	T bounds[6][N]; ///< Quantized min x, min y, min z, max x, max y, max z of every child
+	int child[N]; ///< Index of the child node, or of the first primitive for leaves
+};
+
+static_assert(sizeof(QuantizedBVHNode<uint16_t, 4>) < sizeof(WideBVHNode<4>), "The 16 bit BVH4 node must be smaller than the full precision one");
+static_assert(sizeof(QuantizedBVHNode<uint16_t, 8>) < sizeof(WideBVHNode<8>), "The 16 bit BVH8 node must be smaller than the full precision one");
+
+/**
+ * @brief QuantizedBVH class
+ *
+ * This class represents an N-ary BVH whose child boxes are quantized to T-bit
+ * integers relative to the box of their parent. The minimum corners are
+ * rounded down and the maximum ones up, so the decoded boxes always contain
+ * the exact ones and no intersection is missed.
+ */
+template <typename T, int N>
+class QuantizedBVH {
+public:
+	vector<QuantizedBVHNode<T, N>> nodes; ///< Nodes of the hierarchy
+
+	/**
+	 * @brief Build the hierarchy by quantizing a wide BVH with the same topology
+	 *
+	 * @param wide The full precision wide BVH
+	 */
+	void build(const WideBVH<N> &wide) {
+		nodes.resize(wide.nodes.size());
+
+		for (int n = 0; n < (int)wide.nodes.size(); n++) {
+			quantize(wide.nodes[n], nodes[n]);
+		}
+	}
+
+	/**
+	 * @brief Decode the boxes of the children of a node
+	 *
+	 * @param node The compressed node
+	 * @param decoded Set to a full precision node with the same child boxes
+	 */
+	static void decode(const QuantizedBVHNode<T, N> &node, WideBVHNode<N> &decoded) {
+		for (int axis = 0; axis < 3; axis++) {
+			float scale = ldexpf(1.0f, node.exponent[axis]);
+
+			for (int i = 0; i < N; i++) {
+				decoded.bounds[axis][i] = node.origin[axis] + node.bounds[axis][i] * scale;
+				decoded.bounds[axis + 3][i] = node.origin[axis] + node.bounds[axis + 3][i] * scale;
+			}
+		}
+	}
+
+	/**
+	 * @brief Visit the primitives whose bounds are crossed by a ray, from near to far
+	 *
+	 * @param ray The ray to test
+	 * @param t_max The maximum distance along the ray, may be shrunk by the function
+	 * @param indices The primitive index array of the binary BVH
+	 * @param function Called as function(object_index), the visit stops when it returns true
+	 * @return True if the visit was stopped by the function
+	 */
+	template <typename Function>
+	bool traverse(const Ray &ray, float &t_max, const vector<int> &indices, Function function) const {
+		if (nodes.empty()) return false;
+
+		WideRay wide_ray(ray);
+		ChildrenKernel<N> intersect_children = childrenKernel<N>();
+		WideBVHNode<N> decoded;
+		int stack[BVH_STACK_SIZE * N][2]; // pairs of child index and primitive count
+		int size = 0;
+
+		stack[size][0] = 0;
+		stack[size++][1] = 0;
+
+		while (size > 0) {
+			size--;
+			int index = stack[size][0];
+			int count = stack[size][1];
+
+			if (count > 0) {
+				for (int p = index; p < index + count; p++) {
+					if (function(indices[p])) return true;
+				}
+				continue;
+			}
+
+			const QuantizedBVHNode<T, N> &node = nodes[index];
+			decode(node, decoded);
+
+			float t_near[N];
+			int mask = intersect_children(decoded, wide_ray, t_max, t_near);
+
+			int order[N];
+			int hits = 0;
+
+			for (int i = 0; i < N; i++) {
+				if (!(mask & (1 << i)) || node.count[i] < 0) continue;
+
+				int j = hits++;
+				for (; j > 0 && t_near[order[j - 1]] < t_near[i]; j--) order[j] = order[j - 1];
+				order[j] = i;
+			}
+
+			for (int j = 0; j < hits; j++) {
+				stack[size][0] = node.child[order[j]];
+				stack[size++][1] = node.count[order[j]];
+			}
+		}
+
+		return false;
+	}
+
+private:
+	/**
+	 * @brief Compress a full precision wide node
+	 *
+	 * @param wide The full precision node
+	 * @param node Set to the compressed node
+	 */
+	static void quantize(const WideBVHNode<N> &wide, QuantizedBVHNode<T, N> &node) {
+		const float levels = numeric_limits<T>::max();
+		AABB box;
+
+		for (int i = 0; i < N; i++) {
+			if (wide.count[i] < 0) continue;
+			box.expand(AABB(glm::vec3(wide.bounds[0][i], wide.bounds[1][i], wide.bounds[2][i]), glm::vec3(wide.bounds[3][i], wide.bounds[4][i], wide.bounds[5][i])));
+		}
+
+		for (int axis = 0; axis < 3; axis++) {
+			// One level is kept as headroom for the rounding of the decoded values
+			float extent = box.max[axis] - box.min[axis];
+			int exponent = extent > 0 ? (int)ceil(log2(extent / (levels - 1))) : -64;
+
+			node.origin[axis] = box.min[axis];
+			node.exponent[axis] = glm::clamp(exponent, -127, 127);
+		}
+
+		for (int i = 0; i < N; i++) {
+			node.child[i] = wide.child[i];
+			node.count[i] = wide.count[i];
+
+			for (int axis = 0; axis < 3; axis++) {
+				if (wide.count[i] < 0) {
+					node.bounds[axis][i] = levels;
+					node.bounds[axis + 3][i] = 0;
+					continue;
+				}
+
+				float scale = ldexpf(1.0f, node.exponent[axis]);
+				float low = floor((wide.bounds[axis][i] - node.origin[axis]) / scale);
+				float high = ceil((wide.bounds[axis + 3][i] - node.origin[axis]) / scale);
+
+				low = glm::clamp(low, 0.0f, levels);
+				high = glm::clamp(high, 0.0f, levels);
+
+				// Fix the cells whose decoded value was rounded inside the exact box
+				while (low > 0 && node.origin[axis] + low * scale > wide.bounds[axis][i]) low--;
+				while (high < levels && node.origin[axis] + high * scale < wide.bounds[axis + 3][i]) high++;
+
+				node.bounds[axis][i] = low;
+				node.bounds[axis + 3][i] = high;
+			}
+		}
+	}
+};
+
+#endif /* QuantizedBVH_h */
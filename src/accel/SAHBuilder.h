@@ -0,0 +1,112 @@
+#include <vector>
+#include <algorithm>
+#include "AABB.h"
+#include "BVHNode.h"
+
+#ifndef SAHBuilder_h
+#define SAHBuilder_h
+
+using namespace std;
+
+#define SAH_BINS 16 ///< Number of bins used to evaluate the split candidates
+
+/**
+ * @brief Function that builds a hierarchy over a range of items with the binned SAH
+ *
+ * The items are partitioned recursively along the axis with the largest
+ * centroid extent, choosing among SAH_BINS candidate planes the one with the
+ * lowest surface area heuristic cost.
+ *
+ * @param nodes The node array the new nodes are appended to
+ * @param items The item indices, reordered in place
+ * @param begin The first position of the range in items
+ * @param end One past the last position of the range in items
+ * @param bounds The bounding box of every item
+ * @param centroids The centroid of every item
+ * @param max_leaf The maximum number of items stored in a leaf
+ * @param make_leaf Called as make_leaf(begin, end, bounds) to create a leaf, returns its node index
+ * @return The index of the root node of the range
+ */
+template <typename LeafFunction>
+int buildBinnedSAH(vector<BVHNode> &nodes, vector<int> &items, int begin, int end, const vector<AABB> &bounds, const vector<glm::vec3> &centroids, int max_leaf, LeafFunction make_leaf) {
+	AABB node_bounds, centroid_bounds;
+
+	for (int i = begin; i < end; i++) {
+		node_bounds.expand(bounds[items[i]]);
+		centroid_bounds.expand(centroids[items[i]]);
+	}
+
+	int count = end - begin;
+	if (count <= 1) return make_leaf(begin, end, node_bounds);
+
+	glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+	int split = begin + count / 2;
+
+	if (extent[axis] > 0) {
+		int bin_count[SAH_BINS] = {0};
+		AABB bin_bounds[SAH_BINS];
+		float scale = SAH_BINS / extent[axis];
+
+		auto binOf = [&](int item) {
+			int bin = (centroids[item][axis] - centroid_bounds.min[axis]) * scale;
+			return glm::clamp(bin, 0, SAH_BINS - 1);
+		};
+
+		for (int i = begin; i < end; i++) {
+			int bin = binOf(items[i]);
+			bin_count[bin]++;
+			bin_bounds[bin].expand(bounds[items[i]]);
+		}
+
+		// Sweep from the right to get the cost of every right half, then from the left
+		float right_area[SAH_BINS];
+		int right_count[SAH_BINS];
+		AABB accumulated;
+		int accumulated_count = 0;
+
+		for (int b = SAH_BINS - 1; b > 0; b--) {
+			accumulated.expand(bin_bounds[b]);
+			accumulated_count += bin_count[b];
+			right_area[b] = accumulated.surfaceArea();
+			right_count[b] = accumulated_count;
+		}
+
+		float best_cost = INFINITY;
+		int best_bin = -1;
+		accumulated = AABB();
+		accumulated_count = 0;
+
+		for (int b = 1; b < SAH_BINS; b++) {
+			accumulated.expand(bin_bounds[b - 1]);
+			accumulated_count += bin_count[b - 1];
+
+			if (accumulated_count == 0 || right_count[b] == 0) continue;
+
+			float cost = accumulated_count * accumulated.surfaceArea() + right_count[b] * right_area[b];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_bin = b;
+			}
+		}
+
+		float area = node_bounds.surfaceArea();
+		float split_cost = area > 0 ? 1.0f + best_cost / area : count;
+
+		if (count <= max_leaf && (best_bin < 0 || count <= split_cost)) return make_leaf(begin, end, node_bounds);
+
+		if (best_bin > 0) {
+			split = partition(items.begin() + begin, items.begin() + end, [&](int item) { return binOf(item) < best_bin; }) - items.begin();
+		}
+	} else if (count <= max_leaf) {
+		return make_leaf(begin, end, node_bounds);
+	}
+
+	int left = buildBinnedSAH(nodes, items, begin, split, bounds, centroids, max_leaf, make_leaf);
+	int right = buildBinnedSAH(nodes, items, split, end, bounds, centroids, max_leaf, make_leaf);
+
+	return makeInteriorNode(nodes, left, right);
+}
+
+#endif /* SAHBuilder_h */
@@ -0,0 +1,367 @@
+#include <vector>
+#include <algorithm>
+#include "AABB.h"
+#include "BVHNode.h"
+#include "SAHBuilder.h"
+#include "../primitives/Object.h"
+
+#ifndef SBVHBuilder_h
+#define SBVHBuilder_h
+
+using namespace std;
+
+#define SBVH_MIN_OVERLAP 1e-5 ///< Overlap of the object split children, relative to the root area, above which spatial splits are tried
+
+/**
+ * @brief SBVHReference structure
+ *
+ * This structure represents a reference to a primitive in a spatial split
+ * BVH. A primitive split by spatial planes has several references, each
+ * bounded by the part of the primitive on its side of the planes.
+ */
+struct SBVHReference {
+	AABB bounds; ///< Bounds of the part of the primitive covered by the reference
+	int index; ///< Index of the primitive
+};
+
+/**
+ * @brief SBVHSplit structure
+ *
+ * This structure describes the best split candidate found for a node.
+ */
+struct SBVHSplit {
+	float cost = INFINITY; ///< SAH cost of the split, relative to the area of the node
+	int axis = -1; ///< Axis of the split plane
+	float position = 0.0; ///< Position of the spatial split plane, or centroid threshold of the object split
+	AABB left; ///< Bounds of the left child
+	AABB right; ///< Bounds of the right child
+};
+
+/**
+ * @brief SBVHBuilder class
+ *
+ * This class builds a BVH with spatial splits (SBVH). Every node compares the
+ * best binned object split with the best binned spatial split, which clips
+ * the primitives straddling the plane and references them on both sides.
+ * Spatial splits are only tried where the children of the object split
+ * overlap, and stop once the references reach the duplication budget.
+ */
+class SBVHBuilder {
+public:
+	int references = 0; ///< Number of references created by the last build
+
+	/**
+	 * @brief Construct a new SBVHBuilder object
+	 *
+	 * @param objects The primitives, used to clip their bounds
+	 * @param budget The fraction of extra references allowed, e.g. 0.3 for 30% duplication
+	 */
+	SBVHBuilder(const vector<Object *> &objects, float budget): objects(objects), budget(budget) {}
+
+	/**
+	 * @brief Build the hierarchy
+	 *
+	 * @param nodes The node array the new nodes are appended to
+	 * @param indices Set to the primitive indices in leaf order, possibly repeated
+	 * @param bounds The bounding box of every primitive
+	 * @param max_leaf The maximum number of references stored in a leaf
+	 * @return The index of the root node
+	 */
+	int build(vector<BVHNode> &nodes, vector<int> &indices, const vector<AABB> &bounds, int max_leaf) {
+		vector<SBVHReference> refs(bounds.size());
+		AABB node_bounds;
+
+		for (int i = 0; i < (int)bounds.size(); i++) {
+			refs[i].bounds = bounds[i];
+			refs[i].index = i;
+			node_bounds.expand(bounds[i]);
+		}
+
+		references = refs.size();
+		max_references = refs.size() * (1.0f + budget);
+		root_area = node_bounds.surfaceArea();
+		this->max_leaf = max_leaf;
+
+		indices.clear();
+		return buildNode(nodes, indices, refs, node_bounds);
+	}
+
+private:
+	const vector<Object *> &objects; ///< The primitives
+	float budget; ///< The fraction of extra references allowed
+	int max_references = 0; ///< Maximum number of references
+	float root_area = 0.0; ///< Surface area of the root node
+	int max_leaf = 1; ///< Maximum number of references in a leaf
+
+	/**
+	 * @brief Clip a reference to a box
+	 *
+	 * @param ref The reference to clip
+	 * @param box The box to clip to
+	 * @return The bounds of the part of the primitive inside the box
+	 */
+	AABB clip(const SBVHReference &ref, const AABB &box) {
+		AABB clipped = objects[ref.index]->clipBounds(box);
+
+		clipped.min = glm::max(clipped.min, ref.bounds.min);
+		clipped.max = glm::min(clipped.max, ref.bounds.max);
+
+		return clipped;
+	}
+
+	/**
+	 * @brief Find the best binned object split of a list of references
+	 */
+	SBVHSplit findObjectSplit(const vector<SBVHReference> &refs, float area) {
+		SBVHSplit best;
+		AABB centroid_bounds;
+
+		for (const SBVHReference &ref : refs) centroid_bounds.expand(ref.bounds.centroid());
+
+		for (int axis = 0; axis < 3; axis++) {
+			float extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+			if (extent <= 0) continue;
+
+			int bin_count[SAH_BINS] = {0};
+			AABB bin_bounds[SAH_BINS];
+
+			for (const SBVHReference &ref : refs) {
+				int bin = glm::clamp((int)((ref.bounds.centroid()[axis] - centroid_bounds.min[axis]) * SAH_BINS / extent), 0, SAH_BINS - 1);
+				bin_count[bin]++;
+				bin_bounds[bin].expand(ref.bounds);
+			}
+
+			evaluateBins(best, axis, bin_count, bin_count, bin_bounds, area, [&](int b) {
+				return centroid_bounds.min[axis] + extent * b / SAH_BINS;
+			});
+		}
+
+		return best;
+	}
+
+	/**
+	 * @brief Find the best binned spatial split of a list of references
+	 */
+	SBVHSplit findSpatialSplit(const vector<SBVHReference> &refs, const AABB &node_bounds, float area) {
+		SBVHSplit best;
+
+		for (int axis = 0; axis < 3; axis++) {
+			float origin = node_bounds.min[axis];
+			float extent = node_bounds.max[axis] - origin;
+			if (extent <= 0) continue;
+
+			int entries[SAH_BINS] = {0};
+			int exits[SAH_BINS] = {0};
+			AABB bin_bounds[SAH_BINS];
+
+			auto binOf = [&](float value) {
+				return glm::clamp((int)((value - origin) * SAH_BINS / extent), 0, SAH_BINS - 1);
+			};
+
+			for (const SBVHReference &ref : refs) {
+				int first = binOf(ref.bounds.min[axis]);
+				int last = binOf(ref.bounds.max[axis]);
+
+				for (int b = first; b <= last; b++) {
+					AABB bin = node_bounds;
+					bin.min[axis] = origin + extent * b / SAH_BINS;
+					bin.max[axis] = b == SAH_BINS - 1 ? node_bounds.max[axis] : origin + extent * (b + 1) / SAH_BINS;
+
+					bin_bounds[b].expand(first == last ? ref.bounds : clip(ref, bin));
+				}
+
+				entries[first]++;
+				exits[last]++;
+			}
+
+			evaluateBins(best, axis, entries, exits, bin_bounds, area, [&](int b) {
+				return origin + extent * b / SAH_BINS;
+			});
+		}
+
+		return best;
+	}
+
+	/**
+	 * @brief Sweep the bins of an axis and keep the cheapest split plane
+	 *
+	 * @param best The best split so far, updated if a cheaper one is found
+	 * @param axis The axis of the bins
+	 * @param entries The number of references starting in every bin
+	 * @param exits The number of references ending in every bin
+	 * @param bin_bounds The bounds of every bin
+	 * @param area The surface area of the node
+	 * @param plane Gives the position of the plane before a bin
+	 */
+	template <typename PlaneFunction>
+	void evaluateBins(SBVHSplit &best, int axis, const int *entries, const int *exits, const AABB *bin_bounds, float area, PlaneFunction plane) {
+		AABB right_bounds[SAH_BINS];
+		int right_count[SAH_BINS];
+		AABB accumulated;
+		int accumulated_count = 0;
+
+		for (int b = SAH_BINS - 1; b > 0; b--) {
+			accumulated.expand(bin_bounds[b]);
+			accumulated_count += exits[b];
+			right_bounds[b] = accumulated;
+			right_count[b] = accumulated_count;
+		}
+
+		accumulated = AABB();
+		accumulated_count = 0;
+
+		for (int b = 1; b < SAH_BINS; b++) {
+			accumulated.expand(bin_bounds[b - 1]);
+			accumulated_count += entries[b - 1];
+
+			if (accumulated_count == 0 || right_count[b] == 0) continue;
+
+			float cost = 1.0f + (accumulated_count * accumulated.surfaceArea() + right_count[b] * right_bounds[b].surfaceArea()) / area;
+
+			if (cost < best.cost) {
+				best.cost = cost;
+				best.axis = axis;
+				best.position = plane(b);
+				best.left = accumulated;
+				best.right = right_bounds[b];
+			}
+		}
+	}
+
+	/**
+	 * @brief Build the subtree over a list of references
+	 *
+	 * @param nodes The node array the new nodes are appended to
+	 * @param indices The primitive indices referenced by the leaves
+	 * @param refs The references of the node, consumed by the call
+	 * @param node_bounds The bounds of the references
+	 * @return The index of the root node of the subtree
+	 */
+	int buildNode(vector<BVHNode> &nodes, vector<int> &indices, vector<SBVHReference> &refs, const AABB &node_bounds) {
+		int count = refs.size();
+		float area = node_bounds.surfaceArea();
+
+		SBVHSplit object_split = count > 1 ? findObjectSplit(refs, area) : SBVHSplit();
+		SBVHSplit spatial_split;
+
+		if (count > 1 && references < max_references && root_area > 0) {
+			AABB overlap(glm::max(object_split.left.min, object_split.right.min), glm::min(object_split.left.max, object_split.right.max));
+
+			if (object_split.axis < 0 || overlap.surfaceArea() / root_area > SBVH_MIN_OVERLAP) {
+				spatial_split = findSpatialSplit(refs, node_bounds, area);
+			}
+		}
+
+		float leaf_cost = count;
+		bool use_spatial = spatial_split.cost < object_split.cost;
+		float split_cost = use_spatial ? spatial_split.cost : object_split.cost;
+
+		if (count <= 1 || (count <= max_leaf && leaf_cost <= split_cost)) {
+			BVHNode leaf;
+			leaf.left = indices.size();
+			leaf.count = count;
+			leaf.bounds = node_bounds;
+
+			for (const SBVHReference &ref : refs) indices.push_back(ref.index);
+			vector<SBVHReference>().swap(refs);
+
+			nodes.push_back(leaf);
+			return nodes.size() - 1;
+		}
+
+		vector<SBVHReference> left, right;
+
+		if (use_spatial) {
+			splitSpatially(refs, spatial_split, left, right);
+		} else if (object_split.axis >= 0) {
+			for (const SBVHReference &ref : refs) {
+				(ref.bounds.centroid()[object_split.axis] < object_split.position ? left : right).push_back(ref);
+			}
+		}
+
+		if (left.empty() || right.empty()) {
+			// No split separates the references, halve the list to keep making progress
+			left.assign(refs.begin(), refs.begin() + count / 2);
+			right.assign(refs.begin() + count / 2, refs.end());
+		}
+
+		vector<SBVHReference>().swap(refs);
+
+		AABB left_bounds, right_bounds;
+		for (const SBVHReference &ref : left) left_bounds.expand(ref.bounds);
+		for (const SBVHReference &ref : right) right_bounds.expand(ref.bounds);
+
+		int left_node = buildNode(nodes, indices, left, left_bounds);
+		int right_node = buildNode(nodes, indices, right, right_bounds);
+
+		return makeInteriorNode(nodes, left_node, right_node);
+	}
+
+	/**
+	 * @brief Distribute the references of a node on the two sides of a spatial split
+	 *
+	 * References straddling the plane are clipped and duplicated, unless moving
+	 * them entirely to one side (unsplitting) is cheaper or the budget is spent.
+	 */
+	void splitSpatially(const vector<SBVHReference> &refs, const SBVHSplit &split, vector<SBVHReference> &left, vector<SBVHReference> &right) {
+		int axis = split.axis;
+		AABB left_bounds, right_bounds;
+		vector<SBVHReference> straddling;
+
+		for (const SBVHReference &ref : refs) {
+			if (ref.bounds.max[axis] <= split.position) {
+				left.push_back(ref);
+				left_bounds.expand(ref.bounds);
+			} else if (ref.bounds.min[axis] >= split.position) {
+				right.push_back(ref);
+				right_bounds.expand(ref.bounds);
+			} else {
+				straddling.push_back(ref);
+			}
+		}
+
+		for (const SBVHReference &ref : straddling) {
+			AABB left_half = ref.bounds, right_half = ref.bounds;
+			left_half.max[axis] = split.position;
+			right_half.min[axis] = split.position;
+			left_half = clip(ref, left_half);
+			right_half = clip(ref, right_half);
+
+			AABB left_grown = left_bounds, right_grown = right_bounds, left_split = left_bounds, right_split = right_bounds;
+			left_grown.expand(ref.bounds);
+			right_grown.expand(ref.bounds);
+			left_split.expand(left_half);
+			right_split.expand(right_half);
+
+			int nl = left.size(), nr = right.size();
+			float split_cost = left_split.surfaceArea() * (nl + 1) + right_split.surfaceArea() * (nr + 1);
+			float to_left = left_grown.surfaceArea() * (nl + 1) + right_bounds.surfaceArea() * nr;
+			float to_right = left_bounds.surfaceArea() * nl + right_grown.surfaceArea() * (nr + 1);
+
+			bool can_split = references < max_references;
+
+			// The clipped primitive may lie entirely on one side of the plane
+			if (glm::any(glm::greaterThan(left_half.min, left_half.max))) {
+				right.push_back({right_half, ref.index});
+				right_bounds = right_split;
+			} else if (glm::any(glm::greaterThan(right_half.min, right_half.max))) {
+				left.push_back({left_half, ref.index});
+				left_bounds = left_split;
+			} else if (can_split && split_cost < to_left && split_cost < to_right) {
+				left.push_back({left_half, ref.index});
+				right.push_back({right_half, ref.index});
+				left_bounds = left_split;
+				right_bounds = right_split;
+				references++;
+			} else if (to_left <= to_right) {
+				left.push_back(ref);
+				left_bounds = left_grown;
+			} else {
+				right.push_back(ref);
+				right_bounds = right_grown;
+			}
+		}
+	}
+};
+
+#endif /* SBVHBuilder_h */
@@ -0,0 +1,390 @@
+#include <vector>
+#include <cmath>
+#include "AABB.h"
+#include "BVHNode.h"
+#include "../primitives/Ray.h"
+#include "../math/CPUDispatch.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifndef WideBVH_h
+#define WideBVH_h
+
+using namespace std;
+
+/**
+ * @brief WideBVHNode structure
+ *
+ * This structure represents a node of an N-ary BVH. The boxes of the
+ * children are stored as structure of arrays so that a ray is tested against
+ * all of them with one SIMD instruction per slab.
+ */
+template <int N>
+struct alignas(32) WideBVHNode {
+	float bounds[6][N]; ///< min x, min y, min z, max x, max y, max z of every child
+	int child[N]; ///< Index of the child node, or of the first primitive for leaves
+	int count[N]; ///< Number of primitives of a leaf child, 0 for nodes, -1 for empty slots
+
+	/**
+	 * @brief Construct a node with all the slots empty
+	 */
+	WideBVHNode() {
+		for (int i = 0; i < N; i++) {
+			setChild(i, AABB(glm::vec3(INFINITY), glm::vec3(-INFINITY)), -1, -1);
+		}
+	}
+
+	/**
+	 * @brief Set one of the children of the node
+	 *
+	 * @param slot The slot of the child
+	 * @param box The bounding box of the child
+	 * @param index The index of the child node or of the first primitive
+	 * @param primitives The number of primitives of a leaf, 0 for nodes
+	 */
+	void setChild(int slot, AABB box, int index, int primitives) {
+		for (int axis = 0; axis < 3; axis++) {
+			bounds[axis][slot] = box.min[axis];
+			bounds[axis + 3][slot] = box.max[axis];
+		}
+
+		child[slot] = index;
+		count[slot] = primitives;
+	}
+};
+
+/**
+ * @brief WideRay structure
+ *
+ * This structure holds the values of a ray that are reused by every box test.
+ * The origin and the inverse direction are padded to 4 floats, so that the
+ * kernels load them as vectors.
+ */
+struct WideRay {
+	float origin[4]; ///< Origin of the ray, then 0
+	float inv_direction[4]; ///< Component-wise inverse of the direction, then 1
+	int near[3]; ///< Row of the bounds holding the near slab of every axis
+	int far[3]; ///< Row of the bounds holding the far slab of every axis
+
+	/**
+	 * @brief Construct a new WideRay object
+	 *
+	 * @param ray The ray to trace
+	 */
+	WideRay(const Ray &ray) {
+		for (int axis = 0; axis < 3; axis++) {
+			origin[axis] = ray.origin[axis];
+			inv_direction[axis] = 1.0f / ray.direction[axis];
+			near[axis] = inv_direction[axis] < 0 ? axis + 3 : axis;
+			far[axis] = inv_direction[axis] < 0 ? axis : axis + 3;
+		}
+
+		origin[3] = 0.0f;
+		inv_direction[3] = 1.0f;
+	}
+};
+
+/**
+ * @brief Test a ray against all the children of a node
+ *
+ * Choosing the near and far slab from the sign of the direction avoids the
+ * min/max of the classic slab test. Empty slots have inverted boxes and are
+ * never hit.
+ *
+ * @param node The node to test
+ * @param ray The ray to test
+ * @param t_max The maximum distance along the ray
+ * @param t_near Set to the entry distance of the ray into every child
+ * @return The mask of the children hit by the ray
+ */
+template <int N>
+int intersectChildren(const WideBVHNode<N> &node, const WideRay &ray, float t_max, float t_near[N]) {
+	int mask = 0;
+
+	for (int i = 0; i < N; i++) {
+		float t_min = 0.0f, t_far = t_max;
+
+		for (int axis = 0; axis < 3; axis++) {
+			t_min = fmaxf(t_min, (node.bounds[ray.near[axis]][i] - ray.origin[axis]) * ray.inv_direction[axis]);
+			t_far = fminf(t_far, (node.bounds[ray.far[axis]][i] - ray.origin[axis]) * ray.inv_direction[axis]);
+		}
+
+		t_near[i] = t_min;
+		if (t_min <= t_far) mask |= 1 << i;
+	}
+
+	return mask;
+}
+
+/**
+ * @brief Kernel testing a ray against all the children of a node, with the signature of intersectChildren
+ */
+template <int N>
+using ChildrenKernel = int (*)(const WideBVHNode<N> &node, const WideRay &ray, float t_max, float t_near[N]);
+
+/**
+ * @brief Get the kernel of the selected instruction set testing a ray against the children of a node
+ *
+ * Widths without dispatched kernels use intersectChildren.
+ */
+template <int N>
+ChildrenKernel<N> childrenKernel() {
+	return &intersectChildren<N>;
+}
+
+#if defined(__SSE2__)
+/**
+ * @brief Test a ray against the four children of a node with SSE
+ */
+template <>
+inline int intersectChildren<4>(const WideBVHNode<4> &node, const WideRay &ray, float t_max, float t_near[4]) {
+	__m128 t_min = _mm_setzero_ps();
+	__m128 t_far = _mm_set1_ps(t_max);
+
+	for (int axis = 0; axis < 3; axis++) {
+		__m128 origin = _mm_set1_ps(ray.origin[axis]);
+		__m128 inv_direction = _mm_set1_ps(ray.inv_direction[axis]);
+
+		t_min = _mm_max_ps(t_min, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.near[axis]]), origin), inv_direction));
+		t_far = _mm_min_ps(t_far, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.far[axis]]), origin), inv_direction));
+	}
+
+	_mm_storeu_ps(t_near, t_min);
+	return _mm_movemask_ps(_mm_cmple_ps(t_min, t_far));
+}
+#endif
+
+#if defined(CPU_DISPATCH)
+/**
+ * @brief Test a ray against the eight children of a node with two SSE halves
+ */
+inline int intersectChildren8SSE(const WideBVHNode<8> &node, const WideRay &ray, float t_max, float t_near[8]) {
+	__m128 t_min[2] = {_mm_setzero_ps(), _mm_setzero_ps()};
+	__m128 t_far[2] = {_mm_set1_ps(t_max), _mm_set1_ps(t_max)};
+
+	for (int axis = 0; axis < 3; axis++) {
+		__m128 origin = _mm_set1_ps(ray.origin[axis]);
+		__m128 inv_direction = _mm_set1_ps(ray.inv_direction[axis]);
+
+		for (int half = 0; half < 2; half++) {
+			t_min[half] = _mm_max_ps(t_min[half], _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.near[axis]] + 4 * half), origin), inv_direction));
+			t_far[half] = _mm_min_ps(t_far[half], _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.far[axis]] + 4 * half), origin), inv_direction));
+		}
+	}
+
+	_mm_storeu_ps(t_near, t_min[0]);
+	_mm_storeu_ps(t_near + 4, t_min[1]);
+	return _mm_movemask_ps(_mm_cmple_ps(t_min[0], t_far[0])) | _mm_movemask_ps(_mm_cmple_ps(t_min[1], t_far[1])) << 4;
+}
+
+/**
+ * @brief Test a ray against the eight children of a node with AVX2
+ */
+TARGET_AVX2 inline int intersectChildren8AVX2(const WideBVHNode<8> &node, const WideRay &ray, float t_max, float t_near[8]) {
+	__m256 t_min = _mm256_setzero_ps();
+	__m256 t_far = _mm256_set1_ps(t_max);
+
+	for (int axis = 0; axis < 3; axis++) {
+		__m256 origin = _mm256_set1_ps(ray.origin[axis]);
+		__m256 inv_direction = _mm256_set1_ps(ray.inv_direction[axis]);
+
+		t_min = _mm256_max_ps(t_min, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[ray.near[axis]]), origin), inv_direction));
+		t_far = _mm256_min_ps(t_far, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[ray.far[axis]]), origin), inv_direction));
+	}
+
+	_mm256_storeu_ps(t_near, t_min);
+	return _mm256_movemask_ps(_mm256_cmp_ps(t_min, t_far, _CMP_LE_OQ));
+}
+
+AVX512_WARNINGS_OFF
+
+/**
+ * @brief Test a ray against the eight children of a node with AVX-512
+ *
+ * The near slabs fill the low half of a register and the far slabs the high
+ * half, so every axis takes one subtraction and one multiplication.
+ */
+TARGET_AVX512 inline int intersectChildren8AVX512(const WideBVHNode<8> &node, const WideRay &ray, float t_max, float t_near[8]) {
+	__m512 t_min = _mm512_setzero_ps();
+	__m512 t_far = _mm512_set1_ps(t_max);
+
+	for (int axis = 0; axis < 3; axis++) {
+		__m512 bounds = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castpd256_pd512(_mm256_castps_pd(_mm256_load_ps(node.bounds[ray.near[axis]]))), _mm256_castps_pd(_mm256_load_ps(node.bounds[ray.far[axis]])), 1));
+		__m512 slabs = _mm512_mul_ps(_mm512_sub_ps(bounds, _mm512_set1_ps(ray.origin[axis])), _mm512_set1_ps(ray.inv_direction[axis]));
+
+		t_min = _mm512_max_ps(t_min, slabs);
+		t_far = _mm512_min_ps(t_far, slabs);
+	}
+
+	// Only the low half of t_min and the high half of t_far are meaningful
+	__m256 entry = _mm512_castps512_ps256(t_min);
+	__m256 exit = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(t_far), 1));
+
+	_mm256_storeu_ps(t_near, entry);
+	return _mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ));
+}
+
+AVX512_WARNINGS_ON
+
+/**
+ * @brief Get the kernel of the selected instruction set testing a ray against the eight children of a node
+ */
+template <>
+inline ChildrenKernel<8> childrenKernel<8>() {
+	switch (active_isa) {
+		case ISA_AVX512:
+			return &intersectChildren8AVX512;
+		case ISA_AVX2:
+			return &intersectChildren8AVX2;
+		default:
+			return &intersectChildren8SSE;
+	}
+}
+#endif
+
+/**
+ * @brief WideBVH class
+ *
+ * This class represents an N-ary BVH obtained by collapsing a binary one.
+ * Leaves keep referencing the primitive index array of the binary BVH.
+ */
+template <int N>
+class WideBVH {
+public:
+	vector<WideBVHNode<N>> nodes; ///< Nodes of the hierarchy
+	AABB bounds; ///< Bounding box of the whole hierarchy
+
+	/**
+	 * @brief Build the hierarchy by collapsing a binary BVH
+	 *
+	 * Every wide node takes the children of a binary node and keeps opening the
+	 * interior child with the largest surface area until N slots are used.
+	 *
+	 * @param binary The nodes of the binary BVH
+	 * @param root The index of the root of the binary BVH
+	 */
+	void build(const vector<BVHNode> &binary, int root) {
+		nodes.clear();
+		if (root < 0) return;
+
+		bounds = binary[root].bounds;
+
+		if (binary[root].isLeaf()) {
+			nodes.push_back(WideBVHNode<N>());
+			nodes[0].setChild(0, binary[root].bounds, binary[root].left, binary[root].count);
+			return;
+		}
+
+		collapse(binary, root);
+	}
+
+	/**
+	 * @brief Visit the primitives whose bounds are crossed by a ray, from near to far
+	 *
+	 * @param ray The ray to test
+	 * @param t_max The maximum distance along the ray, may be shrunk by the function
+	 * @param indices The primitive index array of the binary BVH
+	 * @param function Called as function(object_index), the visit stops when it returns true
+	 * @return True if the visit was stopped by the function
+	 */
+	template <typename Function>
+	bool traverse(const Ray &ray, float &t_max, const vector<int> &indices, Function function) const {
+		if (nodes.empty()) return false;
+
+		WideRay wide_ray(ray);
+		ChildrenKernel<N> intersect_children = childrenKernel<N>();
+		int stack[BVH_STACK_SIZE * N][2]; // pairs of child index and primitive count
+		int size = 0;
+
+		stack[size][0] = 0;
+		stack[size++][1] = 0;
+
+		while (size > 0) {
+			size--;
+			int index = stack[size][0];
+			int count = stack[size][1];
+
+			if (count > 0) {
+				for (int p = index; p < index + count; p++) {
+					if (function(indices[p])) return true;
+				}
+				continue;
+			}
+
+			const WideBVHNode<N> &node = nodes[index];
+
+			float t_near[N];
+			int mask = intersect_children(node, wide_ray, t_max, t_near);
+
+			// Sort the hit children from far to near, so that the nearest one is popped first
+			int order[N];
+			int hits = 0;
+
+			for (int i = 0; i < N; i++) {
+				if (!(mask & (1 << i))) continue;
+
+				int j = hits++;
+				for (; j > 0 && t_near[order[j - 1]] < t_near[i]; j--) order[j] = order[j - 1];
+				order[j] = i;
+			}
+
+			for (int j = 0; j < hits; j++) {
+				stack[size][0] = node.child[order[j]];
+				stack[size++][1] = node.count[order[j]];
+			}
+		}
+
+		return false;
+	}
+
+private:
+	/**
+	 * @brief Create the wide node replacing a binary interior node
+	 *
+	 * @param binary The nodes of the binary BVH
+	 * @param index The index of the binary node
+	 * @return The index of the wide node
+	 */
+	int collapse(const vector<BVHNode> &binary, int index) {
+		int slots[N];
+		int used = 2;
+
+		slots[0] = binary[index].left;
+		slots[1] = binary[index].right;
+
+		while (used < N) {
+			int largest = -1;
+
+			for (int i = 0; i < used; i++) {
+				const BVHNode &candidate = binary[slots[i]];
+				if (!candidate.isLeaf() && (largest < 0 || candidate.bounds.surfaceArea() > binary[slots[largest]].bounds.surfaceArea())) largest = i;
+			}
+
+			if (largest < 0) break;
+
+			int opened = slots[largest];
+			slots[largest] = binary[opened].left;
+			slots[used++] = binary[opened].right;
+		}
+
+		int wide = nodes.size();
+		nodes.push_back(WideBVHNode<N>());
+
+		for (int i = 0; i < used; i++) {
+			const BVHNode &node = binary[slots[i]];
+
+			if (node.isLeaf()) {
+				nodes[wide].setChild(i, node.bounds, node.left, node.count);
+			} else {
+				int child = collapse(binary, slots[i]);
+				nodes[wide].setChild(i, node.bounds, child, 0);
+			}
+		}
+
+		return wide;
+	}
+};
+
+#endif /* WideBVH_h */
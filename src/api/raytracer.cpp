@@ -0,0 +1,355 @@
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include "raytracer.h"
+#include "../Renderer.h"
+#include "../RayQuery.h"
+#include "../RenderContext.h"
+#include "../shapes/Cone.h"
+#include "../shapes/Plane.h"
+#include "../shapes/Sphere.h"
+#include "../shader/Phong.h"
+#include "../accel/Parallel.h"
+#include "../math/CPUDispatch.h"
+#include "../attributes/Material.h"
+#include "../attributes/Textures.h"
+
+using namespace std;
+
+/// Size of the first version of rt_build_options, which had no light options
+#define RT_BUILD_OPTIONS_FIRST_SIZE offsetof(rt_build_options, light_threshold)
+
+/**
+ * @brief rt_scene structure
+ *
+ * This structure wraps a render context with its commit state.
+ */
+struct rt_scene {
+	RenderContext context; ///< The scene
+	bool committed = false; ///< Whether the acceleration structures match the scene
+};
+
+/**
+ * @brief Convert three floats to a vector
+ */
+static glm::vec3 toVec3(const float * values) {
+	return glm::vec3(values[0], values[1], values[2]);
+}
+
+/**
+ * @brief Add a transformed shape to a scene
+ */
+static int addTransformed(rt_scene * scene, Object * object, const float transform[16]) {
+	glm::mat4 matrix;
+	for (int c = 0; c < 4; c++) {
+		for (int r = 0; r < 4; r++) matrix[c][r] = transform[4 * c + r];
+	}
+
+	object->setTransformation(matrix);
+	scene->context.addObject(object);
+	scene->committed = false;
+
+	return scene->context.objects.size() - 1;
+}
+
+/**
+ * @brief Check that a render job can be executed
+ */
+static bool validJob(const rt_camera * camera, const rt_region * region, const float * buffer, int stride) {
+	if (!camera || !region || !buffer || camera->width <= 0 || camera->height <= 0) return false;
+	if (region->x < 0 || region->y < 0 || region->width <= 0 || region->height <= 0) return false;
+	if (region->x + region->width > camera->width || region->y + region->height > camera->height) return false;
+
+	return stride == 0 || stride >= 3 * region->width;
+}
+
+/**
+ * @brief Render a job, assumed valid, into its buffer
+ */
+static void renderJob(const rt_scene * scene, const rt_camera * camera, const rt_region * region, float * buffer, int stride) {
+	Camera view(camera->width, camera->height, camera->fov);
+	Region pixels;
+	pixels.x = region->x;
+	pixels.y = region->y;
+	pixels.width = region->width;
+	pixels.height = region->height;
+
+	if (stride == 0) stride = 3 * region->width;
+
+	renderRegion(scene->context, view, pixels, [&](int i, int j, glm::vec3 color) {
+		float * pixel = buffer + (j - region->y) * stride + 3 * (i - region->x);
+		pixel[0] = color.r;
+		pixel[1] = color.g;
+		pixel[2] = color.b;
+	});
+}
+
+/**
+ * @brief Check a batch of rays and convert it to a RayBatch
+ */
+static bool convertBatch(const rt_ray_batch * rays, RayBatch &batch) {
+	if (!rays || rays->count < 0) return false;
+
+	batch.count = rays->count;
+	batch.origin[0] = rays->origin_x;
+	batch.origin[1] = rays->origin_y;
+	batch.origin[2] = rays->origin_z;
+	batch.direction[0] = rays->direction_x;
+	batch.direction[1] = rays->direction_y;
+	batch.direction[2] = rays->direction_z;
+	batch.t_max = rays->tmax;
+
+	if (batch.count == 0) return true;
+
+	for (int axis = 0; axis < 3; axis++) {
+		if (!batch.origin[axis] || !batch.direction[axis]) return false;
+	}
+
+	return true;
+}
+
+extern "C" {
+
+void rt_build_options_default(rt_build_options * options) {
+	if (!options) return;
+
+	options->struct_size = sizeof(rt_build_options);
+	options->builder = RT_BUILDER_SAH;
+	options->width = 2;
+	options->precision = 32;
+	options->split_budget = 0.3;
+	options->light_threshold = 0.0;
+	options->light_samples = 0;
+}
+
+void rt_material_default(rt_material * material) {
+	if (!material) return;
+
+	Material defaults;
+	for (int c = 0; c < 3; c++) {
+		material->ambient[c] = defaults.ambient[c];
+		material->diffuse[c] = defaults.diffuse[c];
+		material->specular[c] = defaults.specular[c];
+	}
+
+	material->shininess = defaults.shininess;
+	material->is_reflective = defaults.is_reflective;
+	material->reflectiveness = defaults.reflectiveness;
+	material->is_refractive = defaults.is_refractive;
+	material->refractiveness = defaults.refractiveness;
+	material->delta = defaults.delta;
+	material->texture = RT_TEXTURE_NONE;
+	material->image = -1;
+}
+
+rt_scene * rt_scene_create(void) {
+	return new rt_scene();
+}
+
+void rt_scene_destroy(rt_scene * scene) {
+	delete scene;
+}
+
+int rt_scene_add_material(rt_scene * scene, const rt_material * material) {
+	if (!scene || !material) return RT_INVALID_ARGUMENT;
+	if (material->image < -1 || material->image >= scene->context.textures.size()) return RT_INVALID_ARGUMENT;
+	if (material->texture != RT_TEXTURE_NONE && material->texture != RT_TEXTURE_CHECKERBOARD && material->texture != RT_TEXTURE_RAINBOW) return RT_INVALID_ARGUMENT;
+
+	Material converted;
+	converted.ambient = toVec3(material->ambient);
+	converted.diffuse = toVec3(material->diffuse);
+	converted.specular = toVec3(material->specular);
+	converted.shininess = material->shininess;
+	converted.is_reflective = material->is_reflective != 0;
+	converted.reflectiveness = material->reflectiveness;
+	converted.is_refractive = material->is_refractive != 0;
+	converted.refractiveness = material->refractiveness;
+	converted.delta = material->delta;
+
+	if (material->texture == RT_TEXTURE_CHECKERBOARD) converted.texture = &checkerboardTexture;
+	if (material->texture == RT_TEXTURE_RAINBOW) converted.texture = &rainbowTexture;
+	converted.image = material->image;
+
+	return scene->context.addMaterial(converted);
+}
+
+int rt_convert_texture(const char * input, const char * output) {
+	if (!input || !output) return RT_INVALID_ARGUMENT;
+
+	return convertTexture(input, output) ? RT_SUCCESS : RT_INVALID_ARGUMENT;
+}
+
+int rt_scene_add_texture(rt_scene * scene, const char * path) {
+	if (!scene || !path) return RT_INVALID_ARGUMENT;
+
+	int texture = scene->context.addImageTexture(path);
+	return texture >= 0 ? texture : RT_INVALID_ARGUMENT;
+}
+
+int rt_scene_set_texture_cache(rt_scene * scene, size_t bytes) {
+	if (!scene || bytes == 0) return RT_INVALID_ARGUMENT;
+
+	scene->context.textures.setCapacity(bytes);
+	return RT_SUCCESS;
+}
+
+int rt_scene_add_sphere(rt_scene * scene, const float transform[16], int material) {
+	if (!scene || !transform || material < 0 || material >= (int)scene->context.materials.size()) return RT_INVALID_ARGUMENT;
+
+	return addTransformed(scene, new Sphere(material), transform);
+}
+
+int rt_scene_add_cone(rt_scene * scene, const float transform[16], int material) {
+	if (!scene || !transform || material < 0 || material >= (int)scene->context.materials.size()) return RT_INVALID_ARGUMENT;
+
+	return addTransformed(scene, new Cone(material), transform);
+}
+
+int rt_scene_add_plane(rt_scene * scene, const float point[3], const float normal[3], int material) {
+	if (!scene || !point || !normal || material < 0 || material >= (int)scene->context.materials.size()) return RT_INVALID_ARGUMENT;
+
+	scene->context.addObject(new Plane(toVec3(point), glm::normalize(toVec3(normal)), material));
+	scene->committed = false;
+
+	return scene->context.objects.size() - 1;
+}
+
+int rt_scene_add_light(rt_scene * scene, const float position[3], const float color[3]) {
+	if (!scene || !position || !color) return RT_INVALID_ARGUMENT;
+
+	scene->context.addLight(new Light(toVec3(position), toVec3(color)));
+	scene->committed = false;
+
+	return scene->context.lights.size() - 1;
+}
+
+int rt_scene_set_ambient(rt_scene * scene, const float color[3]) {
+	if (!scene || !color) return RT_INVALID_ARGUMENT;
+
+	scene->context.ambient_light = toVec3(color);
+	return RT_SUCCESS;
+}
+
+int rt_scene_commit(rt_scene * scene, const rt_build_options * options) {
+	if (!scene) return RT_INVALID_ARGUMENT;
+
+	rt_build_options settings;
+	rt_build_options_default(&settings);
+
+	// The fields past the size known to the caller keep their defaults
+	if (options) {
+		if (options->struct_size < RT_BUILD_OPTIONS_FIRST_SIZE) return RT_INVALID_ARGUMENT;
+		memcpy(&settings, options, min(options->struct_size, sizeof(settings)));
+		settings.struct_size = sizeof(settings);
+	}
+
+	if (settings.builder < RT_BUILDER_SAH || settings.builder > RT_BUILDER_SBVH) return RT_INVALID_ARGUMENT;
+	if (settings.width != 2 && settings.width != 4 && settings.width != 8) return RT_INVALID_ARGUMENT;
+	if (settings.precision != 8 && settings.precision != 16 && settings.precision != 32) return RT_INVALID_ARGUMENT;
+	if (!(settings.light_threshold >= 0.0f) || settings.light_samples < 0) return RT_INVALID_ARGUMENT;
+
+	scene->context.light_threshold = settings.light_threshold;
+	scene->context.light_samples = settings.light_samples;
+	scene->context.commit((BVHBuilder)settings.builder, settings.width, settings.precision, settings.split_budget);
+	scene->committed = true;
+
+	return RT_SUCCESS;
+}
+
+int rt_render(const rt_scene * scene, const rt_camera * camera, const rt_region * region, float * buffer, int stride) {
+	if (!scene || !validJob(camera, region, buffer, stride)) return RT_INVALID_ARGUMENT;
+	if (!scene->committed) return RT_NOT_COMMITTED;
+
+	renderJob(scene, camera, region, buffer, stride);
+	return RT_SUCCESS;
+}
+
+int rt_render_batch(const rt_scene * scene, const rt_render_job * jobs, int count) {
+	if (!scene || (count > 0 && !jobs) || count < 0) return RT_INVALID_ARGUMENT;
+	if (!scene->committed) return RT_NOT_COMMITTED;
+
+	for (int k = 0; k < count; k++) {
+		if (!validJob(&jobs[k].camera, &jobs[k].region, jobs[k].buffer, jobs[k].stride)) return RT_INVALID_ARGUMENT;
+	}
+
+	for (int k = 0; k < count; k++) {
+		renderJob(scene, &jobs[k].camera, &jobs[k].region, jobs[k].buffer, jobs[k].stride);
+	}
+
+	return RT_SUCCESS;
+}
+
+int rt_trace_rays(const rt_scene * scene, const float * origins, const float * directions, int count, float * colors) {
+	if (!scene || count < 0 || (count > 0 && (!origins || !directions || !colors))) return RT_INVALID_ARGUMENT;
+	if (!scene->committed) return RT_NOT_COMMITTED;
+
+	parallelFor(0, count, [&](int k) {
+		Ray ray(toVec3(origins + 3 * k), glm::normalize(toVec3(directions + 3 * k)));
+		glm::vec3 color = trace_ray(scene->context, ray);
+
+		colors[3 * k] = color.r;
+		colors[3 * k + 1] = color.g;
+		colors[3 * k + 2] = color.b;
+	}, 256);
+
+	return RT_SUCCESS;
+}
+
+int rt_intersect_rays(const rt_scene * scene, const rt_ray_batch * rays, rt_hit_batch * hits) {
+	RayBatch batch;
+	if (!scene || !hits || !convertBatch(rays, batch)) return RT_INVALID_ARGUMENT;
+	if (!scene->committed) return RT_NOT_COMMITTED;
+
+	HitBatch results;
+	results.distance = hits->distance;
+	results.object = hits->object;
+	results.normal[0] = hits->normal_x;
+	results.normal[1] = hits->normal_y;
+	results.normal[2] = hits->normal_z;
+	results.uv[0] = hits->u;
+	results.uv[1] = hits->v;
+
+	intersectRays(scene->context, batch, results);
+	return RT_SUCCESS;
+}
+
+int rt_occluded_rays(const rt_scene * scene, const rt_ray_batch * rays, int * occluded) {
+	RayBatch batch;
+	if (!scene || !convertBatch(rays, batch) || (batch.count > 0 && !occluded)) return RT_INVALID_ARGUMENT;
+	if (!scene->committed) return RT_NOT_COMMITTED;
+
+	occludedRays(scene->context, batch, occluded);
+	return RT_SUCCESS;
+}
+
+int rt_evaluate_texture(rt_texture texture, int count, const float * u, const float * v, const float * width_u, const float * width_v, float * r, float * g, float * b) {
+	if (count < 0 || (count > 0 && (!u || !v || !r || !g || !b))) return RT_INVALID_ARGUMENT;
+	if (texture != RT_TEXTURE_CHECKERBOARD && texture != RT_TEXTURE_RAINBOW) return RT_INVALID_ARGUMENT;
+
+	TextureBatch batch;
+	batch.count = count;
+	batch.u = u;
+	batch.v = v;
+	batch.width_u = width_u;
+	batch.width_v = width_v;
+	batch.r = r;
+	batch.g = g;
+	batch.b = b;
+
+	evaluateTextures(texture == RT_TEXTURE_CHECKERBOARD ? &checkerboardTexture : &rainbowTexture, batch);
+	return RT_SUCCESS;
+}
+
+const char * rt_get_isa(void) {
+	return isaName(active_isa);
+}
+
+int rt_set_isa(const char * name) {
+	ISALevel level;
+	if (!name || !parseISA(name, level)) return RT_INVALID_ARGUMENT;
+
+	setISA(level);
+	return RT_SUCCESS;
+}
+
+}
@@ -0,0 +1,316 @@
+#ifndef raytracer_h
+#define raytracer_h
+
+/**
+ * @file raytracer.h
+ * @brief C API of the ray tracer
+ *
+ * A scene is created, filled with materials, shapes and lights, and committed,
+ * which builds its acceleration structures. A committed scene is only read
+ * while rendering, so it can be rendered from several threads and several
+ * scenes can live in one process. Editing a scene requires a new commit.
+ *
+ * Functions returning int return RT_SUCCESS (or a non-negative id) on success
+ * and a negative rt_status on failure.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Status codes returned by the API
+ */
+typedef enum rt_status {
+	RT_SUCCESS = 0, ///< The call succeeded
+	RT_INVALID_ARGUMENT = -1, ///< A pointer was null, an id unknown or a size invalid
+	RT_NOT_COMMITTED = -2 ///< The scene was edited since its last commit
+} rt_status;
+
+/**
+ * @brief Procedural textures of a material
+ */
+typedef enum rt_texture {
+	RT_TEXTURE_NONE = 0, ///< Use the diffuse color
+	RT_TEXTURE_CHECKERBOARD = 1, ///< Black and white checkerboard
+	RT_TEXTURE_RAINBOW = 2 ///< Red, green and blue stripes
+} rt_texture;
+
+/**
+ * @brief BVH builders, see --builder
+ */
+typedef enum rt_builder {
+	RT_BUILDER_SAH = 0, ///< Binned SAH
+	RT_BUILDER_LBVH = 1, ///< Parallel linear BVH
+	RT_BUILDER_HLBVH = 2, ///< Linear BVH with SAH top levels
+	RT_BUILDER_SBVH = 3 ///< SAH with spatial splits
+} rt_builder;
+
+/**
+ * @brief Description of a material, see Material
+ */
+typedef struct rt_material {
+	float ambient[3]; ///< Ambient coefficient
+	float diffuse[3]; ///< Diffuse coefficient
+	float specular[3]; ///< Specular coefficient
+	float shininess; ///< Exponent for Phong model
+	int is_reflective; ///< Non-zero if the material is a mirror
+	float reflectiveness; ///< Quantify the reflectiveness of the material
+	int is_refractive; ///< Non-zero if the material is transparent
+	float refractiveness; ///< Quantity of refractiveness of the material
+	float delta; ///< Index representing refractiveness
+	rt_texture texture; ///< Procedural texture replacing the diffuse color
+	int image; ///< Id of an image texture replacing the diffuse color, -1 for none
+} rt_material;
+
+/**
+ * @brief Options of the acceleration structure built by rt_scene_commit
+ *
+ * Fill the structure with rt_build_options_default before changing fields.
+ * New fields are only ever appended: struct_size tells the library which
+ * fields the caller knows of, and the others keep their defaults, so
+ * programs built against an older header keep working.
+ */
+typedef struct rt_build_options {
+	size_t struct_size; ///< sizeof(rt_build_options) of the header the caller was built with
+	rt_builder builder; ///< Algorithm used to build the BVH
+	int width; ///< Branching factor of the BVH: 2, 4 or 8
+	int precision; ///< Bits per child box coordinate: 8, 16 or 32
+	float split_budget; ///< Fraction of duplicated references allowed by the SBVH builder
+	float light_threshold; ///< Contribution below which lights are culled, 0 to shade with every light
+	int light_samples; ///< Lights sampled per shading point, 0 to shade with every light
+} rt_build_options;
+
+/**
+ * @brief Pinhole camera at the origin looking along +z
+ */
+typedef struct rt_camera {
+	int width; ///< Width of the full image in pixels
+	int height; ///< Height of the full image in pixels
+	float fov; ///< Horizontal field of view in degrees
+} rt_camera;
+
+/**
+ * @brief Rectangle of pixels of the image of a camera
+ */
+typedef struct rt_region {
+	int x; ///< Column of the top left pixel
+	int y; ///< Row of the top left pixel
+	int width; ///< Width of the rectangle
+	int height; ///< Height of the rectangle
+} rt_region;
+
+/**
+ * @brief One render of a batch: a region of a camera written to a buffer
+ */
+typedef struct rt_render_job {
+	rt_camera camera; ///< Camera generating the primary rays
+	rt_region region; ///< Pixels to render
+	float * buffer; ///< Output RGB floats in [0, 1], row-major, 3 per pixel
+	int stride; ///< Floats between the starts of two rows of the buffer, 0 for 3 * region.width
+} rt_render_job;
+
+/**
+ * @brief Batch of rays stored as structure of arrays, see rt_intersect_rays
+ */
+typedef struct rt_ray_batch {
+	int count; ///< Number of rays
+	const float * origin_x; ///< x coordinates of the origins
+	const float * origin_y; ///< y coordinates of the origins
+	const float * origin_z; ///< z coordinates of the origins
+	const float * direction_x; ///< x coordinates of the directions, need not be normalized
+	const float * direction_y; ///< y coordinates of the directions
+	const float * direction_z; ///< z coordinates of the directions
+	const float * tmax; ///< Maximum hit distance of every ray, NULL for no limit
+} rt_ray_batch;
+
+/**
+ * @brief Closest hits of a batch of rays stored as structure of arrays
+ *
+ * Arrays left NULL are not written. Rays that hit nothing get an infinite
+ * distance, the object -1 and zero normals and texture coordinates. Planes
+ * and cones have no texture coordinates and get zero as well.
+ */
+typedef struct rt_hit_batch {
+	float * distance; ///< Distance from the origin to the hit
+	int * object; ///< Id of the hit object, as returned when it was added
+	float * normal_x; ///< x coordinates of the normals at the hits
+	float * normal_y; ///< y coordinates of the normals at the hits
+	float * normal_z; ///< z coordinates of the normals at the hits
+	float * u; ///< First texture coordinates of the hits
+	float * v; ///< Second texture coordinates of the hits
+} rt_hit_batch;
+
+typedef struct rt_scene rt_scene; ///< Opaque handle of a scene
+
+/**
+ * @brief Fill a build options structure with the defaults (SAH, binary, full precision) and its size
+ */
+void rt_build_options_default(rt_build_options * options);
+
+/**
+ * @brief Fill a material structure with the defaults of Material
+ */
+void rt_material_default(rt_material * material);
+
+/**
+ * @brief Create an empty scene, with a white ambient light
+ */
+rt_scene * rt_scene_create(void);
+
+/**
+ * @brief Destroy a scene and everything it owns
+ */
+void rt_scene_destroy(rt_scene * scene);
+
+/**
+ * @brief Add a material to the scene
+ *
+ * @return The id of the material, or a negative rt_status
+ */
+int rt_scene_add_material(rt_scene * scene, const rt_material * material);
+
+/**
+ * @brief Convert a PPM image to a tiled, mip-mapped texture file, meant to be done offline
+ *
+ * @param input The path of the PPM image
+ * @param output The path of the tiled texture file
+ */
+int rt_convert_texture(const char * input, const char * output);
+
+/**
+ * @brief Add an image texture read from a tiled texture file
+ *
+ * Only the tiles needed by the renders are read, through a cache of bounded size.
+ *
+ * @return The id of the texture, or a negative rt_status
+ */
+int rt_scene_add_texture(rt_scene * scene, const char * path);
+
+/**
+ * @brief Set the memory budget of the texture tile cache of the scene, 64 MB by default
+ */
+int rt_scene_set_texture_cache(rt_scene * scene, size_t bytes);
+
+/**
+ * @brief Add a unit sphere transformed by a column-major 4x4 matrix
+ *
+ * @return The id of the object, or a negative rt_status
+ */
+int rt_scene_add_sphere(rt_scene * scene, const float transform[16], int material);
+
+/**
+ * @brief Add a unit cone (apex at the origin, opening along +y up to y = 1) transformed by a column-major 4x4 matrix
+ *
+ * @return The id of the object, or a negative rt_status
+ */
+int rt_scene_add_cone(rt_scene * scene, const float transform[16], int material);
+
+/**
+ * @brief Add an infinite plane through a point
+ *
+ * @return The id of the object, or a negative rt_status
+ */
+int rt_scene_add_plane(rt_scene * scene, const float point[3], const float normal[3], int material);
+
+/**
+ * @brief Add a point light
+ *
+ * @return The id of the light, or a negative rt_status
+ */
+int rt_scene_add_light(rt_scene * scene, const float position[3], const float color[3]);
+
+/**
+ * @brief Set the intensity of the ambient light
+ */
+int rt_scene_set_ambient(rt_scene * scene, const float color[3]);
+
+/**
+ * @brief Build the acceleration structures of the scene
+ *
+ * @param options The build options, or NULL for the defaults
+ * @return RT_INVALID_ARGUMENT if an option is invalid or struct_size is smaller than the first version of the structure
+ */
+int rt_scene_commit(rt_scene * scene, const rt_build_options * options);
+
+/**
+ * @brief Render a region of the image of a camera into a caller-provided buffer
+ *
+ * @param buffer Output RGB floats in [0, 1], row-major, 3 per pixel of the region
+ * @param stride Floats between the starts of two rows of the buffer, 0 for 3 * region->width
+ */
+int rt_render(const rt_scene * scene, const rt_camera * camera, const rt_region * region, float * buffer, int stride);
+
+/**
+ * @brief Render a list of regions and cameras in one call
+ */
+int rt_render_batch(const rt_scene * scene, const rt_render_job * jobs, int count);
+
+/**
+ * @brief Trace a batch of rays and return their shaded colors
+ *
+ * @param origins Ray origins, 3 floats per ray
+ * @param directions Ray directions, 3 floats per ray, need not be normalized
+ * @param count Number of rays
+ * @param colors Output RGB floats, 3 per ray
+ */
+int rt_trace_rays(const rt_scene * scene, const float * origins, const float * directions, int count, float * colors);
+
+/**
+ * @brief Find the closest hit of every ray of a batch, without shading
+ *
+ * Only hits closer than the maximum distance of their ray are reported.
+ */
+int rt_intersect_rays(const rt_scene * scene, const rt_ray_batch * rays, rt_hit_batch * hits);
+
+/**
+ * @brief Check which rays of a batch hit any object closer than their maximum distance
+ *
+ * The traversal of a ray stops at its first such hit, which is cheaper than
+ * rt_intersect_rays for shadow and visibility queries.
+ *
+ * @param occluded Output, 1 for the occluded rays and 0 for the others
+ */
+int rt_occluded_rays(const rt_scene * scene, const rt_ray_batch * rays, int * occluded);
+
+/**
+ * @brief Evaluate a procedural texture over a batch of lookups stored as structure of arrays
+ *
+ * The lookups are evaluated several at a time with SIMD instructions, which is
+ * much cheaper than one call per lookup for texture-heavy ray batches.
+ *
+ * @param u First texture coordinates
+ * @param v Second texture coordinates
+ * @param width_u Widths of the footprints along u, or NULL to point sample
+ * @param width_v Widths of the footprints along v, or NULL to point sample
+ * @param r Output red channels
+ * @param g Output green channels
+ * @param b Output blue channels
+ */
+int rt_evaluate_texture(rt_texture texture, int count, const float * u, const float * v, const float * width_u, const float * width_v, float * r, float * g, float * b);
+
+/**
+ * @brief Get the instruction set level of the SIMD kernels in use
+ *
+ * @return "baseline", "sse4.2", "avx2" or "avx512", the highest one supported
+ * by the CPU unless changed by rt_set_isa
+ */
+const char * rt_get_isa(void);
+
+/**
+ * @brief Select the instruction set level of the SIMD kernels for the whole process, see --isa
+ *
+ * Must not be called while rendering. Levels above the one supported by the
+ * CPU are lowered to it.
+ *
+ * @param name "baseline", "sse4.2", "avx2" or "avx512"
+ */
+int rt_set_isa(const char * name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* raytracer_h */
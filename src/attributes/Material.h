@@ -22,7 +22,8 @@ struct Material {
   float refractiveness = 0.0; ///< Quantity of refractiveness of the object
   float delta = 0.0; ///< Index representing refractiveness
 
-  glm::vec3 (* texture)(glm::vec2 uv) = NULL; ///< Texture of the object
+  glm::vec3 (* texture)(glm::vec2 uv, glm::vec2 width) = NULL; ///< Texture of the object, filtered over a footprint of the given width
+  int image = -1; ///< Index of an image texture of the context replacing the diffuse color, -1 for none
 };
 
 #endif /* Material_h */
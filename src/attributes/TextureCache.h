@@ -0,0 +1,274 @@
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "TiledTexture.h"
+#include "../../lib/glm.hpp"
+#include "../accel/Parallel.h"
+
+#ifndef TextureCache_h
+#define TextureCache_h
+
+using namespace std;
+
+#define TEXTURE_CACHE_BYTES (64 << 20) ///< Default memory budget of the tile cache
+#define TEXTURE_CACHE_SHARDS_PER_THREAD 4 ///< Independently locked parts of the cache per worker thread
+
+typedef shared_ptr<const vector<unsigned char>> TextureTile; ///< Texels of a tile, kept alive while in use
+
+/**
+ * @brief TextureTileLookup structure
+ *
+ * This structure keeps the tile last fetched by a filter, so that the texels
+ * of its footprint falling in the same tile fetch it once.
+ */
+struct TextureTileLookup {
+	int tile = -1; ///< Index of the tile in its level, -1 before the first fetch
+	TextureTile texels; ///< Texels of the tile, NULL if it cannot be read
+};
+
+/**
+ * @brief TextureCacheShard structure
+ *
+ * This structure is one independently locked part of the tile cache, with its
+ * own least recently used list and byte budget.
+ */
+struct TextureCacheShard {
+	mutex lock; ///< Protects the other members
+	list<uint64_t> order; ///< Keys of the cached tiles, most recently used first
+	unordered_map<uint64_t, pair<TextureTile, list<uint64_t>::iterator>> tiles; ///< Cached tiles and their place in the order
+	size_t bytes = 0; ///< Memory used by the cached tiles
+};
+
+/**
+ * @brief TextureCache class
+ *
+ * This class owns the image textures of a scene and a fixed-size cache of
+ * their tiles, so the memory used stays bounded however large and numerous
+ * the textures are. The cache is split into shards selected by a hash of the
+ * tile, which keeps threads rendering different parts of the image from
+ * contending on a single lock. Tiles are read from disk on a miss and the
+ * least recently used tiles of the shard are evicted.
+ *
+ * Every shard has an equal part of the budget, so there are no more shards
+ * than tiles of the largest texture fitting in it. A budget smaller than a
+ * tile caches nothing, the tiles then only living while they are filtered.
+ */
+class TextureCache {
+private:
+	vector<TiledTexture *> textures; ///< The open texture files
+	size_t capacity = TEXTURE_CACHE_BYTES; ///< Memory budget of all the shards
+	size_t largest_tile = 0; ///< Size of the largest tile of the textures in bytes
+	mutable vector<TextureCacheShard> shards; ///< Parts of the cache
+	mutable atomic<long long> hits{0}; ///< Number of tile lookups found in the cache
+	mutable atomic<long long> misses{0}; ///< Number of tile lookups read from disk
+
+	/**
+	 * @brief Find a tile in the cache or read it from disk
+	 *
+	 * @param texture The index of the texture
+	 * @param level The mip level of the tile
+	 * @param tile The index of the tile in its level
+	 * @return The texels of the tile, or NULL if it cannot be read
+	 */
+	TextureTile fetchTile(int texture, int level, int tile) const {
+		uint64_t key = ((uint64_t)texture << 40) | ((uint64_t)level << 32) | (uint32_t)tile;
+		TextureCacheShard &shard = shards[(key * 0x9E3779B97F4A7C15ULL >> 32) % shards.size()];
+
+		{
+			lock_guard<mutex> guard(shard.lock);
+			auto found = shard.tiles.find(key);
+
+			if (found != shard.tiles.end()) {
+				shard.order.splice(shard.order.begin(), shard.order, found->second.second);
+				hits++;
+				return found->second.first;
+			}
+		}
+
+		// Read outside of the lock so that other lookups of the shard proceed
+		misses++;
+		vector<unsigned char> * texels = new vector<unsigned char>(textures[texture]->tileBytes());
+		TextureTile loaded(texels);
+		if (!textures[texture]->readTile(level, tile, texels->data())) return NULL;
+
+		lock_guard<mutex> guard(shard.lock);
+		auto found = shard.tiles.find(key);
+		if (found != shard.tiles.end()) return found->second.first;
+
+		shard.order.push_front(key);
+		shard.tiles[key] = make_pair(loaded, shard.order.begin());
+		shard.bytes += texels->size();
+
+		size_t budget = capacity / shards.size();
+
+		while (shard.bytes > budget && !shard.order.empty()) {
+			auto evicted = shard.tiles.find(shard.order.back());
+			shard.bytes -= evicted->second.first->size();
+			shard.tiles.erase(evicted);
+			shard.order.pop_back();
+		}
+
+		return loaded;
+	}
+
+	/**
+	 * @brief Empty the cache and split it into as many shards as the budget allows
+	 */
+	void reshard() {
+		size_t count = TEXTURE_CACHE_SHARDS_PER_THREAD * workerCount();
+		if (largest_tile > 0) count = min(count, capacity / largest_tile);
+
+		vector<TextureCacheShard>(max((size_t)1, count)).swap(shards);
+	}
+
+	/**
+	 * @brief Get a texel of a mip level, wrapping the coordinates around
+	 *
+	 * @param lookup The tile last fetched on the same level, replaced if the texel is in another one
+	 */
+	glm::vec3 texel(int texture, int level, int x, int y, TextureTileLookup &lookup) const {
+		const TiledTexture &file = *textures[texture];
+		const TiledTextureLevel &size = file.levels[level];
+		int tile_size = file.header.tile_size;
+
+		x = ((x % size.width) + size.width) % size.width;
+		y = ((y % size.height) + size.height) % size.height;
+
+		int tile = (y / tile_size) * size.tiles_x + x / tile_size;
+
+		if (tile != lookup.tile) {
+			lookup.tile = tile;
+			lookup.texels = fetchTile(texture, level, tile);
+		}
+
+		if (!lookup.texels) return glm::vec3(0.0);
+
+		const unsigned char * value = lookup.texels->data() + 3 * ((y % tile_size) * tile_size + x % tile_size);
+		return glm::vec3(value[0], value[1], value[2]) / 255.0f;
+	}
+
+	/**
+	 * @brief Sample a mip level with bilinear filtering, fetching each tile of the footprint once
+	 */
+	glm::vec3 bilinear(int texture, int level, glm::vec2 uv) const {
+		const TiledTextureLevel &size = textures[texture]->levels[level];
+		float x = uv.s * size.width - 0.5f;
+		float y = uv.t * size.height - 0.5f;
+		int x0 = floor(x), y0 = floor(y);
+		float fx = x - x0, fy = y - y0;
+
+		TextureTileLookup lookup;
+
+		glm::vec3 top = glm::mix(texel(texture, level, x0, y0, lookup), texel(texture, level, x0 + 1, y0, lookup), fx);
+		glm::vec3 bottom = glm::mix(texel(texture, level, x0, y0 + 1, lookup), texel(texture, level, x0 + 1, y0 + 1, lookup), fx);
+
+		return glm::mix(top, bottom, fy);
+	}
+
+public:
+	/**
+	 * @brief Construct an empty TextureCache with the default budget
+	 */
+	TextureCache() : shards(TEXTURE_CACHE_SHARDS_PER_THREAD * workerCount()) {}
+
+	TextureCache(const TextureCache &) = delete;
+	TextureCache & operator=(const TextureCache &) = delete;
+
+	/**
+	 * @brief Destroy the TextureCache object, closing the texture files
+	 */
+	~TextureCache() {
+		for (TiledTexture * texture : textures) delete texture;
+	}
+
+	/**
+	 * @brief Open a tiled texture file, see convertTexture, must not be called while rendering
+	 *
+	 * @param path The path of the file
+	 * @return The index of the texture, or -1 if the file cannot be opened
+	 */
+	int add(const char * path) {
+		TiledTexture * texture = new TiledTexture();
+
+		if (!texture->open(path)) {
+			delete texture;
+			return -1;
+		}
+
+		textures.push_back(texture);
+
+		if ((size_t)texture->tileBytes() > largest_tile) {
+			largest_tile = texture->tileBytes();
+			reshard();
+		}
+
+		return textures.size() - 1;
+	}
+
+	/**
+	 * @brief Set the memory budget of the cache, must not be called while rendering
+	 *
+	 * @param bytes The maximum memory used by the cached tiles
+	 */
+	void setCapacity(size_t bytes) {
+		capacity = bytes;
+		reshard();
+	}
+
+	/**
+	 * @brief Get the number of textures
+	 */
+	int size() const {
+		return textures.size();
+	}
+
+	/**
+	 * @brief Get the fraction of the tile lookups found in the cache
+	 */
+	float hitRate() const {
+		long long total = hits + misses;
+		return total > 0 ? (float)hits / total : 0.0f;
+	}
+
+	/**
+	 * @brief Get the mip level matching a footprint on a texture
+	 *
+	 * @param texture The index of the texture
+	 * @param duvdx The offset of the texture coordinates between neighbouring pixels along x
+	 * @param duvdy The offset of the texture coordinates between neighbouring pixels along y
+	 * @return The level whose texels are as large as the footprint
+	 */
+	float lod(int texture, glm::vec2 duvdx, glm::vec2 duvdy) const {
+		glm::vec2 size(textures[texture]->header.width, textures[texture]->header.height);
+		float extent = max(glm::length(duvdx * size), glm::length(duvdy * size));
+
+		return extent > 1.0f ? log2(extent) : 0.0f;
+	}
+
+	/**
+	 * @brief Sample a texture with trilinear filtering, the texture repeating outside of [0, 1]
+	 *
+	 * @param texture The index of the texture
+	 * @param uv The texture coordinates, u along the width and v along the height
+	 * @param lod The mip level, 0 for the full resolution, fractional levels blending the two nearest ones
+	 * @return The color of the texture
+	 */
+	glm::vec3 sample(int texture, glm::vec2 uv, float lod=0.0) const {
+		int last = textures[texture]->header.levels - 1;
+		lod = glm::clamp(lod, 0.0f, (float)last);
+
+		int level = floor(lod);
+		float blend = lod - level;
+		glm::vec3 color = bilinear(texture, level, uv);
+
+		if (blend > 0.0f && level < last) color = glm::mix(color, bilinear(texture, level + 1, uv), blend);
+
+		return color;
+	}
+};
+
+#endif /* TextureCache_h */
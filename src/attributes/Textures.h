@@ -1,36 +1,110 @@
+#include <cmath>
 #include "../../lib/glm.hpp"
+#include "../math/CPUDispatch.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #ifndef Textures_h
 #define Textures_h
 
+/**
+ * @brief TextureBatch structure
+ *
+ * This structure describes a batch of texture lookups stored as structure of
+ * arrays, evaluated in one call by evaluateTextures.
+ */
+struct TextureBatch {
+  int count = 0; ///< Number of lookups
+  const float * u = NULL; ///< First texture coordinates
+  const float * v = NULL; ///< Second texture coordinates
+  const float * width_u = NULL; ///< Widths of the footprints along u, NULL to point sample
+  const float * width_v = NULL; ///< Widths of the footprints along v, NULL to point sample
+  float * r = NULL; ///< Output red channels
+  float * g = NULL; ///< Output green channels
+  float * b = NULL; ///< Output blue channels
+};
+
+/**
+ * @brief Integral of a periodic stripe pattern
+ *
+ * Integrates from 0 to x the indicator of the stripe k of a pattern made of
+ * period stripes of width 1, i.e. of floor(u) mod period == k.
+ *
+ * @param x The upper bound of the integral
+ * @param period The number of stripes of a period
+ * @param k The stripe
+ * @return The length of the stripe k in [0, x]
+ */
+inline float stripeIntegral(float x, float period, float k) {
+  float periods = floor(x / period);
+
+  return periods + glm::clamp(x - period * periods - k, 0.0f, 1.0f);
+}
+
+/**
+ * @brief Box filtered periodic stripe pattern
+ *
+ * @param x The center of the filter
+ * @param width The width of the filter, positive
+ * @param period The number of stripes of a period
+ * @param k The stripe
+ * @return The fraction of the filter covered by the stripe k
+ */
+inline float filteredStripe(float x, float width, float period, float k) {
+  return (stripeIntegral(x + 0.5f * width, period, k) - stripeIntegral(x - 0.5f * width, period, k)) / width;
+}
+
 /**
  * @brief Checkerboard texture
  * 
  * This function returns the color for each point of a
- * checkerboard texture.
+ * checkerboard texture. With a filter width, the squares are box filtered
+ * analytically over the footprint so that they do not alias.
  * 
  * @param uv  The uv coordinates of the point
+ * @param width The width of the footprint along u and v, zero for a point sample
  * @return The color of the point in the texture
  */
-glm::vec3 checkerboardTexture(glm::vec2 uv) {
+inline glm::vec3 checkerboardTexture(glm::vec2 uv, glm::vec2 width) {
   float n = 20;
-  float value = int(floor(n * uv.s) + floor(2 * n * uv.t)) % 2;
 
-  return glm::vec3(value);
+  if (width.s <= 0.0f || width.t <= 0.0f) {
+    float value = int(floor(n * uv.s) + floor(2 * n * uv.t)) % 2;
+
+    return glm::vec3(value);
+  }
+
+  // The checkerboard is the exclusive or of two stripe patterns
+  float a = filteredStripe(n * uv.s, n * width.s, 2, 1);
+  float b = filteredStripe(2 * n * uv.t, 2 * n * width.t, 2, 1);
+
+  return glm::vec3(a + b - 2 * a * b);
 }
 
 /**
  * @brief Rainbow texture
  * 
  * This function returns the color for each point of a
- * rainbow texture.
+ * rainbow texture. With a filter width, the stripes are box filtered
+ * analytically over the footprint so that they do not alias.
  * 
  * @param uv The uv coordinates of the point
+ * @param width The width of the footprint along u and v, zero for a point sample
  * @return The color of the point in the texture
  */
-glm::vec3 rainbowTexture(glm::vec2 uv) {
+inline glm::vec3 rainbowTexture(glm::vec2 uv, glm::vec2 width) {
   float n = 40;
-  int value = int(floor(n * uv.t + 0.5 * n * uv.s)) % 3;
+  float stripe_width = n * width.t + 0.5f * n * width.s;
+
+  if (stripe_width > 0.0f) {
+    float x = n * uv.t + 0.5f * n * uv.s;
+
+    return glm::vec3(filteredStripe(x, stripe_width, 3, 0), filteredStripe(x, stripe_width, 3, 1), filteredStripe(x, stripe_width, 3, 2));
+  }
+
+  int value = int(floor(n * uv.t + 0.5f * n * uv.s)) % 3;
 
   switch(value){
     case 0:
@@ -42,4 +116,246 @@ glm::vec3 rainbowTexture(glm::vec2 uv) {
   }
 }
 
+#if defined(__SSE2__)
+/**
+ * @brief Round four floats down, SSE2 has no floor instruction
+ *
+ * Saturates to -2^31 from 2^31 in magnitude and for NaNs, like the int
+ * conversion of the scalar textures.
+ */
+inline __m128 floor4(__m128 x) {
+  __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+
+  return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+}
+
+/**
+ * @brief Select the lanes of a where mask is set and those of b elsewhere
+ */
+inline __m128 select4(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/**
+ * @brief Define the batched procedural textures for one vector width
+ *
+ * Defines filteredStripe, checkerboardBatch and rainbowBatch followed by
+ * SUFFIX. Both batches evaluate the lookups [first, count - count % LANES)
+ * with the results of checkerboardTexture and rainbowTexture, and return the
+ * first lookup left. The kernels only differ by the width of the vectors and
+ * by the instructions below, PREFIX and SI naming the intrinsics of the width.
+ *
+ * The floor instruction of SSE4.1 does not saturate like floor4, so the
+ * levels give the same results for finite coordinates below 2^31 / 40 in
+ * magnitude, where every rounded coordinate fits an int.
+ */
+#define TEXTURE_BATCH_KERNELS(SUFFIX, TARGET, LANES, VEC, IVEC, PREFIX, SI, FLOOR, SELECT, CMPGT, CMPEQ) \
+TARGET inline VEC filteredStripe##SUFFIX(VEC x, VEC width, float period, float k) { \
+  VEC half = PREFIX##_mul_ps(PREFIX##_set1_ps(0.5f), width); \
+  VEC bounds[2] = {PREFIX##_add_ps(x, half), PREFIX##_sub_ps(x, half)}; \
+  VEC integral[2]; \
+\
+  for (int i = 0; i < 2; i++) { \
+    VEC periods = FLOOR(PREFIX##_div_ps(bounds[i], PREFIX##_set1_ps(period))); \
+    VEC inside = PREFIX##_sub_ps(PREFIX##_sub_ps(bounds[i], PREFIX##_mul_ps(PREFIX##_set1_ps(period), periods)), PREFIX##_set1_ps(k)); \
+\
+    integral[i] = PREFIX##_add_ps(periods, PREFIX##_min_ps(PREFIX##_max_ps(inside, PREFIX##_setzero_ps()), PREFIX##_set1_ps(1.0f))); \
+  } \
+\
+  return PREFIX##_div_ps(PREFIX##_sub_ps(integral[0], integral[1]), width); \
+} \
+\
+TARGET inline int checkerboardBatch##SUFFIX(const TextureBatch &batch, int first) { \
+  const VEC n = PREFIX##_set1_ps(20); \
+  const IVEC one = PREFIX##_set1_epi32(1); \
+\
+  for (; first + LANES <= batch.count; first += LANES) { \
+    VEC u = PREFIX##_mul_ps(n, PREFIX##_loadu_ps(batch.u + first)); \
+    VEC v = PREFIX##_mul_ps(PREFIX##_add_ps(n, n), PREFIX##_loadu_ps(batch.v + first)); \
+\
+    /* int(a + b) % 2, which is -1 for negative odd sums */ \
+    IVEC sum = PREFIX##_add_epi32(PREFIX##_cvttps_epi32(FLOOR(u)), PREFIX##_cvttps_epi32(FLOOR(v))); \
+    IVEC odd = PREFIX##_and_##SI(sum, one); \
+    IVEC remainder = PREFIX##_or_##SI(odd, PREFIX##_and_##SI(PREFIX##_srai_epi32(sum, 31), PREFIX##_sub_epi32(PREFIX##_setzero_##SI(), odd))); \
+    VEC value = PREFIX##_cvtepi32_ps(remainder); \
+\
+    if (batch.width_u && batch.width_v) { \
+      VEC width_u = PREFIX##_loadu_ps(batch.width_u + first); \
+      VEC width_v = PREFIX##_loadu_ps(batch.width_v + first); \
+      VEC filtered = PREFIX##_and_ps(CMPGT(width_u, PREFIX##_setzero_ps()), CMPGT(width_v, PREFIX##_setzero_ps())); \
+\
+      VEC a = filteredStripe##SUFFIX(u, PREFIX##_mul_ps(n, width_u), 2, 1); \
+      VEC b = filteredStripe##SUFFIX(v, PREFIX##_mul_ps(PREFIX##_add_ps(n, n), width_v), 2, 1); \
+      VEC mixed = PREFIX##_sub_ps(PREFIX##_add_ps(a, b), PREFIX##_mul_ps(PREFIX##_mul_ps(PREFIX##_set1_ps(2), a), b)); \
+\
+      value = SELECT(filtered, mixed, value); \
+    } \
+\
+    PREFIX##_storeu_ps(batch.r + first, value); \
+    PREFIX##_storeu_ps(batch.g + first, value); \
+    PREFIX##_storeu_ps(batch.b + first, value); \
+  } \
+\
+  return first; \
+} \
+\
+TARGET inline int rainbowBatch##SUFFIX(const TextureBatch &batch, int first) { \
+  const VEC n = PREFIX##_set1_ps(40); \
+  const VEC half_n = PREFIX##_mul_ps(PREFIX##_set1_ps(0.5f), n); \
+  const VEC zero = PREFIX##_setzero_ps(); \
+  const VEC one = PREFIX##_set1_ps(1.0f); \
+\
+  for (; first + LANES <= batch.count; first += LANES) { \
+    VEC u = PREFIX##_loadu_ps(batch.u + first); \
+    VEC v = PREFIX##_loadu_ps(batch.v + first); \
+    VEC x = PREFIX##_add_ps(PREFIX##_mul_ps(n, v), PREFIX##_mul_ps(half_n, u)); \
+\
+    /* int(floor(x)) % 3 truncates towards zero, negative remainders fall to blue */ \
+    VEC stripe = FLOOR(x); \
+    VEC quotient = PREFIX##_cvtepi32_ps(PREFIX##_cvttps_epi32(PREFIX##_div_ps(stripe, PREFIX##_set1_ps(3)))); \
+    VEC remainder = PREFIX##_sub_ps(stripe, PREFIX##_mul_ps(PREFIX##_set1_ps(3), quotient)); \
+\
+    VEC red = PREFIX##_and_ps(CMPEQ(remainder, zero), one); \
+    VEC green = PREFIX##_and_ps(CMPEQ(remainder, one), one); \
+    VEC blue = PREFIX##_sub_ps(PREFIX##_sub_ps(one, red), green); \
+\
+    if (batch.width_u && batch.width_v) { \
+      VEC width = PREFIX##_add_ps(PREFIX##_mul_ps(n, PREFIX##_loadu_ps(batch.width_v + first)), PREFIX##_mul_ps(half_n, PREFIX##_loadu_ps(batch.width_u + first))); \
+      VEC filtered = CMPGT(width, zero); \
+\
+      red = SELECT(filtered, filteredStripe##SUFFIX(x, width, 3, 0), red); \
+      green = SELECT(filtered, filteredStripe##SUFFIX(x, width, 3, 1), green); \
+      blue = SELECT(filtered, filteredStripe##SUFFIX(x, width, 3, 2), blue); \
+    } \
+\
+    PREFIX##_storeu_ps(batch.r + first, red); \
+    PREFIX##_storeu_ps(batch.g + first, green); \
+    PREFIX##_storeu_ps(batch.b + first, blue); \
+  } \
+\
+  return first; \
+}
+
+TEXTURE_BATCH_KERNELS(SSE, , 4, __m128, __m128i, _mm, si128, floor4, select4, _mm_cmpgt_ps, _mm_cmpeq_ps)
+#endif
+
+#if defined(CPU_DISPATCH)
+/**
+ * @brief SSE4.1 version of select4, with the blend instruction
+ */
+TARGET_SSE42 inline __m128 select4SSE42(__m128 mask, __m128 a, __m128 b) {
+  return _mm_blendv_ps(b, a, mask);
+}
+
+/**
+ * @brief Round four floats down with the SSE4.1 instruction
+ */
+TARGET_SSE42 inline __m128 floor4SSE42(__m128 x) {
+  return _mm_floor_ps(x);
+}
+
+/**
+ * @brief AVX version of select4
+ */
+TARGET_AVX2 inline __m256 select8(__m256 mask, __m256 a, __m256 b) {
+  return _mm256_blendv_ps(b, a, mask);
+}
+
+/**
+ * @brief Round eight floats down
+ */
+TARGET_AVX2 inline __m256 floor8(__m256 x) {
+  return _mm256_floor_ps(x);
+}
+
+/**
+ * @brief AVX version of _mm_cmpgt_ps
+ */
+TARGET_AVX2 inline __m256 cmpgt8(__m256 a, __m256 b) {
+  return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+}
+
+/**
+ * @brief AVX version of _mm_cmpeq_ps
+ */
+TARGET_AVX2 inline __m256 cmpeq8(__m256 a, __m256 b) {
+  return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);
+}
+
+TEXTURE_BATCH_KERNELS(SSE42, TARGET_SSE42, 4, __m128, __m128i, _mm, si128, floor4SSE42, select4SSE42, _mm_cmpgt_ps, _mm_cmpeq_ps)
+TEXTURE_BATCH_KERNELS(AVX2, TARGET_AVX2, 8, __m256, __m256i, _mm256, si256, floor8, select8, cmpgt8, cmpeq8)
+#endif
+
+/**
+ * @brief Batched checkerboard texture
+ *
+ * Evaluates checkerboardTexture several lookups at a time with the kernel of
+ * the selected instruction set, with the same results.
+ *
+ * @param batch The lookups
+ * @param first The first lookup to evaluate
+ * @return The index of the first lookup left to the scalar code
+ */
+inline int checkerboardTextureBatch(const TextureBatch &batch, int first) {
+#if defined(CPU_DISPATCH)
+  if (active_isa >= ISA_AVX2) first = checkerboardBatchAVX2(batch, first);
+  else if (active_isa == ISA_SSE42) first = checkerboardBatchSSE42(batch, first);
+#endif
+
+#if defined(__SSE2__)
+  first = checkerboardBatchSSE(batch, first);
+#endif
+
+  return first;
+}
+
+/**
+ * @brief Batched rainbow texture
+ *
+ * Evaluates rainbowTexture several lookups at a time with the kernel of the
+ * selected instruction set, with the same results.
+ *
+ * @param batch The lookups
+ * @param first The first lookup to evaluate
+ * @return The index of the first lookup left to the scalar code
+ */
+inline int rainbowTextureBatch(const TextureBatch &batch, int first) {
+#if defined(CPU_DISPATCH)
+  if (active_isa >= ISA_AVX2) first = rainbowBatchAVX2(batch, first);
+  else if (active_isa == ISA_SSE42) first = rainbowBatchSSE42(batch, first);
+#endif
+
+#if defined(__SSE2__)
+  first = rainbowBatchSSE(batch, first);
+#endif
+
+  return first;
+}
+
+/**
+ * @brief Function that evaluates a texture over a batch of lookups
+ *
+ * The procedural textures of this file are evaluated several lookups at a
+ * time with SIMD instructions, other textures and the remaining lookups one
+ * at a time.
+ *
+ * @param texture The texture
+ * @param batch The lookups
+ */
+inline void evaluateTextures(glm::vec3 (* texture)(glm::vec2 uv, glm::vec2 width), const TextureBatch &batch) {
+  int first = 0;
+
+  if (texture == &checkerboardTexture) first = checkerboardTextureBatch(batch, first);
+  else if (texture == &rainbowTexture) first = rainbowTextureBatch(batch, first);
+
+  for (int k = first; k < batch.count; k++) {
+    glm::vec2 width = batch.width_u && batch.width_v ? glm::vec2(batch.width_u[k], batch.width_v[k]) : glm::vec2(0.0);
+    glm::vec3 color = texture(glm::vec2(batch.u[k], batch.v[k]), width);
+
+    batch.r[k] = color.r;
+    batch.g[k] = color.g;
+    batch.b[k] = color.b;
+  }
+}
+
 #endif /* Textures_h */
@@ -0,0 +1,347 @@
+#include <mutex>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include "../../lib/glm.hpp"
+
+#ifndef TiledTexture_h
+#define TiledTexture_h
+
+using namespace std;
+
+#define TILED_TEXTURE_MAGIC 0x58545452 ///< "RTTX" read as a little endian int
+#define TILED_TEXTURE_VERSION 1 ///< Version of the on-disk layout
+#define TILED_TEXTURE_TILE 64 ///< Default width and height of a tile in texels
+
+/**
+ * @brief TiledTextureLevel structure
+ *
+ * This structure describes one mip level of a tiled texture file. Tiles are
+ * stored row by row, each one as tile_size * tile_size RGB texels of one byte
+ * per channel, the tiles on the right and bottom borders being padded by
+ * repeating the last texel.
+ */
+struct TiledTextureLevel {
+	int width; ///< Width of the level in texels
+	int height; ///< Height of the level in texels
+	int tiles_x; ///< Number of tiles in a row
+	int tiles_y; ///< Number of tiles in a column
+	long long offset; ///< Offset of the first tile in the file
+};
+
+/**
+ * @brief TiledTextureHeader structure
+ *
+ * This structure starts a tiled texture file and is followed by the table of
+ * its levels, from the full resolution one down to a single texel.
+ */
+struct TiledTextureHeader {
+	int magic = TILED_TEXTURE_MAGIC; ///< Identifies the file format
+	int version = TILED_TEXTURE_VERSION; ///< Version of the layout
+	int width = 0; ///< Width of the full resolution level
+	int height = 0; ///< Height of the full resolution level
+	int tile_size = TILED_TEXTURE_TILE; ///< Width and height of a tile
+	int levels = 0; ///< Number of mip levels
+};
+
+/**
+ * @brief PPMReader class
+ *
+ * This class reads a binary (P6) or plain (P3) PPM image one row at a time,
+ * so that images larger than the memory can be converted.
+ */
+class PPMReader {
+private:
+	ifstream file; ///< The open image
+	string format; ///< "P3" or "P6"
+	int max_value = 0; ///< Value of a full channel
+	vector<unsigned char> bytes; ///< Bytes of a binary row
+
+public:
+	int width = 0; ///< Width of the image
+	int height = 0; ///< Height of the image
+
+	/**
+	 * @brief Open an image and read its header
+	 *
+	 * @param path The path of the image
+	 * @return False if the file cannot be read or is not a PPM image
+	 */
+	bool open(const char * path) {
+		file.open(path, ios::binary);
+
+		if (!(file >> format >> width >> height >> max_value) || (format != "P3" && format != "P6")) return false;
+		if (width <= 0 || height <= 0 || max_value <= 0 || max_value > 65535) return false;
+
+		if (format == "P6") {
+			file.get();
+			bytes.resize(3 * (size_t)width * (max_value < 256 ? 1 : 2));
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Read the next row of the image
+	 *
+	 * @param row Receives the 3 * width RGB values of the row, in [0, 1]
+	 * @return False if the file ends before the row
+	 */
+	bool readRow(float * row) {
+		if (format == "P3") {
+			for (int x = 0; x < 3 * width; x++) {
+				int value;
+				if (!(file >> value)) return false;
+				row[x] = (float)value / max_value;
+			}
+
+			return true;
+		}
+
+		if (!file.read((char *)bytes.data(), bytes.size())) return false;
+
+		for (int x = 0; x < 3 * width; x++) {
+			int value = max_value < 256 ? bytes[x] : (bytes[2 * x] << 8) | bytes[2 * x + 1];
+			row[x] = (float)value / max_value;
+		}
+
+		return true;
+	}
+};
+
+/**
+ * @brief TiledTextureWriter class
+ *
+ * This class writes the levels of a tiled texture file from the rows of the
+ * full resolution level. Every level keeps the rows of its current row of
+ * tiles, written at their place in the file once complete, and the last
+ * even row, halved with the next one into a row of the level below. The
+ * memory used is a few rows of tiles per level whatever the height.
+ */
+class TiledTextureWriter {
+private:
+	ofstream &file; ///< The file, its header and level table already written
+	const vector<TiledTextureLevel> &levels; ///< The levels of the file, with their offsets
+	int tile_size; ///< Width and height of a tile
+	vector<vector<float>> bands; ///< Rows of the current row of tiles of every level
+	vector<vector<float>> pending; ///< Last even row of every level, waiting for the next one
+	vector<unsigned char> tile; ///< Texels of the tile being written
+
+	/**
+	 * @brief Write a row of tiles, padding the tiles below the last row by repeating it
+	 *
+	 * @param l The level
+	 * @param tile_row The row of tiles
+	 * @param rows The number of rows of the level in the band
+	 */
+	void writeTiles(int l, int tile_row, int rows) {
+		const TiledTextureLevel &level = levels[l];
+		const vector<float> &band = bands[l];
+
+		file.seekp(level.offset + (long long)tile_row * level.tiles_x * tile.size());
+
+		for (int tx = 0; tx < level.tiles_x; tx++) {
+			for (int y = 0; y < tile_size; y++) {
+				for (int x = 0; x < tile_size; x++) {
+					int sx = min(tx * tile_size + x, level.width - 1);
+					int sy = min(y, rows - 1);
+
+					for (int c = 0; c < 3; c++) {
+						float value = glm::clamp(band[3 * ((size_t)sy * level.width + sx) + c], 0.0f, 1.0f);
+						tile[3 * (y * tile_size + x) + c] = (unsigned char)(value * 255.0f + 0.5f);
+					}
+				}
+			}
+
+			file.write((const char *)tile.data(), tile.size());
+		}
+	}
+
+public:
+	/**
+	 * @brief Construct a new TiledTextureWriter
+	 *
+	 * @param file The file, its header and level table already written
+	 * @param levels The levels of the file, with their offsets
+	 * @param tile_size The width and height of a tile
+	 */
+	TiledTextureWriter(ofstream &file, const vector<TiledTextureLevel> &levels, int tile_size): file(file), levels(levels), tile_size(tile_size), bands(levels.size()), pending(levels.size()), tile(3 * (size_t)tile_size * tile_size) {
+		for (size_t l = 0; l < levels.size(); l++) {
+			bands[l].resize(3 * (size_t)tile_size * levels[l].width);
+			pending[l].resize(3 * (size_t)levels[l].width);
+		}
+	}
+
+	/**
+	 * @brief Add the next row of a level, the rows of every level coming in order
+	 *
+	 * Every level halves the previous one with a box filter, the last row and
+	 * column of an odd size being dropped, except for a single one.
+	 *
+	 * @param l The level, 0 for the full resolution one
+	 * @param y The index of the row in the level
+	 * @param row The 3 * width RGB values of the row
+	 */
+	void addRow(int l, int y, const float * row) {
+		const TiledTextureLevel &level = levels[l];
+		int band_row = y % tile_size;
+
+		copy(row, row + 3 * level.width, bands[l].begin() + 3 * (size_t)band_row * level.width);
+		if (band_row == tile_size - 1 || y == level.height - 1) writeTiles(l, y / tile_size, band_row + 1);
+
+		if (l + 1 == (int)levels.size()) return;
+
+		const TiledTextureLevel &next = levels[l + 1];
+		int next_y = y / 2;
+
+		if (next_y >= next.height) return;
+
+		if (y % 2 == 0 && y < level.height - 1) {
+			copy(row, row + 3 * level.width, pending[l].begin());
+			return;
+		}
+
+		// A single row is halved with itself
+		const float * rows[2] = {y % 2 == 0 ? row : pending[l].data(), row};
+		vector<float> reduced(3 * (size_t)next.width);
+
+		for (int x = 0; x < next.width; x++) {
+			for (int c = 0; c < 3; c++) {
+				float sum = 0.0;
+
+				for (int dy = 0; dy < 2; dy++) {
+					for (int dx = 0; dx < 2; dx++) {
+						int sx = min(2 * x + dx, level.width - 1);
+						sum += rows[dy][3 * sx + c];
+					}
+				}
+
+				reduced[3 * x + c] = sum / 4.0f;
+			}
+		}
+
+		addRow(l + 1, next_y, reduced.data());
+	}
+};
+
+/**
+ * @brief Function that converts an image to a tiled, mip-mapped texture file
+ *
+ * Every level halves the previous one with a box filter until a single texel
+ * is left. This is meant to run offline, the renderer then only reads the
+ * tiles it needs. The image is streamed row by row, see TiledTextureWriter.
+ *
+ * @param input The path of a PPM image
+ * @param output The path of the tiled texture file to write
+ * @param tile_size The width and height of a tile in texels
+ * @return False if the image cannot be read or the file cannot be written
+ */
+inline bool convertTexture(const char * input, const char * output, int tile_size=TILED_TEXTURE_TILE) {
+	TiledTextureHeader header;
+	PPMReader image;
+
+	if (tile_size <= 0 || !image.open(input)) return false;
+	header.width = image.width;
+	header.height = image.height;
+	header.tile_size = tile_size;
+
+	vector<TiledTextureLevel> levels;
+	long long tile_bytes = 3LL * tile_size * tile_size;
+	int width = header.width, height = header.height;
+
+	while (true) {
+		TiledTextureLevel level;
+		level.width = width;
+		level.height = height;
+		level.tiles_x = (width + tile_size - 1) / tile_size;
+		level.tiles_y = (height + tile_size - 1) / tile_size;
+		levels.push_back(level);
+
+		if (width == 1 && height == 1) break;
+		width = max(1, width / 2);
+		height = max(1, height / 2);
+	}
+
+	header.levels = levels.size();
+	long long offset = sizeof(header) + levels.size() * sizeof(TiledTextureLevel);
+
+	for (TiledTextureLevel &level : levels) {
+		level.offset = offset;
+		offset += tile_bytes * level.tiles_x * level.tiles_y;
+	}
+
+	ofstream file(output, ios::binary);
+	file.write((const char *)&header, sizeof(header));
+	file.write((const char *)levels.data(), levels.size() * sizeof(TiledTextureLevel));
+
+	TiledTextureWriter writer(file, levels, tile_size);
+	vector<float> row(3 * (size_t)header.width);
+
+	for (int y = 0; y < header.height; y++) {
+		if (!image.readRow(row.data())) return false;
+		writer.addRow(0, y, row.data());
+	}
+
+	return file.good();
+}
+
+/**
+ * @brief TiledTexture class
+ *
+ * This class gives access to the tiles of a tiled texture file without
+ * loading it. Reads are serialized per texture.
+ */
+class TiledTexture {
+private:
+	ifstream file; ///< The open texture file
+	mutex lock; ///< Serializes the seeks and reads of the file
+
+public:
+	TiledTextureHeader header; ///< Header of the file
+	vector<TiledTextureLevel> levels; ///< Levels of the file, the first one at full resolution
+
+	/**
+	 * @brief Open a tiled texture file and read its header
+	 *
+	 * @param path The path of the file
+	 * @return False if the file cannot be read or is not a tiled texture
+	 */
+	bool open(const char * path) {
+		file.open(path, ios::binary);
+
+		if (!file.read((char *)&header, sizeof(header))) return false;
+		if (header.magic != TILED_TEXTURE_MAGIC || header.version != TILED_TEXTURE_VERSION) return false;
+		if (header.levels <= 0 || header.tile_size <= 0 || header.width <= 0 || header.height <= 0) return false;
+
+		levels.resize(header.levels);
+		return (bool)file.read((char *)levels.data(), levels.size() * sizeof(TiledTextureLevel));
+	}
+
+	/**
+	 * @brief Get the size of a tile in bytes
+	 */
+	int tileBytes() const {
+		return 3 * header.tile_size * header.tile_size;
+	}
+
+	/**
+	 * @brief Read a tile from the file
+	 *
+	 * @param level The mip level of the tile
+	 * @param tile The index of the tile in its level, row by row
+	 * @param texels Receives the tileBytes() bytes of the tile
+	 * @return False if the read failed
+	 */
+	bool readTile(int level, int tile, unsigned char * texels) {
+		lock_guard<mutex> guard(lock);
+
+		file.clear();
+		file.seekg(levels[level].offset + (long long)tile * tileBytes());
+		return (bool)file.read((char *)texels, tileBytes());
+	}
+};
+
+#endif /* TiledTexture_h */
@@ -1,55 +1,303 @@
-#include <ctime>
+#include <chrono>
+#include <memory>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include "./Scene.h"
+#include "./Options.h"
+#include "./Benchmark.h"
+#include "./Renderer.h"
+#include "./IncrementalRenderer.h"
+#include "./Distributed.h"
+#include "./Checkpoint.h"
+#include "./StreamingImage.h"
+#include "./Stitch.h"
+#include "./Denoiser.h"
+#include "./PreviewRenderer.h"
 #include "../lib/glm.hpp"
 #include "./shader/Phong.h"
 #include "./primitives/Ray.h"
+#include "./primitives/Camera.h"
 #include "./primitives/Image.h"
 
 using namespace std;
 
+/**
+ * @brief Function that fills and commits a context from the options of a render
+ *
+ * @param context The empty context
+ * @param options The options, see parseOptions
+ */
+static void loadScene(RenderContext &context, const Options &options) {
+	context.textures.setCapacity((size_t)options.texture_cache << 20);
+	context.ray_differentials = options.ray_differentials;
+	context.setFastMath(options.fast_math);
+	context.light_threshold = options.light_threshold;
+	context.light_samples = options.light_samples;
+	context.shadow_cache = options.shadow_cache;
+	context.pixel_order = options.pixel_order;
+	context.tile_size = options.tile_size;
+
+	if (options.positional.size() > 2) {
+		sceneDefinition(context, atof(options.positional[1]), atof(options.positional[2]), options.texture);
+	} else {
+		sceneDefinition(context, 0, 12, options.texture);
+	}
+
+	if (options.lights > 0) scatterLights(context, options.lights);
+
+	if (!options.incremental && options.move_object >= 0 && !moveObject(context, options.move_object, options.move_offset)) {
+		cerr << "There is no object " << options.move_object << " to move." << endl;
+	}
+
+	context.commit(options.builder, options.width, options.precision, options.split_budget);
+}
+
 int main(int argc, const char * argv[]) {
-	clock_t t = clock(); // variable for keeping the time of the rendering
+	auto start = chrono::steady_clock::now(); // variable for keeping the time of the rendering
 	
-	int width = 1024; // width of the image
-	int height = 768; // height of the image
+	Options options = parseOptions(argc, argv);
+	if (!options.valid) return 1;
+
+	int width = options.image_width; // width of the image
+	int height = options.image_height; // height of the image
 	float fov = 90; // field of view
 
-	float pixel_size = (2 * tan((fov / 2) * (M_PI / 180))) / width; // size of the pixels
-	
-	if (argc > 2) {
-		sceneDefinition(atof(argv[2]), atof(argv[3]));
-	} else {
-		sceneDefinition();
+	Camera camera(width, height, fov);
+
+	if (options.convert_input) {
+		if (convertTexture(options.convert_input, options.convert_output)) return 0;
+
+		cerr << "Cannot convert " << options.convert_input << " to " << options.convert_output << "." << endl;
+		return 1;
+	}
+
+	if (setISA(options.isa) != options.isa) {
+		cerr << "The CPU does not support " << isaName(options.isa) << ", using " << isaName(active_isa) << "." << endl;
+	}
+
+	if (options.stitch_output) {
+		if (stitchImages(options.stitch_output, options.positional)) return 0;
+
+		cerr << "Cannot stitch the crops into " << options.stitch_output << "." << endl;
+		return 1;
+	}
+
+	auto load = [](const vector<string> &arguments, RenderContext &context) {
+		vector<const char *> job_argv = {"runner"};
+		for (const string &argument : arguments) job_argv.push_back(argument.c_str());
+
+		Options job = parseOptions(job_argv.size(), job_argv.data());
+		setISA(job.isa);
+		loadScene(context, job);
+	};
+
+	if (!options.worker_host.empty()) return runWorker(options.worker_host.c_str(), options.worker_port, load) ? 0 : 1;
+
+	if (options.coordinator_port >= 0) {
+		// The coordinator does not load the scene, it only assembles the tiles of the workers
+		int port = options.coordinator_port;
+		int listener = listenSocket(port);
+
+		if (listener < 0) {
+			cerr << "Cannot listen on port " << options.coordinator_port << "." << endl;
+			return 1;
+		}
+
+		vector<pid_t> workers = spawnWorkers(listener, options.local_workers, port, load);
+		if (options.verbose) cout << "Coordinating on port " << port << " with " << workers.size() << " local workers." << endl;
+
+		Image image(width, height);
+		DistributedStats stats;
+
+		bool complete = renderDistributed(listener, camera, jobArguments(argc, argv), [&](int i, int j, glm::vec3 color) {
+			image.setPixel(i, j, color);
+		}, stats, options.worker_timeout);
+
+		close(listener);
+		int failed_workers = waitWorkers(workers);
+
+		if (!complete) {
+			cerr << "The workers left before the frame was complete." << endl;
+			return 1;
+		}
+
+		if (failed_workers > 0) {
+			cerr << failed_workers << " of the " << workers.size() << " local workers failed." << endl;
+			return 1;
+		}
+
+		if (options.verbose) {
+			float seconds = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+			cout << "It took " << seconds << " seconds to render the image." << endl;
+			cout << "Rendered " << stats.tiles << " tiles on " << stats.workers << " workers, " << stats.failed << " failed, " << stats.reassigned << " tiles reassigned, " << stats.stolen << " stolen, " << stats.discarded << " results discarded." << endl;
+		}
+
+		image.writeImage("./out/result.ppm");
+		return 0;
+	}
+
+	RenderContext context;
+	loadScene(context, options);
+
+	if (!options.crops.empty()) {
+		// Every crop is an image of its own, which --stitch places back in the frame
+		int pixels = 0;
+
+		for (int k = 0; k < (int)options.crops.size(); k++) {
+			Region region = clipRegion(options.crops[k], width, height);
+
+			if (region.width == 0 || region.height == 0) {
+				cerr << "The crop " << k << " is outside of the " << width << "x" << height << " frame." << endl;
+				continue;
+			}
+
+			Image crop(region.width, region.height);
+
+			renderRegion(context, camera, region, [&](int i, int j, glm::vec3 color) {
+				crop.setPixel(i - region.x, j - region.y, color);
+			});
+
+			crop.writeImage(("./out/result_" + to_string(k) + ".ppm").c_str(), regionComment(region, width, height));
+			pixels += region.width * region.height;
+		}
+
+		if (options.verbose) {
+			float seconds = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+			cout << "It took " << seconds << " seconds to render the image." << endl;
+			cout << "Rendered " << options.crops.size() << " crops, " << pixels << " of the " << width * height << " pixels of the frame." << endl;
+		}
+
+		return 0;
+	}
+
+	if (options.out_of_core) {
+		// Only the tiles in flight are in memory, the image is assembled from the tiled file
+		StreamingImage image("./out/result.tiles", width, height, (size_t)options.memory_cap << 20);
+
+		if (!image.isOpen() || !image.render(context, camera) || !image.writeImage("./out/result.ppm")) {
+			cerr << "Cannot write the out-of-core image " << image.path << "." << endl;
+			return 1;
+		}
+
+		image.remove();
+
+		if (options.verbose) {
+			float seconds = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+			cout << "It took " << seconds << " seconds to render the image." << endl;
+			cout << "Streamed " << image.header.tiles_x * image.header.tiles_y << " tiles through " << options.memory_cap << " MB, at most " << image.peak << " in flight." << endl;
+		}
+
+		return 0;
 	}
 	
 	Image image(width, height);
+	unique_ptr<Checkpoint> checkpoint;
+	float denoise_seconds = -1.0;
+	int preview_shaded = -1;
+
+	if (options.incremental) {
+		// Render the scene, move the object and render again the tiles the move affects
+		IncrementalRenderer renderer(camera, context.tile_size);
+		renderer.render(context);
+
+		if (options.move_object >= 0 && options.move_object < (int)context.objects.size()) {
+			AABB old_bounds = context.objects[options.move_object]->getBounds();
+			moveObject(context, options.move_object, options.move_offset);
+			renderer.objectChanged(context.objects[options.move_object], old_bounds);
+			context.commit(options.builder, options.width, options.precision, options.split_budget);
+		} else if (options.move_object >= 0) {
+			cerr << "There is no object " << options.move_object << " to move." << endl;
+		}
+
+		auto edit_start = chrono::steady_clock::now();
+		renderer.render(context);
+
+		if (options.verbose) {
+			float seconds = chrono::duration<float>(chrono::steady_clock::now() - edit_start).count();
+			cout << "Rendered again " << renderer.rendered << " of " << renderer.tiles_x * renderer.tiles_y << " tiles after the edit in " << seconds << " seconds." << endl;
+		}
 
-	for (int i = 0; i < width; i++) {
 		for (int j = 0; j < height; j++) {
-			float dx = (((- width) * pixel_size) / 2) + (i * pixel_size) + (0.5 * pixel_size);
-			float dy = ((height * pixel_size) / 2) - (j * pixel_size) - (0.5 * pixel_size);
-			
-			glm::vec3 origin = glm::vec3(0.0);
-			glm::vec3 direction = glm::vec3(dx, dy, 1);
+			for (int i = 0; i < width; i++) image.setPixel(i, j, renderer.pixel(i, j));
+		}
+	} else if (options.checkpoint) {
+		checkpoint.reset(new Checkpoint(options.checkpoint, width, height, jobHash(jobArguments(argc, argv))));
 
-			direction = glm::normalize(direction);
+		if (options.resume && !checkpoint->resume()) {
+			cerr << "Cannot resume from " << options.checkpoint << ", starting over." << endl;
+		}
 
-			Ray ray = Ray(origin, direction);
-			image.setPixel(i, j, trace_ray(ray));
+		bool finished = checkpoint->render(context, camera, options.checkpoint_interval, [&](int i, int j, glm::vec3 color) {
+			image.setPixel(i, j, color);
+		}, options.tile_budget);
+
+		// The tile budget is spent, the render goes on from the checkpoint with --resume
+		if (!finished) {
+			if (options.verbose) cout << "Stopped after " << options.tile_budget << " more tiles and saved the checkpoint to " << checkpoint->path << ", resume with --resume." << endl;
+			return 0;
 		}
+	} else if (options.preview > 0) {
+		// Shading at a reduced resolution, upsampled along the full resolution primary hits
+		PreviewRenderer renderer(camera, options.preview);
+		renderer.render(context, [&](int i, int j, glm::vec3 color) {
+			image.setPixel(i, j, color);
+		});
+
+		preview_shaded = renderer.shaded;
+	} else if (options.denoise) {
+		vector<glm::vec3> colors((size_t)width * height);
+		vector<GBufferSample> features((size_t)width * height);
+
+		renderRegion(context, camera, fullRegion(camera), [&](int i, int j, glm::vec3 color) {
+			colors[(size_t)j * width + i] = color;
+		}, features.data());
+
+		auto denoise_start = chrono::steady_clock::now();
+		Denoiser denoiser;
+		denoiser.passes = options.denoise_passes;
+		denoiser.denoise(width, height, colors, features);
+		denoise_seconds = chrono::duration<float>(chrono::steady_clock::now() - denoise_start).count();
+
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) image.setPixel(i, j, colors[(size_t)j * width + i]);
+		}
+	} else {
+		renderRegion(context, camera, fullRegion(camera), [&](int i, int j, glm::vec3 color) {
+			image.setPixel(i, j, color);
+		});
 	}
   
-	for (int i = 0; i < argc ; i++) {
-		if (!strcmp(argv[i], "--verbose") || !strcmp(argv[i], "-v")) {
-			t = clock() - t;
-			cout << "It took " << ((float)t)/CLOCKS_PER_SEC << " seconds to render the image." << endl;
-			cout << "I could render at " << (float)CLOCKS_PER_SEC/((float)t) << " frames per second." << endl;
+	if (options.verbose) {
+		float seconds = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+		BVHBuildStats stats = context.bvh.stats;
+		cout << "It took " << seconds << " seconds to render the image." << endl;
+		cout << "I could render at " << 1.0f / seconds << " frames per second." << endl;
+		cout << "Built the " << builderName(stats.builder) << " BVH" << stats.width << " (" << stats.precision << " bit) over " << stats.primitives << " primitives (" << stats.references << " references, " << stats.nodes << " nodes, " << stats.bytes << " bytes) in " << stats.seconds << " seconds, " << stats.throughput() << " Mprims/s." << endl;
+		cout << "Using the " << isaName(active_isa) << " kernels." << endl;
+		if (context.light_samples > 0) cout << "Sampled " << context.light_samples << " of " << context.lights.size() << " lights per point from a light tree of depth " << context.light_tree.depth << "." << endl;
+		if (context.light_grid.culling) cout << "Light grid of " << context.light_grid.resolution.x << "x" << context.light_grid.resolution.y << "x" << context.light_grid.resolution.z << " cells with " << context.light_grid.size() << " references to " << context.lights.size() << " lights." << endl;
+		if (context.shadow_cache) {
+			ShadowCounters shadows = context.shadowStats();
+			cout << "Shadow occluder cache hit rate: " << 100.0f * context.shadowCacheHitRate() << "% of " << shadows.blocked << " blocked out of " << shadows.rays << " shadow rays." << endl;
 		}
+		if (denoise_seconds >= 0.0f) cout << "Denoised the image in " << denoise_seconds << " seconds with " << options.denoise_passes << " passes." << endl;
+		if (preview_shaded >= 0) cout << "Shaded " << preview_shaded << " of the " << width * height << " pixels at 1/" << options.preview << " resolution." << endl;
+		if (checkpoint) cout << "Resumed " << checkpoint->resumed << " of " << checkpoint->header.tiles << " tiles and wrote " << checkpoint->written << " checkpoints to " << checkpoint->path << "." << endl;
+		if (context.textures.size() > 0) cout << "Texture tile cache hit rate: " << 100.0f * context.textures.hitRate() << "%." << endl;
+	}
+
+	if (options.benchmark) {
+		benchmarkTraversal(camera, context.objects, options.builder);
+		benchmarkMath();
+		benchmarkKernels();
+		benchmarkPixelOrder(context, camera);
 	}
 
 	image.writeImage("./out/result.ppm");
 
+	// The image is saved, the checkpoint is not needed any more
+	if (checkpoint) checkpoint->remove();
+
 	return 0;
 }
@@ -0,0 +1,136 @@
+#include <cstring>
+#include <initializer_list>
+
+#ifndef CPUDispatch_h
+#define CPUDispatch_h
+
+/**
+ * @file CPUDispatch.h
+ * @brief Selection of the SIMD kernels at run time
+ *
+ * The binary is built for the baseline x86-64 instruction set (SSE2). The
+ * kernels that gain from wider vectors are additionally compiled for higher
+ * instruction sets with the target attribute, and the best level supported
+ * by the CPU is picked from CPUID at startup. setISA overrides the choice,
+ * e.g. to compare the kernels on one machine. All the levels compute the
+ * same operations in the same order, so the results do not depend on the
+ * level.
+ *
+ * The dispatched kernels, a level without its own kernel running the one of
+ * the level below:
+ * - box tests of the 8-ary BVH (WideBVH.h): baseline, AVX2 and AVX-512
+ * - procedural texture batches (Textures.h): baseline, SSE4.2 and AVX2, with
+ *   the same results over the range of coordinates given there
+ * - denoiser rows (Denoiser.h): baseline, AVX2 and AVX-512
+ *
+ * The traversals and batches resolve the kernel once per call, not once per
+ * node or lookup. The box tests of the binary and 4-ary BVH are SSE at every
+ * level: a single box test is bound by its latency, and the AVX2 versions
+ * tried were no faster. Tone mapping and image encoding stay scalar: they run
+ * once per pixel, after all the rays of the pixel are traced.
+ *
+ * The SIMD paths of the vendored GLM (lib/simd, lib/detail/func_*_simd.inl)
+ * are not enabled. GLM picks them at compile time from GLM_FORCE_INTRINSICS
+ * and the target flags, so in this baseline build they could only be the SSE2
+ * ones, whatever the CPU. They also only specialise vec4 and mat4, while the
+ * colors, points and normals here are vec3, and they have no pow or cbrt for
+ * the tone mapping. Defining GLM_FORCE_INTRINSICS leaves the images unchanged
+ * and the render time within noise.
+ */
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define CPU_DISPATCH 1 ///< Whether kernels are compiled for several instruction sets
+#define TARGET_SSE42 __attribute__((target("sse4.2"))) ///< Compiles a function for SSE4.2
+#define TARGET_AVX2 __attribute__((target("avx2"))) ///< Compiles a function for AVX2
+#define TARGET_AVX512 __attribute__((target("avx512f"))) ///< Compiles a function for AVX-512
+#endif
+
+// The AVX-512 headers of GCC 12 initialize their undefined registers with
+// themselves (GCC bug 105593), which -Wall reports in every kernel using them
+#if defined(__GNUC__) && !defined(__clang__)
+#define AVX512_WARNINGS_OFF _Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Wuninitialized\"") _Pragma("GCC diagnostic ignored \"-Wmaybe-uninitialized\"") ///< Starts the AVX-512 kernels
+#define AVX512_WARNINGS_ON _Pragma("GCC diagnostic pop") ///< Ends the AVX-512 kernels
+#else
+#define AVX512_WARNINGS_OFF
+#define AVX512_WARNINGS_ON
+#endif
+
+/**
+ * @brief Instruction set levels of the dispatched kernels, from the lowest
+ */
+enum ISALevel {
+	ISA_BASELINE, ///< SSE2, available on every x86-64 CPU
+	ISA_SSE42, ///< SSE4.2
+	ISA_AVX2, ///< AVX2
+	ISA_AVX512 ///< AVX-512 foundation
+};
+
+/**
+ * @brief Get the name of an instruction set level
+ *
+ * @param level The level
+ * @return The name used on the command line
+ */
+inline const char * isaName(ISALevel level) {
+	switch (level) {
+		case ISA_SSE42:
+			return "sse4.2";
+		case ISA_AVX2:
+			return "avx2";
+		case ISA_AVX512:
+			return "avx512";
+		default:
+			return "baseline";
+	}
+}
+
+/**
+ * @brief Parse the name of an instruction set level
+ *
+ * @param name The name used on the command line
+ * @param level Set to the parsed level
+ * @return True if the name is known
+ */
+inline bool parseISA(const char * name, ISALevel &level) {
+	for (ISALevel candidate : {ISA_BASELINE, ISA_SSE42, ISA_AVX2, ISA_AVX512}) {
+		if (!strcmp(name, isaName(candidate))) {
+			level = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief Get the highest instruction set level supported by the CPU and the operating system
+ */
+inline ISALevel detectISA() {
+#if defined(CPU_DISPATCH)
+	// May run before the constructors of libgcc
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f")) return ISA_AVX512;
+	if (__builtin_cpu_supports("avx2")) return ISA_AVX2;
+	if (__builtin_cpu_supports("sse4.2")) return ISA_SSE42;
+#endif
+
+	return ISA_BASELINE;
+}
+
+inline ISALevel active_isa = detectISA(); ///< Level of the kernels in use, see setISA
+
+/**
+ * @brief Select the level of the kernels, must not be called while rendering
+ *
+ * @param level The requested level, lowered to the one supported by the CPU
+ * @return The selected level
+ */
+inline ISALevel setISA(ISALevel level) {
+	ISALevel supported = detectISA();
+	active_isa = level < supported ? level : supported;
+
+	return active_isa;
+}
+
+#endif /* CPUDispatch_h */
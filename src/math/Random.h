@@ -0,0 +1,54 @@
+#include <cstdint>
+#include <cstring>
+#include "../../lib/glm.hpp"
+
+#ifndef Random_h
+#define Random_h
+
+/**
+ * @file Random.h
+ * @brief Counter-based random numbers
+ *
+ * A random number is a hash of a key and a counter rather than the next
+ * state of a generator, so it does not depend on the thread or the order in
+ * which the work is done and renders are reproducible.
+ */
+
+/**
+ * @brief Mix the bits of a 64 bit value, the finalizer of SplitMix64
+ */
+inline uint64_t mixBits(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ULL;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBULL;
+	x ^= x >> 31;
+
+	return x;
+}
+
+/**
+ * @brief Get a key from the coordinates of a point
+ *
+ * @param point The point
+ * @return A hash of the bits of the coordinates
+ */
+inline uint64_t pointKey(glm::vec3 point) {
+	uint32_t bits[3];
+	memcpy(bits, &point, sizeof(bits));
+
+	return mixBits(((uint64_t)bits[0] << 32 | bits[1]) ^ mixBits(bits[2]));
+}
+
+/**
+ * @brief Get the random number of a counter in a stream
+ *
+ * @param key The stream, e.g. a hash of a shading point
+ * @param counter The index of the number in the stream
+ * @return A uniform number in [0, 1)
+ */
+inline float counterRandom(uint64_t key, uint64_t counter) {
+	return (mixBits(key ^ mixBits(counter + 0x9E3779B97F4A7C15ULL)) >> 40) / 16777216.0f;
+}
+
+#endif /* Random_h */
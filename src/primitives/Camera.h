@@ -0,0 +1,73 @@
+#include <cmath>
+#include "Ray.h"
+#include "RayDifferential.h"
+#include "../../lib/glm.hpp"
+
+#ifndef Camera_h
+#define Camera_h
+
+/**
+ * @brief Camera class
+ *
+ * This class represents a pinhole camera placed at the origin and looking
+ * along the z axis, which generates the primary rays of an image.
+ */
+class Camera {
+public:
+	int width; ///< Width of the image in pixels
+	int height; ///< Height of the image in pixels
+	float fov; ///< Horizontal field of view in degrees
+	float pixel_size; ///< Size of the pixels on the image plane at distance 1
+
+	/**
+	 * @brief Construct a new Camera object
+	 *
+	 * @param width The width of the image
+	 * @param height The height of the image
+	 * @param fov The horizontal field of view in degrees
+	 */
+	Camera(int width, int height, float fov=90): width(width), height(height), fov(fov) {
+		pixel_size = (2 * tan((fov / 2) * (M_PI / 180))) / width;
+	}
+
+	/**
+	 * @brief Generate the ray through the center of a pixel
+	 *
+	 * @param i The column of the pixel
+	 * @param j The row of the pixel
+	 * @return The primary ray of the pixel
+	 */
+	Ray generateRay(int i, int j) const {
+		float dx = (((- width) * pixel_size) / 2) + (i * pixel_size) + (0.5 * pixel_size);
+		float dy = ((height * pixel_size) / 2) - (j * pixel_size) - (0.5 * pixel_size);
+
+		glm::vec3 origin = glm::vec3(0.0);
+		glm::vec3 direction = glm::vec3(dx, dy, 1);
+
+		direction = glm::normalize(direction);
+
+		return Ray(origin, direction);
+	}
+
+	/**
+	 * @brief Generate the differential of the ray through the center of a pixel
+	 *
+	 * The auxiliary rays go through the centers of the next pixels along x and y.
+	 *
+	 * @param i The column of the pixel
+	 * @param j The row of the pixel
+	 * @return The differential of the primary ray of the pixel
+	 */
+	RayDifferential generateDifferential(int i, int j) const {
+		RayDifferential differential;
+		glm::vec3 direction = generateRay(i, j).direction;
+
+		differential.valid = true;
+		differential.direction_dx = generateRay(i + 1, j).direction - direction;
+		differential.direction_dy = generateRay(i, j + 1).direction - direction;
+
+		return differential;
+	}
+};
+
+#endif /* Camera_h */
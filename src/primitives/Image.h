@@ -1,3 +1,4 @@
+#include <string>
 #include <fstream>
 #include <iostream>
 #include "../../lib/glm.hpp"
@@ -28,15 +29,27 @@ public:
     data = new int[3 * width * height];
   }
 
+  Image(const Image &) = delete;
+  Image & operator=(const Image &) = delete;
+
+  /**
+   * @brief Destroy the Image object with its data
+   */
+  ~Image() {
+    delete[] data;
+  }
+
   /**
    * @brief Write an image to a ppm file
    * 
    * @param path The path where to save the image
+   * @param comment A comment written in the header, e.g. see regionComment, or empty for none
    */
-  void writeImage(const char *path) {
+  void writeImage(const char *path, const string &comment="") {
     ofstream file;
     file.open(path);
     file << "P3" << endl;
+    if (!comment.empty()) file << "# " << comment << endl;
     file << width << " " << height << endl;
     file << 255 << endl;
 
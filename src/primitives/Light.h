@@ -1,8 +1,13 @@
+#include <cmath>
 #include "../../lib/glm.hpp"
 
 #ifndef Light_h
 #define Light_h
 
+#define LIGHT_ATTENUATION_CONSTANT 1.0f ///< Constant term of the attenuation 1 / (a + b d + c d^2)
+#define LIGHT_ATTENUATION_LINEAR 0.001f ///< Linear term of the attenuation
+#define LIGHT_ATTENUATION_QUADRATIC 0.001f ///< Quadratic term of the attenuation
+
 /**
  * @brief Light class
  * 
@@ -29,6 +34,27 @@ public:
    * @param color The color/intensity of the light source
    */
 	Light(glm::vec3 position, glm::vec3 color): position(position), color(color) {}
+
+  /**
+   * @brief Get the distance beyond which the light cannot contribute more than a threshold
+   * 
+   * The contribution of the light to a point is at most the attenuated
+   * intensity of its brightest channel times the diffuse plus specular
+   * coefficients of the material, the threshold applies to that intensity.
+   * 
+   * @param threshold The smallest contribution that matters, 0 to never cull the light
+   * @return The radius of influence, infinite for a zero threshold and 0 for a light too dim to ever matter
+   */
+	float influenceRadius(float threshold) const {
+		if (threshold <= 0.0f) return INFINITY;
+
+		float ratio = glm::max(color.r, glm::max(color.g, color.b)) / threshold;
+		if (ratio <= LIGHT_ATTENUATION_CONSTANT) return 0.0;
+
+		// Positive root of c d^2 + b d + a - ratio = 0
+		float b = LIGHT_ATTENUATION_LINEAR, c = LIGHT_ATTENUATION_QUADRATIC;
+		return (-b + sqrt(b * b - 4.0f * c * (LIGHT_ATTENUATION_CONSTANT - ratio))) / (2.0f * c);
+	}
 };
 
 #endif /* Light_h */
@@ -1,12 +1,64 @@
 #include "../../lib/glm.hpp"
 #include "../primitives/Ray.h"
-#include "../attributes/Material.h"
+#include "../accel/AABB.h"
+#include "../math/FastMath.h"
 
 #ifndef Object_h
 #define Object_h
 
+using namespace std;
+
 struct Hit;
 
+/**
+ * @brief Function that bounds one coordinate of a transformed unit ball inside a slab
+ *
+ * The ball is mapped to center + (row_j . p, row_k . p) for the coordinates
+ * j and k, |p| <= 1. Writing row_k . p = |row_k| t, the largest value of
+ * row_j . p at a given t is alpha t + w sqrt(1 - t^2), with alpha the
+ * component of row_j along row_k and w the norm of the rest. It is concave
+ * in t, so over the slab it peaks at the unconstrained optimum
+ * t = alpha / |row_j| clamped to the slab; the smallest value likewise.
+ * Used with 3D rows for ellipsoids and 2D rows for elliptic disks.
+ *
+ * @param center_j The center along the bounded coordinate
+ * @param row_j The row of the linear map giving the bounded coordinate
+ * @param center_k The center along the coordinate of the slab
+ * @param row_k The row of the linear map giving the coordinate of the slab
+ * @param low The lower side of the slab
+ * @param high The upper side of the slab
+ * @param min Set to the smallest value of the coordinate inside the slab
+ * @param max Set to the largest value of the coordinate inside the slab
+ * @return False if the slab misses the ball
+ */
+template <typename Vector>
+inline bool ballSlabRange(double center_j, Vector row_j, double center_k, Vector row_k, double low, double high, double &min, double &max) {
+	double norm_j = glm::length(row_j), norm_k = glm::length(row_k);
+
+	if (norm_k == 0.0) {
+		if (center_k < low || center_k > high) return false;
+
+		min = center_j - norm_j;
+		max = center_j + norm_j;
+		return true;
+	}
+
+	double t_low = glm::max(-1.0, (low - center_k) / norm_k);
+	double t_high = glm::min(1.0, (high - center_k) / norm_k);
+	if (t_low > t_high) return false;
+
+	double alpha = glm::dot(row_j, row_k) / norm_k;
+	double rest = sqrt(glm::max(0.0, norm_j * norm_j - alpha * alpha));
+	double optimum = norm_j > 0.0 ? alpha / norm_j : 0.0;
+
+	double t_max = glm::clamp(optimum, t_low, t_high);
+	double t_min = glm::clamp(-optimum, t_low, t_high);
+
+	max = center_j + alpha * t_max + rest * sqrt(glm::max(0.0, 1.0 - t_max * t_max));
+	min = center_j + alpha * t_min - rest * sqrt(glm::max(0.0, 1.0 - t_min * t_min));
+	return true;
+}
+
 /**
  * @brief Object class
  * 
@@ -17,31 +69,124 @@ protected:
 	glm::mat4 transformationMatrix; ///< Matrix representing the transformation from the local to the global coordinate system
 	glm::mat4 inverseTransformationMatrix; ///< Matrix representing the transformation from the global to the local coordinate system
 	glm::mat4 normalMatrix; ///< Matrix for transforming normal vectors from the local to the global coordinate system
+	glm::vec3 boundingCenter = glm::vec3(0.0); ///< Center of a sphere containing the object in global coordinates
+	float boundingRadius = INFINITY; ///< Radius of a sphere containing the object in global coordinates
+
+	/**
+	 * @brief Get a sphere containing the object in local coordinates
+	 *
+	 * @param center Set to the center of the sphere
+	 * @param radius Set to the radius of the sphere
+	 * @return False if the object is not bounded
+	 */
+	virtual bool localBoundingSphere(glm::vec3 &/*center*/, float &/*radius*/) {
+		return false;
+	}
+
+	/**
+	 * @brief Check whether a ray certainly misses the object
+	 *
+	 * Cheap early reject done in global coordinates before the ray is
+	 * transformed and the exact intersection is solved.
+	 *
+	 * @param ray The ray to test
+	 * @return True if the ray misses the bounding sphere or the sphere is behind its origin
+	 */
+	bool missesBoundingSphere(const Ray &ray) {
+		glm::vec3 oc = boundingCenter - ray.origin;
+		float dd = glm::dot(ray.direction, ray.direction);
+		float tca = glm::dot(oc, ray.direction);
+		float distance2 = glm::dot(oc, oc) - tca * tca / dd;
+		float radius2 = boundingRadius * boundingRadius;
+
+		return distance2 > radius2 || (tca < 0 && glm::dot(oc, oc) > radius2);
+	}
+
 	
 public:
 	glm::vec3 color; ///< Color of the object
-	Material material; ///< Structure describing the material of the object
+	int material = 0; ///< Index of the material of the object in the material table of its context
+	bool fast_math = false; ///< Use the approximations of FastMath.h in intersect, see RenderContext::setFastMath
+
+	virtual ~Object() {}
 
 	virtual Hit intersect(Ray ray) = 0;
 
 	/**
-	 * @brief Get the Material object
+	 * @brief Get the bounding box of the object in global coordinates
+	 *
+	 * Objects that are not bounded (e.g. planes) keep the default infinite box
+	 * and are tested outside of the acceleration structure.
+	 *
+	 * @return The bounding box of the object
+	 */
+	virtual AABB getBounds() {
+		return AABB(glm::vec3(-INFINITY), glm::vec3(INFINITY));
+	}
+
+	/**
+	 * @brief Get the bounding box of the part of the object inside a box
+	 *
+	 * Used by spatial split builders to clip straddling objects. The default
+	 * intersects the bounds of the object with the box.
+	 *
+	 * @param box The clipping box in global coordinates
+	 * @return A box containing the part of the object inside the clipping box
+	 */
+	virtual AABB clipBounds(AABB box) {
+		AABB bounds = getBounds();
+
+		return AABB(glm::max(bounds.min, box.min), glm::min(bounds.max, box.max));
+	}
+
+protected:
+	/**
+	 * @brief Round clipped bounds computed in double precision outward, then restrict them to the clipping box
+	 *
+	 * @param min The lower corner of the clipped part, min > max along an axis if it is empty
+	 * @param max The upper corner of the clipped part
+	 * @param box The clipping box
+	 * @return The clipped bounds, empty if the part is
+	 */
+	static AABB clippedBox(glm::dvec3 min, glm::dvec3 max, const AABB &box) {
+		if (glm::any(glm::greaterThan(min, max))) return AABB();
+
+		glm::dvec3 margin = 1e-6 * (glm::abs(min) + glm::abs(max) + (max - min));
+		glm::vec3 low = glm::max(glm::vec3(min - margin), box.min);
+		glm::vec3 high = glm::min(glm::vec3(max + margin), box.max);
+
+		return glm::any(glm::greaterThan(low, high)) ? AABB() : AABB(low, high);
+	}
+
+public:
+
+	/**
+	 * @brief Get the material of the object
 	 * 
-	 * @return The material of the object
+	 * @return The index of the material in the material table
 	 */
-	Material getMaterial() {
+	int getMaterial() const {
 		return material;
 	}
 
   /**
-   * @brief Set the Material object
+   * @brief Set the material of the object
    * 
-   * @param material The material of the object
+   * @param material The index of the material in the material table
    */
-	void setMaterial(Material material) {
+	void setMaterial(int material) {
 		this->material = material;
 	}
 
+  /**
+   * @brief Get the transformation of the object
+   * 
+   * @return The matrix from the local to the global coordinates
+   */
+	glm::mat4 getTransformation() const {
+		return transformationMatrix;
+	}
+
   /**
    * @brief Set the Transformation matices
    * 
@@ -51,6 +196,26 @@ public:
 		transformationMatrix = matrix;
 		inverseTransformationMatrix = glm::inverse(matrix);
 		normalMatrix = glm::transpose(inverseTransformationMatrix);
+
+		glm::vec3 center;
+		float radius;
+
+		if (localBoundingSphere(center, radius)) {
+			// A radius is stretched by at most the largest singular value of the linear part,
+			// which both the Frobenius norm and sqrt(|M|_1 |M|_inf) bound from above
+			glm::mat3 linear(matrix);
+			float frobenius2 = 0.0, columns = 0.0, rows = 0.0;
+
+			for (int i = 0; i < 3; i++) {
+				frobenius2 += glm::dot(linear[i], linear[i]);
+				columns = max(columns, fabsf(linear[i][0]) + fabsf(linear[i][1]) + fabsf(linear[i][2]));
+				rows = max(rows, fabsf(linear[0][i]) + fabsf(linear[1][i]) + fabsf(linear[2][i]));
+			}
+
+			// The margin covers the rounding of missesBoundingSphere when the bound is tight
+			boundingCenter = matrix * glm::vec4(center, 1.0);
+			boundingRadius = radius * sqrt(min(frobenius2, columns * rows)) * 1.0001f;
+		}
 	}
 };
 
@@ -65,6 +230,7 @@ struct Hit {
 	glm::vec3 intersection; ///< Point of Intersection
 	float distance; ///< Distance from the origin of the ray to the intersection point
 	Object *object; ///< A pointer to the intersected object
+	int material; ///< Index of the material of the intersected object in the material table
 	glm::vec2 uv; ///< Coordinates for computing the texture
 };
 
@@ -0,0 +1,152 @@
+#include <cmath>
+#include "Ray.h"
+#include "Object.h"
+#include "../../lib/glm.hpp"
+
+#ifndef RayDifferential_h
+#define RayDifferential_h
+
+/**
+ * @brief RayDifferential structure
+ *
+ * This structure describes the footprint of a ray as two auxiliary rays, the
+ * rays of the neighbouring pixels along x and y, given by their offsets from
+ * the main ray. The footprint grows with the distance and through curved
+ * mirrors and glass, and tells how large an area a texture lookup covers.
+ */
+struct RayDifferential {
+	bool valid = false; ///< Whether the offsets are known, otherwise lookups are point sampled
+	glm::vec3 origin_dx = glm::vec3(0.0); ///< Offset of the origin of the auxiliary ray along x
+	glm::vec3 origin_dy = glm::vec3(0.0); ///< Offset of the origin of the auxiliary ray along y
+	glm::vec3 direction_dx = glm::vec3(0.0); ///< Offset of the direction of the auxiliary ray along x
+	glm::vec3 direction_dy = glm::vec3(0.0); ///< Offset of the direction of the auxiliary ray along y
+};
+
+/**
+ * @brief SurfaceFootprint structure
+ *
+ * This structure is the footprint of a ray differential on the surface it
+ * hits: how the hit point, its normal and its texture coordinates change from
+ * the main ray to the auxiliary rays.
+ */
+struct SurfaceFootprint {
+	glm::vec3 dpdx = glm::vec3(0.0); ///< Offset of the hit point along x
+	glm::vec3 dpdy = glm::vec3(0.0); ///< Offset of the hit point along y
+	glm::vec3 dndx = glm::vec3(0.0); ///< Offset of the normal along x
+	glm::vec3 dndy = glm::vec3(0.0); ///< Offset of the normal along y
+	glm::vec2 duvdx = glm::vec2(0.0); ///< Offset of the texture coordinates along x
+	glm::vec2 duvdy = glm::vec2(0.0); ///< Offset of the texture coordinates along y
+};
+
+/**
+ * @brief Function that finds where an auxiliary ray hits the surface of a hit
+ *
+ * The auxiliary ray is intersected with the object that the main ray hit,
+ * which follows its curvature exactly. Near silhouettes, where it misses the
+ * object, it is intersected with the tangent plane at the hit instead.
+ *
+ * @param hit The hit of the main ray
+ * @param ray The main ray
+ * @param origin_offset The offset of the origin of the auxiliary ray
+ * @param direction_offset The offset of the direction of the auxiliary ray
+ * @param dp Set to the offset of the hit point
+ * @param dn Set to the offset of the normal
+ * @param duv Set to the offset of the texture coordinates
+ */
+inline void offsetHit(const Hit &hit, const Ray &ray, glm::vec3 origin_offset, glm::vec3 direction_offset, glm::vec3 &dp, glm::vec3 &dn, glm::vec2 &duv) {
+	Ray offset_ray(ray.origin + origin_offset, glm::normalize(ray.direction + direction_offset));
+	Hit offset_hit = hit.object->intersect(offset_ray);
+
+	if (offset_hit.hit) {
+		dp = offset_hit.intersection - hit.intersection;
+		dn = offset_hit.normal - hit.normal;
+		duv = offset_hit.uv - hit.uv;
+
+		// Texture coordinates wrap around, keep the shortest offset
+		duv -= glm::round(duv);
+		return;
+	}
+
+	float denominator = glm::dot(offset_ray.direction, hit.normal);
+	float t = denominator != 0.0f ? glm::dot(hit.intersection - offset_ray.origin, hit.normal) / denominator : 0.0f;
+
+	dp = t > 0.0f ? offset_ray.origin + t * offset_ray.direction - hit.intersection : glm::vec3(0.0);
+	dn = glm::vec3(0.0);
+	duv = glm::vec2(0.0);
+}
+
+/**
+ * @brief Function that computes the footprint of a ray differential on the surface it hits
+ *
+ * @param ray The main ray
+ * @param differential The differential of the ray
+ * @param hit The hit of the main ray
+ * @return The footprint, zero if the differential is not valid
+ */
+inline SurfaceFootprint surfaceFootprint(const Ray &ray, const RayDifferential &differential, const Hit &hit) {
+	SurfaceFootprint footprint;
+
+	if (!differential.valid) return footprint;
+
+	offsetHit(hit, ray, differential.origin_dx, differential.direction_dx, footprint.dpdx, footprint.dndx, footprint.duvdx);
+	offsetHit(hit, ray, differential.origin_dy, differential.direction_dy, footprint.dpdy, footprint.dndy, footprint.duvdy);
+
+	return footprint;
+}
+
+/**
+ * @brief Function that carries a ray differential through a mirror reflection
+ *
+ * @param direction The normalized direction of the incoming ray
+ * @param normal The normal at the hit
+ * @param incoming The differential of the incoming ray
+ * @param footprint The footprint of the incoming ray at the hit
+ * @return The differential of the reflected ray
+ */
+inline RayDifferential reflectDifferential(glm::vec3 direction, glm::vec3 normal, const RayDifferential &incoming, const SurfaceFootprint &footprint) {
+	RayDifferential reflected;
+
+	if (!incoming.valid) return reflected;
+
+	glm::vec3 base = glm::normalize(glm::reflect(direction, normal));
+	glm::vec3 aux_x = glm::normalize(glm::reflect(glm::normalize(direction + incoming.direction_dx), glm::normalize(normal + footprint.dndx)));
+	glm::vec3 aux_y = glm::normalize(glm::reflect(glm::normalize(direction + incoming.direction_dy), glm::normalize(normal + footprint.dndy)));
+
+	reflected.valid = true;
+	reflected.origin_dx = footprint.dpdx;
+	reflected.origin_dy = footprint.dpdy;
+	reflected.direction_dx = aux_x - base;
+	reflected.direction_dy = aux_y - base;
+
+	return reflected;
+}
+
+/**
+ * @brief Function that carries a ray differential into a ray transmitted along the normal
+ *
+ * Transmitted rays are traced against the normal on the side they enter, so
+ * their directions spread as much as the normals of the footprint.
+ *
+ * @param normal The normal at the hit
+ * @param is_inside Whether the incoming ray is inside the object, the transmitted ray then leaving along the normal
+ * @param incoming The differential of the incoming ray
+ * @param footprint The footprint of the incoming ray at the hit
+ * @return The differential of the transmitted ray
+ */
+inline RayDifferential transmitDifferential(glm::vec3 normal, bool is_inside, const RayDifferential &incoming, const SurfaceFootprint &footprint) {
+	RayDifferential transmitted;
+
+	if (!incoming.valid) return transmitted;
+
+	float side = is_inside ? -1.0f : 1.0f;
+
+	transmitted.valid = true;
+	transmitted.origin_dx = footprint.dpdx;
+	transmitted.origin_dy = footprint.dpdy;
+	transmitted.direction_dx = side * (normal - glm::normalize(normal + footprint.dndx));
+	transmitted.direction_dy = side * (normal - glm::normalize(normal + footprint.dndy));
+
+	return transmitted;
+}
+
+#endif /* RayDifferential_h */
@@ -10,9 +10,17 @@ using namespace std;
  * @param beta_2 The delta of the second material
  * @param cos_1 The cosine of the angle of the original direction
  * @param cos_2 The cosine of the angle of the refracted ray
+ * @param fast_math Whether to square by products rather than through pow
  * @return The Fresnel Effect
  */
-float compute_fresnel(float beta_1, float beta_2, float cos_1, float cos_2) {
+inline float compute_fresnel(float beta_1, float beta_2, float cos_1, float cos_2, bool fast_math=false) {
+	if (fast_math) {
+		float ratio_1 = (beta_1 * cos_1 - beta_2 * cos_2) / (beta_1 * cos_1 + beta_2 * cos_2);
+		float ratio_2 = (beta_1 * cos_2 - beta_2 * cos_1) / (beta_1 * cos_2 + beta_2 * cos_1);
+
+		return 0.5f * (ratio_1 * ratio_1 + ratio_2 * ratio_2);
+	}
+
 	float part_1 = pow((beta_1 * cos_1 - beta_2 * cos_2) / (beta_1 * cos_1 + beta_2 * cos_2), 2);
 	float part_2 = pow((beta_1 * cos_2 - beta_2 * cos_1) / (beta_1 * cos_2 + beta_2 * cos_1), 2);
 
@@ -0,0 +1,34 @@
+#include "../../lib/glm.hpp"
+#include "../primitives/Object.h"
+
+#ifndef GBuffer_h
+#define GBuffer_h
+
+/**
+ * @brief GBufferSample structure
+ *
+ * This structure holds the features of the primary hit of a pixel, which
+ * guide the filters applied to the image after the render. Pixels whose
+ * primary ray misses the scene keep the default values.
+ */
+struct GBufferSample {
+	glm::vec3 normal = glm::vec3(0.0); ///< Normal of the surface at the hit
+	float depth = 0.0; ///< Distance from the camera to the hit, 0 for no hit
+	glm::vec3 albedo = glm::vec3(0.0); ///< Diffuse color of the surface, white for mirrors and glass
+	const Object * object = NULL; ///< The object hit
+};
+
+/**
+ * @brief Get the sample the next traced ray of the calling thread records its hit into
+ *
+ * trace_ray fills the sample and resets the pointer, so that only the
+ * primary ray of a pixel is recorded, see renderPixel.
+ *
+ * @return A reference to the sample pointer, NULL when nothing is recorded
+ */
+inline GBufferSample *& gbufferSample() {
+	thread_local GBufferSample * sample = NULL;
+	return sample;
+}
+
+#endif /* GBuffer_h */
@@ -1,29 +1,52 @@
 #include <vector>
 #include "Shadows.h"
 #include "Fresnel.h"
+#include "GBuffer.h"
 #include "ToneMapping.h"
 #include "../../lib/glm.hpp"
+#include "../math/Random.h"
+#include "../accel/DependencyGrid.h"
 #include "../primitives/Ray.h"
 #include "../primitives/Light.h"
 #include "../primitives/Object.h"
+#include "../primitives/RayDifferential.h"
 
 #ifndef Phong_h
 #define Phong_h
 
-glm::vec3 trace_ray(Ray ray, bool is_inside=false);
+inline glm::vec3 trace_ray(const RenderContext &context, Ray ray, bool is_inside=false, const RayDifferential &differential=RayDifferential());
+
+/**
+ * @brief Function that computes the diffuse color of a point, from the texture of its material if any
+ *
+ * @param context The scene being rendered
+ * @param material The material of the object
+ * @param uv Texture coordinates
+ * @param footprint The footprint of the differential at the point, used to filter the textures
+ * @return The diffuse color
+ */
+inline glm::vec3 surfaceAlbedo(const RenderContext &context, const Material &material, glm::vec2 uv, const SurfaceFootprint &footprint) {
+	if (material.image >= 0) return context.textures.sample(material.image, uv, context.textures.lod(material.image, footprint.duvdx, footprint.duvdy));
+	if (material.texture != NULL) return material.texture(uv, glm::max(glm::abs(footprint.duvdx), glm::abs(footprint.duvdy)));
+
+	return material.diffuse;
+}
 
 /**
  * @brief Function that computes the color of a point based on the Phong Model
  * 
+ * @param context The scene being rendered
  * @param point A point belonging to the object for which the color is computed
  * @param normal A normal vector at the point
  * @param uv Texture coordinates
  * @param view_direction A normalized direction from the point to the viewer/camera
- * @param material A material structure representing the material of the object
+ * @param material The material of the object, in the material table of the context
  * @param is_inside	Flag to check if the ray is inside or outside the object
+ * @param differential The differential of the ray that hit the point
+ * @param footprint The footprint of the differential at the point, used to filter the textures
  * @return The color of the point
  */
-glm::vec3 PhongModel(glm::vec3 point, glm::vec3 normal, glm::vec2 uv, glm::vec3 view_direction, Material material, bool is_inside) {
+inline glm::vec3 PhongModel(const RenderContext &context, glm::vec3 point, glm::vec3 normal, glm::vec2 uv, glm::vec3 view_direction, const Material &material, bool is_inside, const RayDifferential &differential, const SurfaceFootprint &footprint) {
 	glm::vec3 color = glm::vec3(0.0);
 	float epsilon = 0.001;
 
@@ -33,7 +56,7 @@ glm::vec3 PhongModel(glm::vec3 point, glm::vec3 normal, glm::vec2 uv, glm::vec3
 
 		Ray reflected_ray = Ray(point + epsilon * reflected_vec, reflected_vec);
 
-		return trace_ray(reflected_ray) * material.reflectiveness;
+		return trace_ray(context, reflected_ray, false, reflectDifferential(-view_direction, normal, differential, footprint)) * material.reflectiveness;
 	} else if (material.is_refractive) {
 		float beta = is_inside ? material.delta : 1.0f / material.delta;
 		float beta_2 = is_inside ? 1.0f / material.delta: material.delta;
@@ -52,21 +75,25 @@ glm::vec3 PhongModel(glm::vec3 point, glm::vec3 normal, glm::vec2 uv, glm::vec3
 
 		float cos_1 = glm::dot(-direction_to_refract, normal_to_refract);
 		float cos_2 = glm::dot(refracted_vec, -normal_to_refract);
-		float fresnel = compute_fresnel(beta, beta_2, cos_1, cos_2);
+		float fresnel = compute_fresnel(beta, beta_2, cos_1, cos_2, context.fast_math);
 
-		glm::vec3 refracted_color = fresnel < 1.0f ? trace_ray(refracted_ray, !is_inside) : glm::vec3(0.0);
-		glm::vec3 reflected_color = trace_ray(reflected_ray);
+		glm::vec3 refracted_color = fresnel < 1.0f ? trace_ray(context, refracted_ray, !is_inside, transmitDifferential(normal, is_inside, differential, footprint)) : glm::vec3(0.0);
+		glm::vec3 reflected_color = trace_ray(context, reflected_ray, false, reflectDifferential(-view_direction, normal, differential, footprint));
 
 		return reflected_color * fresnel + refracted_color * (1 - fresnel);
 	} else {
-		color += material.ambient * ambient_light;
+		color += material.ambient * context.ambient_light;
 
-		for (Light * source : lights) {
+		// The texture does not depend on the light, look it up once per point
+		glm::vec3 albedo = surfaceAlbedo(context, material, uv, footprint);
+
+		auto contribution = [&](int light) {
+			const Light * source = context.lights[light];
 			glm::vec3 diffuse;
 
-			float att_a = 1.0;
-			float att_b = 0.001;
-			float att_c = 0.001;
+			float att_a = LIGHT_ATTENUATION_CONSTANT;
+			float att_b = LIGHT_ATTENUATION_LINEAR;
+			float att_c = LIGHT_ATTENUATION_QUADRATIC;
 
 			glm::vec3 normal_source = glm::normalize(source->position - point);
 			glm::vec3 reflected = glm::normalize(2.0f * normal * glm::dot(normal, normal_source) - normal_source);
@@ -74,53 +101,80 @@ glm::vec3 PhongModel(glm::vec3 point, glm::vec3 normal, glm::vec2 uv, glm::vec3
 			float is_occluded = glm::dot(normal_source, normal) < 0 ? 0.0 : 1.0;
 
 			Ray shadow_ray(point + epsilon * normal_source, normal_source);
-			if (is_occluded == 1.0) is_occluded = compute_shadow(shadow_ray, source, point);
+			if (is_occluded == 1.0) is_occluded = compute_shadow(context, shadow_ray, light, point);
 
 			float cos_alpha = glm::dot(reflected, view_direction) >= 0.0f ? glm::dot(reflected, view_direction) : 0.0;
 			float cos_phi = glm::dot(normal, normal_source) >= 0.0f ? glm::dot(normal, normal_source) : 0.0;
 			float distance = glm::distance(source->position, point);
 
-			if (material.texture != NULL) {
-				diffuse = material.texture(uv) * cos_phi;
-			} else {
-				diffuse = material.diffuse * cos_phi;
-			}
-
+			diffuse = albedo * cos_phi;
 			glm::vec3 specular = material.specular * pow(cos_alpha, material.shininess);
-			float attenuation = 1 / (att_a + (att_b * distance) + (att_c * pow(distance, 2)));
 
-			color += ((diffuse + specular) * source->color * attenuation) * is_occluded;
+			float attenuation = context.fast_math
+				? 1 / (att_a + (att_b * distance) + (att_c * distance * distance))
+				: 1 / (att_a + (att_b * distance) + (att_c * pow(distance, 2)));
+
+			return ((diffuse + specular) * source->color * attenuation) * is_occluded;
+		};
+
+		if (context.light_samples > 0 && context.light_samples < (int)context.lights.size()) {
+			// A few lights picked by importance, weighted by their probability to keep the estimate unbiased
+			uint64_t key = pointKey(point);
+
+			for (int k = 0; k < context.light_samples; k++) {
+				float probability;
+				int light = context.light_tree.sample(point, normal, key, k, probability);
+
+				if (light >= 0) color += contribution(light) / (context.light_samples * probability);
+			}
+		} else {
+			// Only the lights that can contribute more than the threshold, in the same order as context.lights
+			context.light_grid.visit(context.lights, point, [&](int light) {
+				color += contribution(light);
+			});
 		}
 
-		return toneMapping(color);
+		return toneMapping(color, context.fast_math);
 	}
 }
 
 /**
  * @brief Function that traces all the rays and computes the colors of the pixels
  * 
+ * @param context The scene being rendered
  * @param ray A ray to be traced
  * @param is_inside Flag to check if the ray is inside or outside the object
+ * @param differential The differential of the ray, invalid to point sample the textures
  * @return The color of the pixel
  */
-glm::vec3 trace_ray(Ray ray, bool is_inside) {
-	Hit closest_hit;
+inline glm::vec3 trace_ray(const RenderContext &context, Ray ray, bool is_inside, const RayDifferential &differential) {
+	Hit closest_hit = context.bvh.intersect(ray, context.objects);
 
-	closest_hit.hit = false;
-	closest_hit.distance = INFINITY;
-	
-	for (int k = 0; k < objects.size(); k++) {
-		Hit hit = objects[k]->intersect(ray);
+	// Only the first ray traced for a pixel fills its G-buffer sample
+	GBufferSample * sample = gbufferSample();
+	if (sample) gbufferSample() = NULL;
+
+	if (DependencyRecorder * recorder = dependencyRecorder()) recorder->record(ray, closest_hit.hit ? closest_hit.distance : INFINITY, closest_hit.hit ? closest_hit.object : NULL);
 
-		if (hit.hit == true && hit.distance < closest_hit.distance) {
-			closest_hit = hit;
-		}
-	}
-	
 	glm::vec3 color(0.0);
 
-	if (closest_hit.hit)
-		color = PhongModel(closest_hit.intersection, closest_hit.normal, closest_hit.uv, glm::normalize(-ray.direction), closest_hit.object->getMaterial(), is_inside);
+	if (closest_hit.hit) {
+		const Material &material = context.getMaterial(closest_hit.material);
+		SurfaceFootprint footprint;
+
+		// The footprint costs two intersections, only compute it where it is used
+		if (material.texture != NULL || material.image >= 0 || material.is_reflective || material.is_refractive)
+			footprint = surfaceFootprint(ray, differential, closest_hit);
+
+		if (sample) {
+			sample->normal = closest_hit.normal;
+			sample->depth = closest_hit.distance;
+			sample->albedo = material.is_reflective || material.is_refractive ? glm::vec3(1.0) : surfaceAlbedo(context, material, closest_hit.uv, footprint);
+			sample->object = closest_hit.object;
+		}
+
+		color = PhongModel(context, closest_hit.intersection, closest_hit.normal, closest_hit.uv, glm::normalize(-ray.direction), material, is_inside, differential, footprint);
+	}
 
 	return color;
 }
@@ -1,42 +1,141 @@
+#include <memory>
 #include <vector>
 #include "../../lib/glm.hpp"
 #include "../primitives/Ray.h"
 #include "../primitives/Light.h"
 #include "../primitives/Object.h"
+#include "../RenderContext.h"
+#include "../accel/DependencyGrid.h"
 
 #ifndef Shadows_h
 #define Shadows_h
 
 using namespace std;
 
-vector<Light *> lights; ///< A list of lights in the scene
-vector<Object *> objects; ///< A list of all objects in the scene
-glm::vec3 ambient_light(1.0, 1.0, 1.0);
+/**
+ * @brief OccluderCache structure
+ *
+ * This structure remembers, for one thread and every light, the opaque
+ * object that blocked the last shadow ray, if any. Neighbouring points are usually
+ * shadowed by the same object, which is then tested before traversing the
+ * BVH. The cache only gives candidates that are intersected again, so stale
+ * entries cost a test but never change the result.
+ *
+ * The shadow rays are counted in counters of the thread, summed by
+ * RenderContext::shadowStats after the render.
+ */
+struct OccluderCache {
+	shared_ptr<ShadowCounterPool> pool; ///< The counter pool of the context the entries refer to
+	ShadowCounters * counters = NULL; ///< The counters of the thread, taken from the pool
+	vector<int> occluders; ///< Index of the last opaque occluder of every light, -1 for none
+
+	OccluderCache() {}
+	OccluderCache(const OccluderCache &) = delete;
+	OccluderCache & operator=(const OccluderCache &) = delete;
+
+	/**
+	 * @brief Give the counters back to the pool when the thread exits
+	 */
+	~OccluderCache() {
+		if (pool) pool->release(counters);
+	}
+};
+
+/**
+ * @brief Get the occluder cache of the calling thread for a context
+ *
+ * The cache holds the counter pool of the context, which identifies the
+ * context even once its address is reused.
+ *
+ * @param context The scene being rendered
+ * @return The cache, emptied if it was used for another context or light count
+ */
+inline OccluderCache & occluderCache(const RenderContext &context) {
+	thread_local OccluderCache cache;
+
+	if (cache.pool != context.shadow_counters) {
+		if (cache.pool) cache.pool->release(cache.counters);
+
+		cache.pool = context.shadow_counters;
+		cache.counters = cache.pool->acquire();
+		cache.occluders.clear();
+	}
+
+	if (cache.occluders.size() != context.lights.size()) cache.occluders.assign(context.lights.size(), -1);
+
+	return cache;
+}
 
 /**
  * @brief Function that checks if an object occludes the light source
  * 
+ * @param context The scene being rendered
  * @param ray A ray from the object to the light source
- * @param source The light source
+ * @param light The index of the light source in the context
  * @param intersection The intersection point of the object
- * @return retuns the amount of light that is not blocked by the object 
+ * @return 0 if an opaque object blocks the light, 0.4 if only refractive objects do, 1 otherwise
+ *
+ * An opaque blocker gives 0 wherever it is, so the traversal stops at the
+ * first one found. The first blocker of the object list used to decide
+ * alone, so an opaque object behind a refractive one listed before it gave
+ * 0.4.
  */
-float compute_shadow(Ray ray, Light * source, glm::vec3 intersection) {
-	vector<Object *> objs = objects;
-	float light_distance = glm::distance(intersection, source->position);
-	
-	for (int k = 0; k < objs.size(); k++) {
-		Hit hit = objs[k]->intersect(ray);
+inline float compute_shadow(const RenderContext &context, Ray ray, int light, glm::vec3 intersection) {
+	float light_distance = glm::distance(intersection, context.lights[light]->position);
+	float visibility = 1.0;
+
+	DependencyRecorder * recorder = dependencyRecorder();
+	if (recorder) recorder->record(ray, light_distance, NULL);
+
+	auto blocks = [&](int k, Hit &hit) {
+		hit = context.objects[k]->intersect(ray);
+		bool blocked = hit.hit == true && hit.distance < light_distance;
 
-		if (hit.hit == true && hit.distance < light_distance) {
-			Material material = objs[k]->getMaterial();
-			if (material.is_refractive) return 0.4;
+		if (blocked && recorder) recorder->tile->objects.push_back(context.objects[k]);
+		return blocked;
+	};
 
+	int * occluder = NULL;
+	ShadowCounters * counters = NULL;
+
+	if (context.shadow_cache) {
+		OccluderCache &cache = occluderCache(context);
+		occluder = &cache.occluders[light];
+		counters = cache.counters;
+		counters->rays++;
+
+		Hit hit;
+		if (*occluder >= 0 && *occluder < (int)context.objects.size() && blocks(*occluder, hit) && !context.getMaterial(hit.material).is_refractive) {
+			counters->cache_hits++;
+			counters->blocked++;
 			return 0.0;
 		}
 	}
 
-	return 1.0;
+	// Lit points clear the entry, so that runs of them skip the test
+	if (occluder) *occluder = -1;
+
+	context.bvh.traverse(ray, light_distance, [&](int k) {
+		Hit hit;
+
+		if (blocks(k, hit)) {
+			if (!context.getMaterial(hit.material).is_refractive) {
+				if (occluder) {
+					*occluder = k;
+					counters->blocked++;
+				}
+
+				visibility = 0.0;
+				return true;
+			}
+
+			visibility = 0.4;
+		}
+
+		return false;
+	});
+
+	return visibility;
 }
 
 #endif /* Shadows_h */
@@ -1,3 +1,4 @@
+#include <cmath>
 #include "../../lib/glm.hpp"
 
 #ifndef ToneMapping_h
@@ -6,14 +7,20 @@
 /**
  * @brief Function that performs the tone mapping of a color
  * 
+ * The fast version uses that (alpha * x^beta)^(1 / gamma) is a scaling of
+ * x when beta equals gamma, which avoids the two powers.
+ *
  * @param intensity Input color
+ * @param fast_math Whether to use the fast version
  * @return Tone mapped color
  */
-glm::vec3 toneMapping(glm::vec3 intensity) {
+inline glm::vec3 toneMapping(glm::vec3 intensity, bool fast_math=false) {
 	glm::vec3 alpha(10.0);
 	glm::vec3 beta(3.0);
 	glm::vec3 gamma(3.0);
 
+	if (fast_math) return glm::clamp(cbrtf(10.0f) * intensity, glm::vec3(0.0), glm::vec3(1.0));
+
 	glm::vec3 tone_mapped = glm::pow(alpha * glm::pow(intensity, beta), glm::vec3(1.0) / gamma);
 	
 	return glm::clamp(tone_mapped, glm::vec3(0.0), glm::vec3(1.0));
@@ -16,13 +16,20 @@ public:
 	/**
 	 * @brief Construct a new Cone object
 	 * 
-	 * @param material The material of the cone
+	 * @param material The index in the material table of the material of the cone
 	 */
-	Cone (Material material) {
+	Cone (int material) {
 		this->material = material;
 		plane = new Plane(glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 1.0, 0));
 	}
 
+	/**
+	 * @brief Destroy the Cone object with its cap
+	 */
+	~Cone() {
+		delete plane;
+	}
+
   /**
 	 * @brief Implement the intersection of the cone with a ray
 	 * 
@@ -32,6 +39,8 @@ public:
 	Hit intersect(Ray ray) {
 		Hit hit;
 		hit.hit = false;
+
+		if (missesBoundingSphere(ray)) return hit;
 		
 		glm::vec3 d = inverseTransformationMatrix * glm::vec4(ray.direction, 0.0);
 		glm::vec3 o = inverseTransformationMatrix * glm::vec4(ray.origin, 1.0);
@@ -47,8 +56,9 @@ public:
 			return hit;
 		}
 		
-		float t1 = (-b - sqrt(delta)) / (2 * a);
-		float t2 = (-b + sqrt(delta)) / (2 * a);
+		// The roots are solved in double precision, whichever overloads are visible
+		float t1 = (-b - sqrt((double)delta)) / (2 * a);
+		float t2 = (-b + sqrt((double)delta)) / (2 * a);
 		
 		float t = t1;
 		hit.intersection = o + t * d;
@@ -73,6 +83,9 @@ public:
 		
 		hit.hit = true;
 		hit.object = this;
+		hit.material = material;
+		// Cones carry no texture coordinates
+		hit.uv = glm::vec2(0.0);
 		hit.intersection = transformationMatrix * glm::vec4(hit.intersection, 1.0);
 		hit.normal = normalMatrix * glm::vec4(hit.normal, 0.0);
 		hit.normal = glm::normalize(hit.normal);
@@ -80,6 +93,123 @@ public:
 		
 		return hit;
 	}
+
+	/**
+	 * @brief Get the bounding box of the cone in global coordinates
+	 *
+	 * The unit cone is the convex hull of its apex and of its unit disk at
+	 * y = 1, so the box joins the transformed apex with the box of the
+	 * transformed disk, an ellipse spanned by the images of the x and z axes.
+	 *
+	 * @return The exact box of the transformed unit cone
+	 */
+	AABB getBounds() {
+		glm::vec3 apex = transformationMatrix * glm::vec4(0.0, 0.0, 0.0, 1.0);
+		glm::vec3 disk_center = transformationMatrix * glm::vec4(0.0, 1.0, 0.0, 1.0);
+		glm::vec3 u = transformationMatrix[0];
+		glm::vec3 v = transformationMatrix[2];
+		glm::vec3 extent = glm::sqrt(u * u + v * v);
+
+		AABB bounds(disk_center - extent, disk_center + extent);
+		bounds.expand(apex);
+
+		return bounds;
+	}
+
+	/**
+	 * @brief Get the bounding box of the part of the cone inside a box
+	 *
+	 * Along an axis j, the part inside the slab of the box along another axis
+	 * k reaches its extremes at the apex, on the base disk, see ballSlabRange,
+	 * or where a side of the slab cuts the lateral surface. The points of the
+	 * lateral surface are apex + h (g + w . e) for a height h in [0, 1], g
+	 * the axis of the cone and w . e the point at angle theta on the rim of
+	 * the unit disk, e = (cos theta, sin theta), mapped by the images w of
+	 * the local x and z axes. On the side x_k = c, h = (c - apex_k) /
+	 * (g_k + w_k . e), and x_j is stationary in theta where
+	 * (g_k w_j - g_j w_k) . e' = w_j x w_k, e' being e turned by 90 degrees.
+	 * The box is the intersection of the bounds given by the three slabs.
+	 *
+	 * @param box The clipping box in global coordinates
+	 * @return A box containing the part of the cone inside the clipping box
+	 */
+	AABB clipBounds(AABB box) {
+		AABB bounds = getBounds();
+		glm::dvec3 apex = glm::vec3(transformationMatrix[3]);
+		glm::dvec3 axis = glm::vec3(transformationMatrix[1]);
+		glm::dvec3 u = glm::vec3(transformationMatrix[0]);
+		glm::dvec3 v = glm::vec3(transformationMatrix[2]);
+		glm::dvec3 disk_center = apex + axis;
+		glm::dvec3 min = glm::max(glm::dvec3(bounds.min), glm::dvec3(box.min));
+		glm::dvec3 max = glm::min(glm::dvec3(bounds.max), glm::dvec3(box.max));
+
+		for (int k = 0; k < 3; k++) {
+			double sides[2] = {box.min[k], box.max[k]};
+			glm::dvec2 w_k(u[k], v[k]);
+
+			for (int j = 0; j < 3; j++) {
+				// The cone is convex, so along the axis of the slab its part is the clipped range
+				if (j == k) continue;
+
+				glm::dvec2 w_j(u[j], v[j]);
+				double low = INFINITY, high = -INFINITY;
+
+				auto add = [&](double value) {
+					low = glm::min(low, value);
+					high = glm::max(high, value);
+				};
+
+				if (apex[k] >= sides[0] && apex[k] <= sides[1]) add(apex[j]);
+
+				double disk_low, disk_high;
+				if (ballSlabRange(disk_center[j], w_j, disk_center[k], w_k, sides[0], sides[1], disk_low, disk_high)) {
+					add(disk_low);
+					add(disk_high);
+				}
+
+				glm::dvec2 z = axis[k] * w_j - axis[j] * w_k;
+				double cross = w_j.x * w_k.y - w_j.y * w_k.x;
+				double norm = glm::length(z), scale = glm::length(w_j) * (glm::length(w_k) + fabs(axis[k])) + fabs(axis[j]) * glm::length(w_k);
+
+				// x_j is then constant along the cut, keep the unclipped bounds
+				if (norm <= 1e-9 * scale && fabs(cross) <= 1e-9 * scale) continue;
+
+				if (fabs(cross) <= norm) {
+					double angle = atan2(z.y, z.x), offset = acos(glm::clamp(cross / norm, -1.0, 1.0));
+
+					for (double side : sides) {
+						if (!std::isfinite(side)) continue;
+
+						double thetas[2] = {angle + offset, angle - offset};
+
+						for (double theta : thetas) {
+							glm::dvec2 e(sin(theta), -cos(theta));
+							double denominator = axis[k] + glm::dot(w_k, e);
+							if (denominator == 0.0) continue;
+
+							double h = (side - apex[k]) / denominator;
+							if (h >= 0.0 && h <= 1.0) add(apex[j] + h * (axis[j] + glm::dot(w_j, e)));
+						}
+					}
+				}
+
+				min[j] = glm::max(min[j], low);
+				max[j] = glm::min(max[j], high);
+			}
+		}
+
+		return clippedBox(min, max, box);
+	}
+
+protected:
+	/**
+	 * @brief Get the sphere centered on the disk and passing through the apex
+	 */
+	bool localBoundingSphere(glm::vec3 &center, float &radius) {
+		center = glm::vec3(0.0, 1.0, 0.0);
+		radius = 1.0;
+		return true;
+	}
 };
 
 #endif /* Cone_h */
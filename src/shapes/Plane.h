@@ -10,8 +10,8 @@
  */
 class Plane : public Object {
 private:
-	glm::vec3 normal;
 	glm::vec3 point;
+	glm::vec3 normal;
 
 public:
 	/**
@@ -27,9 +27,9 @@ public:
    * 
    * @param point Point of the plane
    * @param normal Normal of the plane
-   * @param material Material of the plane
+   * @param material Index in the material table of the material of the plane
    */
-	Plane(glm::vec3 point, glm::vec3 normal, Material material) : point(point), normal(normal) {
+	Plane(glm::vec3 point, glm::vec3 normal, int material) : point(point), normal(normal) {
 		this->material = material;
 	}
 
@@ -59,6 +59,9 @@ public:
 		hit.intersection = intersection;
 		hit.normal = -normal;
 		hit.object = this;
+		hit.material = material;
+		// Planes are unbounded and carry no texture coordinates
+		hit.uv = glm::vec2(0.0);
 		
 		return hit;
 	}
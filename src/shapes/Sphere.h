@@ -17,9 +17,9 @@ public:
 	/**
 	 * @brief Construct a new Sphere object
 	 * 
-	 * @param material The material of the sphere
+	 * @param material The index in the material table of the material of the sphere
 	 */
-	Sphere(Material material) {
+	Sphere(int material) {
 		this->material = material;
 		this->radius = 1.0;
 		this->center = glm::vec3(0.0);
@@ -35,6 +35,8 @@ public:
 		Hit hit;
 		hit.hit = false;
 
+		if (missesBoundingSphere(ray)) return hit;
+
 		glm::vec3 d = inverseTransformationMatrix * glm::vec4(ray.direction, 0.0);
 		glm::vec3 o = inverseTransformationMatrix * glm::vec4(ray.origin, 1.0);
 		d = glm::normalize(d);
@@ -44,13 +46,14 @@ public:
 
 		if (delta < 0) return hit;
 
-		float D = sqrt(delta);
+		// The roots and angles are solved in double precision, whichever overloads are visible
+		float D = sqrt((double)delta);
 
 		if (D > radius) return hit;
 
 		float t;
-		float t1 = glm::dot(c, d) + sqrt(1.0f - D * D);
-		float t2 = glm::dot(c, d) - sqrt(1.0f - D * D);
+		float t1 = glm::dot(c, d) + sqrt((double)(1.0f - D * D));
+		float t2 = glm::dot(c, d) - sqrt((double)(1.0f - D * D));
 
 		t = t1 < t2 ? t1 : t2;
 		if (t < 0) return hit;
@@ -60,8 +63,8 @@ public:
 		glm::vec3 normal = intersection;
 		normal = glm::normalize(normal);
 
-		float theta = asin(normal.y);
-		float phi = atan2(normal.z, normal.x);
+		float theta = fast_math ? fastAsin(normal.y) : asin((double)normal.y);
+		float phi = fast_math ? fastAtan2(normal.z, normal.x) : atan2((double)normal.z, (double)normal.x);
 		
 		hit.hit = true;
 		hit.intersection = transformationMatrix * glm::vec4(intersection, 1.0);
@@ -69,12 +72,72 @@ public:
 		hit.normal = normalMatrix * glm::vec4(normal, 0.0);
 		hit.normal = glm::normalize(hit.normal);
 		hit.object = this;
+		hit.material = material;
 
 		hit.uv.s = (theta + M_PI / 2) / M_PI;
 		hit.uv.t = (phi + M_PI) / (2 * M_PI);
 
 		return hit;
 	}
+
+	/**
+	 * @brief Get the bounding box of the sphere in global coordinates
+	 *
+	 * The transformed unit sphere is an ellipsoid whose half extent along an
+	 * axis is the norm of the matching row of the linear part of the matrix.
+	 *
+	 * @return The exact box of the transformed unit sphere
+	 */
+	AABB getBounds() {
+		glm::vec3 center = transformationMatrix[3];
+		glm::vec3 extent;
+
+		for (int axis = 0; axis < 3; axis++) {
+			extent[axis] = glm::length(glm::vec3(transformationMatrix[0][axis], transformationMatrix[1][axis], transformationMatrix[2][axis]));
+		}
+
+		return AABB(center - extent, center + extent);
+	}
+
+	/**
+	 * @brief Get the bounding box of the part of the sphere inside a box
+	 *
+	 * Each slab of the box bounds every coordinate of the ellipsoid exactly, see
+	 * ballSlabRange, and the box is the intersection of these bounds.
+	 *
+	 * @param box The clipping box in global coordinates
+	 * @return A box containing the part of the sphere inside the clipping box
+	 */
+	AABB clipBounds(AABB box) {
+		glm::dvec3 center = glm::vec3(transformationMatrix[3]);
+		glm::dvec3 rows[3], min(-INFINITY), max(INFINITY);
+
+		for (int axis = 0; axis < 3; axis++) {
+			rows[axis] = glm::dvec3(transformationMatrix[0][axis], transformationMatrix[1][axis], transformationMatrix[2][axis]);
+		}
+
+		for (int k = 0; k < 3; k++) {
+			for (int j = 0; j < 3; j++) {
+				double low, high;
+				if (!ballSlabRange(center[j], rows[j], center[k], rows[k], box.min[k], box.max[k], low, high)) return AABB();
+
+				min[j] = glm::max(min[j], low);
+				max[j] = glm::min(max[j], high);
+			}
+		}
+
+		return clippedBox(min, max, box);
+	}
+
+protected:
+	/**
+	 * @brief Get the unit sphere as its own bounding sphere
+	 */
+	bool localBoundingSphere(glm::vec3 &center, float &radius) {
+		center = this->center;
+		radius = this->radius;
+		return true;
+	}
 };
 
 #endif /* Sphere_h */
@@ -0,0 +1,183 @@
+/**
+ * @file api_smoke.c
+ * @brief Smoke test of the C API, built against bin/libraytracer.a by make test
+ *
+ * Builds a small scene through the API and checks the status codes and the
+ * results of every entry point. Also serves as a usage example.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "../src/api/raytracer.h"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while (0)
+
+int main(void) {
+	rt_scene * scene = rt_scene_create();
+	CHECK(scene != NULL);
+
+	/* A red sphere in front of the camera above a grey floor, lit from above */
+	rt_material red, grey;
+	rt_material_default(&red);
+	rt_material_default(&grey);
+	red.diffuse[0] = 1.0f; red.diffuse[1] = 0.1f; red.diffuse[2] = 0.1f;
+	grey.diffuse[0] = grey.diffuse[1] = grey.diffuse[2] = 0.5f;
+
+	int red_id = rt_scene_add_material(scene, &red);
+	int grey_id = rt_scene_add_material(scene, &grey);
+	CHECK(red_id >= 0 && grey_id >= 0 && red_id != grey_id);
+
+	rt_material invalid;
+	rt_material_default(&invalid);
+	invalid.texture = (rt_texture)3;
+	CHECK(rt_scene_add_material(scene, &invalid) == RT_INVALID_ARGUMENT);
+
+	const float transform[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 5, 1};
+	const float point[3] = {0, -1, 0}, normal[3] = {0, 1, 0};
+	const float light[3] = {0, 5, 0}, white[3] = {1, 1, 1};
+
+	/* A cone off to the side, out of the view of the camera */
+	const float cone_transform[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 10, 0, 0, 1};
+
+	int sphere = rt_scene_add_sphere(scene, transform, red_id);
+	int plane = rt_scene_add_plane(scene, point, normal, grey_id);
+	int cone = rt_scene_add_cone(scene, cone_transform, grey_id);
+	CHECK(sphere >= 0 && plane >= 0 && cone >= 0 && sphere != plane && cone != plane);
+	CHECK(rt_scene_add_light(scene, light, white) >= 0);
+	CHECK(rt_scene_add_sphere(scene, transform, 1000) == RT_INVALID_ARGUMENT);
+
+	rt_camera camera = {64, 48, 90};
+	rt_region region = {0, 0, 64, 48};
+	float * image = (float *)calloc(3 * 64 * 48, sizeof(float));
+	float * halves = (float *)calloc(3 * 64 * 48, sizeof(float));
+
+	CHECK(rt_render(scene, &camera, &region, image, 0) == RT_NOT_COMMITTED);
+
+	/* Build options come from the defaults, so their size is set */
+	rt_build_options options;
+	rt_build_options_default(&options);
+	CHECK(options.struct_size == sizeof(rt_build_options));
+
+	options.struct_size = 1;
+	CHECK(rt_scene_commit(scene, &options) == RT_INVALID_ARGUMENT);
+
+	/* A caller built before the light options were appended gets their defaults */
+	rt_build_options_default(&options);
+	options.struct_size = offsetof(rt_build_options, light_threshold);
+	options.light_samples = -1;
+	CHECK(rt_scene_commit(scene, &options) == RT_SUCCESS);
+
+	rt_build_options_default(&options);
+	options.width = 4;
+	CHECK(rt_scene_commit(scene, &options) == RT_SUCCESS);
+	CHECK(rt_scene_commit(scene, NULL) == RT_SUCCESS);
+
+	CHECK(rt_render(scene, &camera, &region, image, 0) == RT_SUCCESS);
+
+	/* The center of the image is on the red sphere */
+	const float * center = image + 3 * (24 * 64 + 32);
+	CHECK(center[0] > center[1] && center[0] > center[2]);
+
+	/* Two half regions rendered in a batch give the same image */
+	rt_render_job jobs[2] = {
+		{camera, {0, 0, 32, 48}, halves, 3 * 64},
+		{camera, {32, 0, 32, 48}, halves + 3 * 32, 3 * 64}
+	};
+
+	CHECK(rt_render_batch(scene, jobs, 2) == RT_SUCCESS);
+	CHECK(memcmp(image, halves, 3 * 64 * 48 * sizeof(float)) == 0);
+
+	rt_region outside = {32, 0, 64, 48};
+	CHECK(rt_render(scene, &camera, &outside, image, 0) == RT_INVALID_ARGUMENT);
+
+	/* A ray toward the sphere and a ray toward the sky */
+	float origins[6] = {0, 0, 0, 0, 0, 0}, directions[6] = {0, 0, 1, 0, 1, 0}, colors[6];
+	CHECK(rt_trace_rays(scene, origins, directions, 2, colors) == RT_SUCCESS);
+	CHECK(colors[0] > 0.0f && colors[3] == 0.0f && colors[4] == 0.0f && colors[5] == 0.0f);
+
+	float zeros[2] = {0, 0}, forward[2] = {1, 0}, up[2] = {0, 1}, tmax[2] = {2, INFINITY};
+	rt_ray_batch rays = {2, zeros, zeros, zeros, zeros, up, forward, NULL};
+	float distance[2];
+	int object[2], occluded[2];
+	rt_hit_batch hits = {distance, object, NULL, NULL, NULL, NULL, NULL};
+
+	CHECK(rt_intersect_rays(scene, &rays, &hits) == RT_SUCCESS);
+	CHECK(object[0] == sphere && fabsf(distance[0] - 4.0f) < 1e-3f);
+	CHECK(object[1] == -1 && isinf(distance[1]));
+
+	/* A ray down to the floor and a ray across the side of the cone, with every output */
+	float hit_origin_x[2] = {0, 10}, hit_origin_y[2] = {0, 0.5f}, hit_origin_z[2] = {0, -5};
+	float hit_direction_x[2] = {0, 0}, hit_direction_y[2] = {-1, 0}, hit_direction_z[2] = {0, 1};
+	rt_ray_batch hit_rays = {2, hit_origin_x, hit_origin_y, hit_origin_z, hit_direction_x, hit_direction_y, hit_direction_z, NULL};
+	float normal_x[2], normal_y[2], normal_z[2], hit_u[2], hit_v[2];
+	rt_hit_batch full_hits = {distance, object, normal_x, normal_y, normal_z, hit_u, hit_v};
+
+	CHECK(rt_intersect_rays(scene, &hit_rays, &full_hits) == RT_SUCCESS);
+	CHECK(object[0] == plane && fabsf(distance[0] - 1.0f) < 1e-3f);
+	CHECK(fabsf(normal_x[0]) < 1e-3f && fabsf(fabsf(normal_y[0]) - 1.0f) < 1e-3f && fabsf(normal_z[0]) < 1e-3f);
+	CHECK(hit_u[0] == 0.0f && hit_v[0] == 0.0f);
+	CHECK(object[1] == cone && fabsf(distance[1] - 4.5f) < 1e-3f);
+	CHECK(fabsf(normal_x[1]) < 1e-3f && fabsf(normal_y[1] + sqrtf(0.5f)) < 1e-3f && fabsf(normal_z[1] + sqrtf(0.5f)) < 1e-3f);
+	CHECK(hit_u[1] == 0.0f && hit_v[1] == 0.0f);
+
+	rays.tmax = tmax;
+	CHECK(rt_occluded_rays(scene, &rays, occluded) == RT_SUCCESS);
+	CHECK(occluded[0] == 0 && occluded[1] == 0);
+
+	tmax[0] = 10.0f;
+	CHECK(rt_occluded_rays(scene, &rays, occluded) == RT_SUCCESS);
+	CHECK(occluded[0] == 1 && occluded[1] == 0);
+
+	/* The SIMD texture kernels match at every instruction set level, filtered or not */
+	float u[19], v[19], width_u[19], width_v[19], lookups[2][2][3][19], reference[2][2][3][19];
+	for (int k = 0; k < 19; k++) {
+		u[k] = 0.13f * k - 1.0f;
+		v[k] = 0.07f * k - 0.5f;
+		width_u[k] = k % 3 == 0 ? 0.0f : 0.005f * k;
+		width_v[k] = k % 5 == 0 ? 0.0f : 0.01f;
+	}
+	u[3] = v[4] = -0.0f;
+
+	const char * levels[4] = {"baseline", "sse4.2", "avx2", "avx512"};
+	const rt_texture textures[2] = {RT_TEXTURE_CHECKERBOARD, RT_TEXTURE_RAINBOW};
+	const char * native = rt_get_isa();
+	CHECK(native != NULL);
+
+	for (int level = 0; level < 4; level++) {
+		CHECK(rt_set_isa(levels[level]) == RT_SUCCESS);
+
+		for (int t = 0; t < 2; t++) {
+			CHECK(rt_evaluate_texture(textures[t], 19, u, v, NULL, NULL, lookups[t][0][0], lookups[t][0][1], lookups[t][0][2]) == RT_SUCCESS);
+			CHECK(rt_evaluate_texture(textures[t], 19, u, v, width_u, width_v, lookups[t][1][0], lookups[t][1][1], lookups[t][1][2]) == RT_SUCCESS);
+		}
+
+		if (level == 0) memcpy(reference, lookups, sizeof(lookups));
+		CHECK(memcmp(reference, lookups, sizeof(lookups)) == 0);
+	}
+
+	CHECK(rt_set_isa(native) == RT_SUCCESS);
+	CHECK(rt_set_isa("mmx") == RT_INVALID_ARGUMENT);
+	CHECK(rt_evaluate_texture(RT_TEXTURE_NONE, 19, u, v, NULL, NULL, lookups[0][0][0], lookups[0][0][1], lookups[0][0][2]) == RT_INVALID_ARGUMENT);
+
+	free(image);
+	free(halves);
+	rt_scene_destroy(scene);
+
+	if (failures > 0) {
+		fprintf(stderr, "api_smoke: %d checks failed\n", failures);
+		return 1;
+	}
+
+	printf("api_smoke: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file fast_math.cpp
+ * @brief Test of the error bounds documented in src/math/FastMath.h, run by make test
+ *
+ * Every approximation is compared with the double precision libm over a
+ * dense sampling of its documented domain, and every SSE2 version with its
+ * scalar version, which computes the same polynomials.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "../src/math/FastMath.h"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while (0)
+
+/**
+ * @brief Track the largest error of an approximation and the argument reaching it
+ */
+struct MaxError {
+	const char * name;
+	double bound;
+	double error = 0.0;
+	float x = 0.0f, y = 0.0f;
+
+	MaxError(const char * name, double bound): name(name), bound(bound) {}
+
+	void add(double approximation, double reference, bool relative, float x, float y=0.0f) {
+		double difference = fabs(approximation - reference);
+		if (relative) difference /= fabs(reference);
+
+		if (!(difference <= error)) {
+			error = difference;
+			this->x = x;
+			this->y = y;
+		}
+	}
+
+	void check() {
+		printf("fast_math: %-28s max error %.3g (bound %.3g) at (%g, %g)\n", name, error, bound, x, y);
+		if (!(error < bound)) {
+			fprintf(stderr, "fast_math: %s exceeds its documented bound\n", name);
+			failures++;
+		}
+	}
+};
+
+#if defined(__SSE2__)
+/**
+ * @brief Check that an SSE2 version gives the bits of the scalar version on 4 arguments
+ */
+static bool sameBits(__m128 vector, const float scalar[4]) {
+	float lanes[4];
+	_mm_storeu_ps(lanes, vector);
+
+	return memcmp(lanes, scalar, sizeof(lanes)) == 0;
+}
+#endif
+
+int main() {
+	const int samples = 1 << 20;
+
+	MaxError sqrt_error("fastSqrt, x > 0", 3e-7);
+	for (int k = 0; k < samples; k++) {
+		float x = powf(2.0f, -100.0f + 200.0f * k / samples);
+		sqrt_error.add(fastSqrt(x), sqrt((double)x), true, x);
+	}
+	sqrt_error.check();
+
+	MaxError asin_error("fastAsin, [-1, 1]", 7e-5);
+	for (int k = 0; k <= samples; k++) {
+		float x = -1.0f + 2.0f * k / samples;
+		asin_error.add(fastAsin(x), asin((double)x), false, x);
+	}
+	asin_error.check();
+
+	MaxError atan2_error("fastAtan2, all directions", 1.2e-5);
+	for (int k = 0; k < samples; k++) {
+		double angle = 2.0 * M_PI * k / samples - M_PI;
+		float radius = powf(2.0f, (float)(k % 41) - 20.0f);
+		float y = radius * sin(angle), x = radius * cos(angle);
+		atan2_error.add(fastAtan2(y, x), atan2((double)y, (double)x), false, y, x);
+	}
+	atan2_error.check();
+
+	MaxError pow_error("fastPow, (0, 1] x [0, 128]", 1.5e-5);
+	MaxError pow_moderate_error("fastPow, |y log2(x)| < 16", 3.5e-6);
+	for (int i = 1; i <= 1024; i++) {
+		for (int j = 0; j <= 1024; j++) {
+			float x = (float)i / 1024, y = 128.0f * j / 1024;
+			double reference = pow((double)x, (double)y);
+			if (reference < 1e-37) continue;
+
+			pow_error.add(fastPow(x, y), reference, true, x, y);
+			if (fabs(y * log2((double)x)) < 16.0) pow_moderate_error.add(fastPow(x, y), reference, true, x, y);
+		}
+	}
+	pow_error.check();
+	pow_moderate_error.check();
+
+	CHECK(fastSqrt(0.0f) == 0.0f && fastSqrt(-1.0f) == 0.0f);
+	CHECK(fastAtan2(0.0f, 0.0f) == 0.0f);
+	CHECK(fastPow(0.0f, 0.0f) == 1.0f && fastPow(0.0f, 2.0f) == 0.0f);
+
+#if defined(__SSE2__)
+	// The vector versions compute the same operations as the scalar ones
+	int mismatches[6] = {0, 0, 0, 0, 0, 0};
+
+	for (int k = 0; k < samples; k += 4) {
+		float x[4], y[4], scalar[4];
+
+		for (int lane = 0; lane < 4; lane++) {
+			x[lane] = -1.0f + 2.0f * (k + lane) / samples;
+			y[lane] = 128.0f * (k + lane) / samples;
+		}
+
+		__m128 vx = _mm_loadu_ps(x), vy = _mm_loadu_ps(y);
+
+		for (int lane = 0; lane < 4; lane++) scalar[lane] = fastAsin(x[lane]);
+		mismatches[0] += !sameBits(fastAsin4(vx), scalar);
+
+		for (int lane = 0; lane < 4; lane++) scalar[lane] = fastAtan2(y[lane] - 64.0f, x[lane]);
+		mismatches[1] += !sameBits(fastAtan24(_mm_sub_ps(vy, _mm_set1_ps(64.0f)), vx), scalar);
+
+		for (int lane = 0; lane < 4; lane++) scalar[lane] = fastSqrt(y[lane]);
+		mismatches[2] += !sameBits(fastSqrt4(vy), scalar);
+
+		for (int lane = 0; lane < 4; lane++) scalar[lane] = fastPow(fabsf(x[lane]), y[lane]);
+		mismatches[3] += !sameBits(fastPow4(_mm_andnot_ps(_mm_set1_ps(-0.0f), vx), vy), scalar);
+
+		for (int lane = 0; lane < 4; lane++) scalar[lane] = fastLog2(y[lane] + 1e-3f);
+		mismatches[4] += !sameBits(fastLog24(_mm_add_ps(vy, _mm_set1_ps(1e-3f))), scalar);
+
+		for (int lane = 0; lane < 4; lane++) scalar[lane] = fastExp2(y[lane] - 64.0f);
+		mismatches[5] += !sameBits(fastExp24(_mm_sub_ps(vy, _mm_set1_ps(64.0f))), scalar);
+	}
+
+	const char * names[6] = {"fastAsin4", "fastAtan24", "fastSqrt4", "fastPow4", "fastLog24", "fastExp24"};
+
+	for (int f = 0; f < 6; f++) {
+		if (mismatches[f] > 0) fprintf(stderr, "fast_math: %s differs from the scalar version in %d of %d groups\n", names[f], mismatches[f], samples / 4);
+		CHECK(mismatches[f] == 0);
+	}
+#endif
+
+	if (failures > 0) {
+		fprintf(stderr, "fast_math: %d checks failed\n", failures);
+		return 1;
+	}
+
+	printf("fast_math: all checks passed\n");
+	return 0;
+}
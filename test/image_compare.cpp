@@ -0,0 +1,72 @@
+/**
+ * @file image_compare.cpp
+ * @brief Comparison of a render with a golden image, run by make test
+ *
+ * Usage: image_compare GOLDEN IMAGE MAX_DIFFERENCE
+ *
+ * Both images are plain (P3) PPM images. The comparison fails if their sizes
+ * differ or if a channel differs by more than MAX_DIFFERENCE out of 255.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Read a plain PPM image, skipping its comments
+ *
+ * @return False if the file is not a plain PPM image
+ */
+static bool readImage(const char * path, int &width, int &height, vector<int> &channels) {
+	ifstream file(path);
+	string format, comment;
+	int max_value;
+
+	if (!(file >> format) || format != "P3") return false;
+
+	while (file >> ws && file.peek() == '#') getline(file, comment);
+	if (!(file >> width >> height >> max_value)) return false;
+
+	channels.resize((size_t)3 * width * height);
+	for (int &channel : channels) {
+		if (!(file >> channel)) return false;
+	}
+
+	return true;
+}
+
+int main(int argc, const char * argv[]) {
+	if (argc != 4) {
+		cerr << "Usage: " << argv[0] << " GOLDEN IMAGE MAX_DIFFERENCE" << endl;
+		return 2;
+	}
+
+	int golden_width, golden_height, width, height;
+	vector<int> golden, image;
+
+	if (!readImage(argv[1], golden_width, golden_height, golden) || !readImage(argv[2], width, height, image)) {
+		cerr << "image_compare: cannot read " << argv[1] << " or " << argv[2] << endl;
+		return 1;
+	}
+
+	if (width != golden_width || height != golden_height) {
+		cerr << "image_compare: " << argv[2] << " is " << width << "x" << height << ", expected " << golden_width << "x" << golden_height << endl;
+		return 1;
+	}
+
+	int tolerance = atoi(argv[3]), differing = 0, largest = 0;
+
+	for (size_t k = 0; k < golden.size(); k++) {
+		int difference = abs(golden[k] - image[k]);
+		differing += difference > 0;
+		largest = max(largest, difference);
+	}
+
+	cout << "image_compare: " << argv[2] << " differs from " << argv[1] << " in " << differing << " channels, at most by " << largest << " (tolerance " << tolerance << ")" << endl;
+	return largest <= tolerance ? 0 : 1;
+}